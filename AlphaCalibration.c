@@ -1,4 +1,4 @@
-//g++ AlphaCalibration.c -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -lROOTTPython -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -o bin/Alphacal
+//g++ AlphaCalibration.c -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -lROOTTPython -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -ICommon -o bin/Alphacal
 
 
 
@@ -34,6 +34,10 @@
 #include <dirent.h>
 
 #include "TS3.h"
+#include "ReadAhead.h"
+#include "InputIndex.h"
+#include "PerfReport.h"
+#include "ChannelTable.h"
 
 TList *hlist;
 TList *flist;
@@ -237,42 +241,20 @@ void Initialize(){
 // Save hists into the global TList *hlist;
 void MakeHist(std::string infile, const char* calfile, int minCH, int maxCH){
 
-  TChain *fragtree = new TChain("FragmentTree");
-  int size = infile.find_last_of("/");
-  std::string directory = infile.substr(0,size);
-  int num = infile.find_last_of("_");
-  std::string runnumber = infile.substr(num-5,5);
-  std::cout << "Directory: " << directory << ", Run number: " << runnumber << std::endl;
-
   //Finds all subruns for a specific run
-  std::vector<std::string> runlist;
-  DIR * pDIR;
-  struct dirent * entry;
-  if ((pDIR = opendir(directory.c_str()))) {
-    while ((entry = readdir(pDIR))) {
-      if (strstr(entry->d_name, runnumber.c_str())) {
-        std::string file = directory;
-  file.append("/");
-  file.append(entry->d_name);
-  if(strstr(file.c_str(),"fragment")) runlist.push_back(file);
-      }
-    }
-    closedir(pDIR);
-  }   
-  std::sort(runlist.begin(),runlist.end()); // Puts subruns in order
-  for(int i = 0; i<runlist.size(); i++) {
-    fragtree->Add(runlist.at(i).c_str());
-  }
+  std::vector<std::string> runlist = FindSubruns(infile, "fragment");
+  InputIndex index("FragmentTree");
+  TChain *fragtree = index.MakeChain(runlist);
 
-  long nentries = fragtree->GetEntries();
-  TFragment * tfrag = 0;
-  fragtree->SetBranchAddress("TFragment", & tfrag);
-  TChannel::ReadCalFile(calfile);
+  if(!LoadChannels(calfile)) return;   // parsed once, or mapped from its snapshot
+  SetupReadCache(fragtree, {"TFragment"});
+  ReadAhead<TFragment> reader(fragtree, "TFragment");   // GetEntry() runs on the reader thread
+  long nentries = reader.GetEntries();
 
   long xentry = 0;
-  for(xentry;xentry<nentries;xentry++){
-    fragtree->GetEntry(xentry);
-    int chnum = tfrag->GetChannelNumber();
+  while(TFragment *tfrag = reader.Next()){
+    xentry = reader.Entry();
+    int chnum = gChannels.Number(tfrag->GetAddress());
     if(chnum>=minCH && chnum<=maxCH){
       double charge = tfrag->GetCharge();
       if(calmap.empty()){
@@ -287,7 +269,8 @@ void MakeHist(std::string infile, const char* calfile, int minCH, int maxCH){
       fflush(stdout);
     }
   }
-  printf("Making Hist DONE!  Entry: %lu / %lu \n", xentry, nentries);
+  gPerf.Count("hits", xentry+1);   // one hit per fragment
+  printf("Making Hist DONE!  Entry: %lu / %lu \n", xentry+1, nentries);
 
   if(calmap.empty()){
     for(int i=0;i<2000;i++){
@@ -304,42 +287,21 @@ void MakeHist(std::string infile, const char* calfile, int minCH, int maxCH){
 // Save hists into the global TList *hlist;
 void MakeAHist(std::string infile, const char* calfile, int minCH, int maxCH){
 
-  TChain *analytree = new TChain("AnalysisTree");
-  int size = infile.find_last_of("/");
-  std::string directory = infile.substr(0,size);
-  int num = infile.find_last_of("_");
-  std::string runnumber = infile.substr(num-5,5);
-  std::cout << "Directory: " << directory << ", Run number: " << runnumber << std::endl;
-
   //Finds all subruns for a specific run
-  std::vector<std::string> runlist;
-  DIR * pDIR;
-  struct dirent * entry;
-  if ((pDIR = opendir(directory.c_str()))) {
-    while ((entry = readdir(pDIR))) {
-      if (strstr(entry->d_name, runnumber.c_str())) {
-        std::string file = directory;
-  file.append("/");
-  file.append(entry->d_name);
-  if(strstr(file.c_str(),"analysis")) runlist.push_back(file);
-      }
-    }
-    closedir(pDIR);
-  }   
-  std::sort(runlist.begin(),runlist.end()); // Puts subruns in order
-  for(int i = 0; i<runlist.size(); i++) {
-    analytree->Add(runlist.at(i).c_str());
-  }
-
-  long nentries = analytree->GetEntries();
-  TS3 *s3 = NULL;
-  analytree->SetBranchAddress("TS3", &s3);
+  std::vector<std::string> runlist = FindSubruns(infile, "analysis");
+  InputIndex index("AnalysisTree");
+  TChain *analytree = index.MakeChain(runlist);
 
-  TChannel::ReadCalFile(calfile);
+  if(!LoadChannels(calfile)) return;   // parsed once, or mapped from its snapshot
+  SetupReadCache(analytree, {"TS3"});
+  ReadAhead<TS3> reader(analytree, "TS3");   // GetEntry() runs on the reader thread
+  long nentries = reader.GetEntries();
 
   long xentry = 0;
-  for(xentry;xentry<nentries;xentry++){
-    analytree->GetEntry(xentry);
+  long nhits = 0;
+  while(TS3 *s3 = reader.Next()){
+    xentry = reader.Entry();
+    nhits += s3->GetSectorMultiplicity() + s3->GetRingMultiplicity();
     for(int i=0;i<s3->GetSectorMultiplicity();i++){
       TS3Hit *sector_hit = s3->GetSectorHit(i);
       double sector_t = sector_hit->GetTime();
@@ -354,7 +316,7 @@ void MakeAHist(std::string infile, const char* calfile, int minCH, int maxCH){
           hdt2->Fill(dt);
         }
       }// ring loop over
-      int sector_ch = sector_hit->GetChannelNumber();
+      int sector_ch = gChannels.Number(sector_hit->GetAddress());
       double sector_c = sector_hit->GetCharge();
       if(calmap.empty()){
         sumc->Fill(sector_c, sector_ch);
@@ -366,7 +328,7 @@ void MakeAHist(std::string infile, const char* calfile, int minCH, int maxCH){
 
     for(int i=0;i<s3->GetRingMultiplicity();i++){
       TS3Hit *ring_hit = s3->GetRingHit(i);
-      int ring_ch = ring_hit->GetChannelNumber();
+      int ring_ch = gChannels.Number(ring_hit->GetAddress());
       double ring_c = ring_hit->GetCharge();
       if(calmap.empty()){
         sumc->Fill(ring_c, ring_ch);
@@ -381,7 +343,8 @@ void MakeAHist(std::string infile, const char* calfile, int minCH, int maxCH){
       fflush(stdout);
     }
   }
-  printf("Making Hist DONE!  Entry: %lu / %lu \n", xentry, nentries);
+  gPerf.Count("hits", nhits);
+  printf("Making Hist DONE!  Entry: %lu / %lu \n", xentry+1, nentries);
 
   if(calmap.empty()){
     for(int i=0;i<2000;i++){
@@ -427,8 +390,8 @@ void CalHist(int minCH, int maxCH, Option_t *opt=""){
       double xwidth = (max-min)/2.;
       hist->GetXaxis()->SetRangeUser(min-xwidth, max+xwidth);  
       TF1 *fc = tasf(hist, Form("fc_CH%i",ich), min,max,"c");
-      hist->Fit(fc,"LQ");     
-      hist->Fit(fc,"LQ");     
+      gPerf.TimedFit(ich, hist, fc, "LQ");
+      gPerf.TimedFit(ich, hist, fc, "LQ");
       flist->Add(fc);
       double gain = fc->GetParameter("gain");
       double offset = fc->GetParameter("offset");
@@ -516,6 +479,8 @@ int main(int agrc, char **agrv){
   }
 
   TParserLibrary::Get()->Load();
+  gPerf.Start("AlphaCalibration", agrc, agrv);
+  EnableParallelRead();   // before the reader and fill threads start
   
   ChMin_int = atoi(ChMin);
   ChMax_int = atoi(ChMax);
@@ -538,6 +503,7 @@ int main(int agrc, char **agrv){
   hdt2->Write();
   newf->Close();
   printf("Input file:%s\nCalibration file: %s\nOutput File: %s\nStarting Channel: %s\nEnding Channel: %s\n",infile,calfile,outfile,ChMin,ChMax);
+  gPerf.Write();
   
 
   return 0;
@@ -9,8 +9,13 @@
 RAW_HIST="raw_hist.root"
 FIT_HIST="fit_hist.root"
 HIST="hist.root"
+EVENTS="events.root"
 CAL_TXT="Calibration.txt"
 RES_CHECK="Res_Check.dat"
+ENTRY_INDEX="entry_index.dat"
+CHAN_SNAP="*.chsnap"
+DRIFT_TABLE="drift_*.dat"
+FIT_CACHE="fit_cache.dat"
 
 # Histogram outputs
 HIST_FILES="Hist_*.root"
@@ -19,7 +24,7 @@ HIST_FILES="Hist_*.root"
 TMP_FILES="fit_output.tmp"
 
 # Directories that may contain outputs
-DIRS_TO_CLEAN=("co60" "peaks" "HistFiles")
+DIRS_TO_CLEAN=("co60" "peaks" "HistFiles" "hist_cache" "shards" "perf")
 
 # --------------------------------------------
 # Helper function: ask before deleting
@@ -53,8 +58,13 @@ echo "============================================"
 ask_and_remove "$RAW_HIST"
 ask_and_remove "$FIT_HIST"
 ask_and_remove "$HIST"
+ask_and_remove "$EVENTS"
 ask_and_remove "$CAL_TXT"
 ask_and_remove "$RES_CHECK"
+ask_and_remove "$ENTRY_INDEX"
+ask_and_remove "$CHAN_SNAP"
+ask_and_remove "$DRIFT_TABLE"
+ask_and_remove "$FIT_CACHE"
 ask_and_remove "$TMP_FILES"
 
 # --------------------------------------------
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 # =============================
-# Build script for 3 programs
+# Build script for all programs
 # =============================
 
 CXX=g++
@@ -21,7 +21,7 @@ GRSIFLAGS=$(grsi-config --cflags --all-libs --GRSIData-libs)
 EXTRA_LIBS="-lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -lX11 -lXpm -lROOTTPython"
 
 # --- Include paths ---
-INCLUDES="-I$GRSISYS/GRSIData/include"
+INCLUDES="-I$GRSISYS/GRSIData/include -I../Common"
 
 # =============================
 # Compile RawHistMaker
@@ -47,6 +47,18 @@ $CXX src/FitRawHist.cxx $CXXFLAGS \
 
 echo "✔ FitRawHist built → $BINDIR/FitRawHist"
 
+# =============================
+# Compile QuickLook
+# =============================
+echo "Compiling QuickLook..."
+$CXX src/QuickLook.cxx $CXXFLAGS \
+    $ROOTFLAGS $EXTRA_LIBS \
+    -L/opt/local/lib -lX11 -lXpm \
+    $GRSIFLAGS $INCLUDES \
+    -o "$BINDIR/QuickLook"
+
+echo "✔ QuickLook built → $BINDIR/QuickLook"
+
 # =============================
 # Compile HistMakers
 # =============================
@@ -59,6 +71,43 @@ $CXX src/HistMakers.cxx $CXXFLAGS \
 
 echo "✔ HistMakers built → $BINDIR/HistMakers"
 
+# =============================
+# Compile MergeHists (ROOT only)
+# =============================
+echo "Compiling MergeHists..."
+$CXX ../Common/MergeHists.cxx -O2 $ROOTFLAGS -o "$BINDIR/MergeHists"
+
+echo "✔ MergeHists built → $BINDIR/MergeHists"
+
+# =============================
+# Compile ResultsQuery (no ROOT)
+# =============================
+echo "Compiling ResultsQuery..."
+$CXX ../Common/ResultsQuery.cxx -O2 -o "$BINDIR/ResultsQuery"
+
+echo "✔ ResultsQuery built → $BINDIR/ResultsQuery"
+
+# =============================
+# Compile EventBuilder (FragmentTree -> compact events)
+# =============================
+echo "Compiling EventBuilder..."
+$CXX ../Common/EventBuilder.cxx $CXXFLAGS -pthread \
+    $ROOTFLAGS $GRSIFLAGS $INCLUDES \
+    -o "$BINDIR/EventBuilder"
+
+echo "✔ EventBuilder built → $BINDIR/EventBuilder"
+
+# =============================
+# Compile CalibChain (whole chain in one process, only the libraries it uses)
+# =============================
+echo "Compiling CalibChain..."
+$CXX ../Common/CalibChain.cxx $CXXFLAGS -pthread \
+    $(root-config --cflags --libs) -lSpectrum -lMinuit \
+    $GRSIFLAGS $INCLUDES \
+    -o "$BINDIR/CalibChain"
+
+echo "✔ CalibChain built → $BINDIR/CalibChain"
+
 echo "=============================="
 echo "✔ All programs compiled into $BINDIR/"
 echo "=============================="
@@ -9,6 +9,9 @@ BIN_DIR="./bins"
 RAW_EXE="${BIN_DIR}/RawHistMaker"
 FIT_EXE="${BIN_DIR}/FitRawHist"
 HIST_EXE="${BIN_DIR}/HistMakers"
+MERGE_EXE="${BIN_DIR}/MergeHists"
+QUICK_EXE="${BIN_DIR}/QuickLook"
+CHAIN_EXE="${BIN_DIR}/CalibChain"
 
 CAL_FILE="/data1/yzhu/Projects/S2403/CalibrationFileClean.cal"
 
@@ -18,14 +21,106 @@ ANALYSIS_FILES=(
                 /data1/yzhu/Projects/S2403/AnalysisTrees/analysis62348*
 )
 
+# FragmentTree input (optional): if set, Step 1 fills raw_hist.root straight from the
+# fragments, one subrun per thread, without waiting for the AnalysisTrees
+FRAGMENT_FILES=(
+)
+FRAG_THREADS=8
+
 # Output files
 RAW_HIST="raw_hist.root"
 RES_CHECK="Res_Check.dat"
-TMP_OUT="fit_output.tmp"
+
+# FitRawHist options: refit only some channels (e.g. "-ch 0 99 -list bad_channels.txt"; write
+# them to another RES_CHECK then), "-global" to fit the channels of each -ch range (one
+# detector) together with shared source parameters, "-refit" to ignore fit_cache.dat, and the
+# threads reading raw_hist.root
+FIT_OPTS=""
+FIT_THREADS=4
+
+# Adaptive RawHistMaker: stop reading once every active channel has this many counts in the
+# Pu/Am/Cm peak window, found from the seed of each channel (0 = read all entries; the
+# histogram cache is not used in this mode)
+TARGET_COUNTS=0
+
+# Quick-look mode (1 = yes, 0 = no): only publish Res_Check.dat snapshots from a growing
+# random sample of the input (1%, 2%, 4%, ... up to all entries), then exit
+RUN_QUICKLOOK=0
+
+# Single process (1 = yes, 0 = no): Step 1 + Step 2 in one CalibChain process, histograms stay
+# in memory between the steps (same output files; not combined with NSHARDS)
+SINGLE_PROCESS=0
+
+# Results store: every fit is also appended to $RESULTS_STORE (default results/) under the
+# run number CAL_RUN, taken from the first input file name (analysis62347_000.root -> 62347)
+# unless set by hand. Query with ResultsQuery, e.g. "ResultsQuery alpha 1000 50".
+export RESULTS_STORE="${RESULTS_STORE-results}"
+export CAL_RUN="${CAL_RUN:-$(basename "${FRAGMENT_FILES[0]:-${ANALYSIS_FILES[0]}}" | sed -n 's/.*\([0-9]\{5\}\)_[0-9]*\.root$/\1/p')}"
+
+# Gain drift tracking (AnalysisTree input, not sharded): DRIFT_SLICE > 0 makes RawHistMaker also
+# track the gain of every channel in slices of DRIFT_SLICE seconds in the same pass and write
+# drift_s3.dat; HistMakers then fills the S3 charges corrected with it. DRIFT_REFILL=1 refills
+# raw_hist.root with the correction before the fits (one more pass over the input). One run
+# per table: the slices follow the time stamps, which restart with every run.
+DRIFT_SLICE=0
+DRIFT_REFILL=0
 
 # Optional: run HistMakers (1 = yes, 0 = no)
 RUN_HISTMAKERS=0
 
+# Sharded mode: split ANALYSIS_FILES into NSHARDS parts, one process each (1 = single process)
+# Partial outputs go to shards/, MergeHists adds them up (same result as a single process)
+NSHARDS=1
+
+# ============================================
+# run_sharded EXE OUTPUT MERGE_OPTS ARGS...
+# Run "EXE -o shards/OUTPUT_<n> ARGS... <files of shard n>" for every shard in the
+# background, then merge the shards into OUTPUT. The shard commands can also be sent to
+# separate batch nodes; only the MergeHists line has to run after all of them.
+# ============================================
+run_sharded() {
+  local exe="$1" out="$2" mopts="$3"
+  shift 3
+  local nfiles=${#ANALYSIS_FILES[@]}
+  local per=$(( (nfiles + NSHARDS - 1) / NSHARDS ))
+  mkdir -p shards
+  rm -f shards/"${out%.root}"_*.root
+  for ((n=0; n<NSHARDS; n++)); do
+    local part=("${ANALYSIS_FILES[@]:$((n*per)):$per}")
+    [[ ${#part[@]} -eq 0 ]] && continue
+    "$exe" -o "shards/${out%.root}_${n}.root" "$@" "${part[@]}" > "shards/${out%.root}_${n}.log" 2>&1 &
+  done
+  wait
+  "$MERGE_EXE" $mopts "$out" shards/"${out%.root}"_*.root
+}
+
+# ============================================
+# Quick-look (skips the full pipeline)
+# ============================================
+if [[ $RUN_QUICKLOOK -eq 1 ]]; then
+  echo "============================================"
+  echo "[QUICK-LOOK] Running QuickLook, $RES_CHECK is updated after every step"
+  echo "============================================"
+  "$QUICK_EXE" -out "$RES_CHECK" "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+  exit $?
+fi
+
+# ============================================
+# Step 1 + 2 in one process
+# ============================================
+if [[ $SINGLE_PROCESS -eq 1 ]]; then
+  echo "============================================"
+  echo "[STEP 1+2] Running CalibChain alpha"
+  echo "============================================"
+  if (( ${#FRAGMENT_FILES[@]} > 0 )); then
+    "$CHAIN_EXE" alpha -frag -nthreads "$FRAG_THREADS" "$CAL_FILE" "${FRAGMENT_FILES[@]}"
+  else
+    "$CHAIN_EXE" alpha -target "$TARGET_COUNTS" "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+  fi
+  echo "[OK] $RAW_HIST and $RES_CHECK created."
+  echo
+else
+
 # ============================================
 # Step 1: Run RawHistMaker
 # ============================================
@@ -35,50 +130,41 @@ echo "Calibration file : $CAL_FILE"
 echo "Analysis files   : $ANALYSIS_FILES"
 echo "============================================"
 
-"$RAW_EXE" "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+if (( ${#FRAGMENT_FILES[@]} > 0 )); then
+  "$RAW_EXE" -frag -nthreads "$FRAG_THREADS" "$CAL_FILE" "${FRAGMENT_FILES[@]}"
+elif (( NSHARDS > 1 )); then
+  run_sharded "$RAW_EXE" "$RAW_HIST" "-min 10" "$CAL_FILE"
+else
+  DRIFT_ARGS=()
+  (( DRIFT_SLICE > 0 )) && DRIFT_ARGS=(-drift "$DRIFT_SLICE")
+  if (( TARGET_COUNTS > 0 )); then
+    "$RAW_EXE" -target "$TARGET_COUNTS" "${DRIFT_ARGS[@]}" "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+  else
+    "$RAW_EXE" "${DRIFT_ARGS[@]}" "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+  fi
+  if (( DRIFT_SLICE > 0 && DRIFT_REFILL == 1 )) && [[ -f drift_s3.dat ]]; then
+    echo "[STEP 1] Refilling $RAW_HIST with the drift correction"
+    "$RAW_EXE" -driftcor drift_s3.dat "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+  fi
+fi
 
 echo "[OK] Raw histogram created: $RAW_HIST"
 echo
 
 # ============================================
-# Step 2: Run FitRawHist
-# Capture stdout and generate Res_Check.dat
+# Step 2: Run FitRawHist (writes Res_Check.dat)
 # ============================================
 echo "============================================"
 echo "[STEP 2] Running FitRawHist"
 echo "============================================"
 
-"$FIT_EXE" "$RAW_HIST" > "$TMP_OUT"
-
-awk '
-BEGIN {
-  OFS = "\t";
-}
-NR == 1 {
-  print "#CHANNEL", "FWHM(Pu)", "FWHM(Am)", "FWHM(Cm)",
-        "Res%(5.8MeV)", "GAIN", "OFFSET";
-  next;
-}
-NF >= 6 {
-  chan = $1;
-  fpu  = $2;
-  fam  = $3;
-  fcm  = $4;
-  gain = $5;
-  offs = $6;
-
-  res = fcm / 5800.0 * 100.0;
-
-  printf "%.0f\t%.4f\t%.4f\t%.4f\t%.2f\t%.4f\t%.4f\n",
-        chan, fpu, fam, fcm, res, gain, offs;
-}
-' "$TMP_OUT" > "$RES_CHECK"
-
-rm -f "$TMP_OUT"
+"$FIT_EXE" -nthreads "$FIT_THREADS" $FIT_OPTS "$RAW_HIST" "$RES_CHECK"
 
 echo "[OK] Res_Check.dat created."
 echo
 
+fi
+
 # ============================================
 # Step 3: Run HistMakers (optional)
 # ============================================
@@ -87,7 +173,13 @@ if [[ $RUN_HISTMAKERS -eq 1 ]]; then
   echo "[STEP 3] Running HistMakers"
   echo "============================================"
 
-  "$HIST_EXE" "$CAL_FILE" $ANALYSIS_FILES
+  DRIFT_ARGS=()
+  (( DRIFT_SLICE > 0 )) && [[ -f drift_s3.dat ]] && DRIFT_ARGS=(-driftcor drift_s3.dat)
+  if (( NSHARDS > 1 )); then
+    run_sharded "$HIST_EXE" "hist.root" "" "${DRIFT_ARGS[@]}" "$CAL_FILE"
+  else
+    "$HIST_EXE" "${DRIFT_ARGS[@]}" "$CAL_FILE" "${ANALYSIS_FILES[@]}"
+  fi
 else
   echo "[INFO] HistMakers step skipped."
 fi
@@ -34,6 +34,56 @@ def read_resolution_file(filename):
 
   return channel, fwhm_pu, fwhm_am, fwhm_cm, res, gain, offset
 
+# ==================================================================== #
+import os
+import struct
+
+# ResultsStore.h layouts: ResultRec, index header and index entry
+_REC = struct.Struct("<qqii16siiff6f6f")
+_IDX_HEAD = struct.Struct("<8sq")
+_IDX_ENTRY = struct.Struct("<16siiqq")
+
+def read_store_history(channel, stage="alpha", last=50, store="results"):
+  """
+  History of one channel from the results store (../Common/ResultsStore.h), newest first,
+  without reading the whole log: the index gives the last record of (stage, channel) and
+  every record points to the previous one.
+
+  Returns a list of dicts: run, time, sub, val (6), err (6), chi2ndf, status, seconds.
+  val for stage "alpha": gain, offset, fwhmPu, fwhmAm, fwhmCm, res%.
+  """
+  logname = os.path.join(store, "results.log")
+  idxname = os.path.join(store, "results.idx")
+  nrec = os.path.getsize(logname) // _REC.size
+  head, covered = -1, 0
+  if os.path.exists(idxname):
+    with open(idxname, "rb") as f:
+      magic, n = _IDX_HEAD.unpack(f.read(_IDX_HEAD.size))
+      if magic.startswith(b"RSIDX1") and n <= nrec:
+        covered = n
+        while True:
+          buf = f.read(_IDX_ENTRY.size)
+          if len(buf) < _IDX_ENTRY.size:
+            break
+          st, ch, _, lastrec, _ = _IDX_ENTRY.unpack(buf)
+          if ch == channel and st.rstrip(b"\0").decode() == stage:
+            head = lastrec
+  out = []
+  with open(logname, "rb") as f:
+    # records appended after the index was written
+    for k in range(covered, nrec):
+      f.seek(k * _REC.size)
+      r = _REC.unpack(f.read(_REC.size))
+      if r[3] == channel and r[4].rstrip(b"\0").decode() == stage:
+        head = k
+    while head >= 0 and len(out) < last:
+      f.seek(head * _REC.size)
+      r = _REC.unpack(f.read(_REC.size))
+      out.append({"time": r[0], "run": r[2], "sub": r[5], "status": r[6], "chi2ndf": r[7],
+                  "seconds": r[8], "val": list(r[9:15]), "err": list(r[15:21])})
+      head = r[1]
+  return out
+
 # ==================================================================== #
 import matplotlib.pyplot as plt
 import numpy as np
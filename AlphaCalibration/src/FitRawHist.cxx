@@ -1,4 +1,4 @@
-//g++ FitRawHist.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -lROOTTPython -o FitRawHist
+//g++ FitRawHist.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -I../../Common -lROOTTPython -pthread -o FitRawHist
 
 
 #include <iostream>  
@@ -7,24 +7,32 @@
 #include <cmath>     
 #include <algorithm>
 #include <string> 
+#include <sstream>
+#include <vector>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <stdio.h>   
 #include "TH1.h"     
 #include "TF1.h"     
 #include "TFile.h"   
 #include "TList.h"   
 #include "TKey.h"
+#include "TROOT.h"
 #include "TSpectrum.h"
+#include "CalibCore.h"   // PeakHunt(), tasf(), FitAlphaHist(), WriteResCheck(), SeedAlphaHist()
+#include "GlobalAlphaFit.h"   // GlobalAlphaFit()
+#include "FitCache.h"        // AlphaFitCache, CachedFitAlphaHist()
 
 
 
 TList *hlist;
 TList *flist;
-std::vector<int> vec_chan; 
-std::vector<double> vec_gain; 
-std::vector<double> vec_offs; 
-std::vector<double> vec_rePu; 
-std::vector<double> vec_reAm; 
-std::vector<double> vec_reCm;
+std::vector<AlphaFit> fits;
 
 
 // =============== Initialize() =================== //
@@ -33,309 +41,249 @@ void Initialize(){
   flist = new TList;
 }
 
-// ============= TripleAlphaHighE_Fun() ======================= //
-// TF1 formula for triple alpha source, 239Pu, 241Am, and 244Cm
-// Simulate a triple alpha spectrum for comparison to a histogram
-// Energy calibration and width of peaks are parameters given up to quadratic linear
-Double_t TripleAlphaHighE_Fun(Double_t *x, Double_t *par){
-// Parameters:
-// par[0] -- Normalization factor for 239Pu group
-// par[1] -- Normalization factor for 241Am group
-// par[2] -- Normalization factor for 244Cm group
-// par[3] -- FWHM of peaks in keV
-// par[4] -- Bg: Constant offset in counts*
-// par[5] -- Width of Pu peaks relative to Cm
-// par[6] -- Width of Am peaks relative to Cm
-// par[7] -- Offset
-// par[8] -- Linear gain
-  
-  Double_t E = par[7]+par[8]*x[0];
-  Double_t sigmaCm = par[3]/2.35;
-  Double_t sigmaPu = sigmaCm*par[5];
-  Double_t sigmaAm = sigmaCm*par[6];
- 
-  Double_t return_f = par[0] * ( 0.7077 * TMath::Gaus(E,5156.59,sigmaPu)    // Pu
-                              +0.1711 * TMath::Gaus(E,5144.30,sigmaPu)
-                              +0.1194 * TMath::Gaus(E,5105.80,sigmaPu) )
-                     +par[1] * ( 0.0036 * TMath::Gaus(E,5544.5,sigmaAm)     // Am
-                              +0.0166 * TMath::Gaus(E,5388,sigmaAm)
-                              +0.848 * TMath::Gaus(E,5485.56,sigmaAm)
-                              +0.131 * TMath::Gaus(E,5442.8,sigmaAm) )
-                     +par[2] * ( 0.769 * TMath::Gaus(E,5804.77,sigmaCm)     // Cm
-                              +0.231 * TMath::Gaus(E,5762.16,sigmaCm ) )
-                     +par[4];                                               // Bg
-  return return_f;
-}
- 
- 
-// ============= TripleAlphaLowE_Fun() ======================= //
-// TF1 formula for triple alpha source, 148Gd, 230Th, 244Cm
-// Simulate a triple alpha spectrum for comparison to a histogram
-// Energy calibration and width of peaks are parameters given up to quadratic linear
-Double_t TripleAlphaLowE_Fun(Double_t *x, Double_t *par){
-// Parameters:
-// par[0] -- Normalization factor for 148Gd group
-// par[1] -- Normalization factor for 230Th group
-// par[2] -- Normalization factor for 244Cm group
-// par[3] -- FWHM of peaks in keV
-// par[4] -- Bg: Constant offset in counts*
-// par[5] -- Width of Gd peaks relative to Cm
-// par[6] -- Width of Th peaks relative to Cm
-// par[7] -- Offset
-// par[8] -- Linear gain
-  
-  Double_t E = par[7]+par[8]*x[0];
-  Double_t sigmaCm = par[3]/2.35;
-  Double_t sigmaGd = sigmaCm*par[5];
-  Double_t sigmaTh = sigmaCm*par[6];
- 
-  Double_t return_f = par[0] * ( 1.0 * TMath::Gaus(E,3182.690,sigmaGd))
-                     +par[1] * ( 0.2340 * TMath::Gaus(E,4620.5,sigmaTh)
-                              +0.763 * TMath::Gaus(E,4687.0,sigmaTh) )
-                     +par[2] * ( 0.769 * TMath::Gaus(E,5804.77,sigmaCm)
-                              +0.231 * TMath::Gaus(E,5762.16,sigmaCm ) )
-                     +par[4];
-  return return_f;
-}
+// =============== Channel selection =================== //
+// -ch min max (any number of ranges) and -list file (channel numbers, '#' for comments);
+// nothing given = every channel
+struct ChannelSelection{
+  std::vector<std::pair<int,int>> ranges;
+  std::set<int> list;
+  bool All() const { return ranges.empty() && list.empty(); }
+  bool Has(int ch) const {
+    if(All() || list.count(ch)) return true;
+    for(const auto &r : ranges) if(ch>=r.first && ch<=r.second) return true;
+    return false;
+  }
+};
 
-// ============== PeakHunt() ================ //
-// Peak search in TH1 *hist by using TSpectrum;
-// Return a vector of x-axis position of 3 peaks with highest y-values;
-// TH1 *hist needs to zoom in a reasonable range to skip noise at low ADC channel. 
-std::vector<Double_t> PeakHunt(TH1 *hist){
-  TSpectrum *s = new TSpectrum(10); //max positions = 10
-  hist->GetXaxis()->SetRangeUser(50, hist->GetNbinsX()*hist->GetBinWidth(1)-1); // skip the nosiy peak
-  Int_t npeaks = s->Search(hist,1,"",0.08); // rough peak-search through the entire hist
-  Double_t *xpeaks = s->GetPositionX();
-  Double_t *ypeaks = s->GetPositionY();
-  std::vector<std::pair<Double_t, Double_t>> peaks;
-  for(int ipeak=0;ipeak<npeaks;ipeak++){
-    peaks.emplace_back(xpeaks[ipeak], ypeaks[ipeak]);
+bool ReadChannelList(const char *fname, std::set<int> &list){
+  std::ifstream infile(fname);
+  if(!infile.is_open()){
+    printf("Error: cannot open channel list %s\n", fname);
+    return false;
   }
-  // order peaks based on y-values from highest to lowest;
-  // extract the first 3 elements (3 highest peak) and put their x-values in a new vector top_xpeaks;
-  // then order top_xpeaks from lowest to highest based on their values;
-  // extract the first and last bin, which should be centers of the first and last true alpha peaks;
-  std::sort(peaks.begin(), peaks.end(), [](const auto &m, const auto &n){return m.second > n.second;});
-  std::vector<Double_t> top_xpeaks;
-  if(npeaks>=3){
-    for(int ipeak=0;ipeak<3;ipeak++){
-      top_xpeaks.push_back(peaks[ipeak].first);
-    }
-  }else{
-    for(int ipeak=0;ipeak<npeaks;ipeak++){
-      top_xpeaks.push_back(peaks[ipeak].first);
-    }
+  std::string line;
+  while(std::getline(infile, line)){
+    if(line.empty() || line[0]=='#') continue;
+    std::stringstream ss(line);
+    int ch;
+    while(ss >> ch) list.insert(ch);
   }
-  std::sort(top_xpeaks.begin(), top_xpeaks.end());
-  return top_xpeaks;
+  return true;
 }
 
-// ============== tasf() =================== //
-// Return a well defined TF1 for TH1 *h fit
-// TH1 *h needs to zoom in a reasonable range to skip noise at low ADC channel. 
-// max and min should be centroids of the first and the last true alpha peaks from the source.
-// if max or min <0, which means PeakHunt() never been called. Call PeakHunt() to obtain max and min values.
-// Options:
-// c: open 2 linear calibration parameters. These two parameters are fixed as default.
-// l: set the TF1 math formula to LowE_Fun. HighE_Fun as default.
-// d: for double peaks
-TF1 *tasf(TH1 *h, const char* name = "tas", Double_t min=-1, Double_t max=-1, Option_t *opt=""){
-    
-  int xbinfirst = h->GetXaxis()->GetFirst();
-  int xbinlast  = h->GetXaxis()->GetLast();
-  double fit_xlower = h->GetBinLowEdge(xbinfirst); 
-  double fit_xupper = h->GetBinLowEdge(xbinlast) + h->GetBinWidth(xbinlast); 
-  double ymax = h->GetMaximum(); 
-    
-  TString sopt(opt);
-  sopt.ToLower();
-  sopt.ReplaceAll(" ","");
-    
-  TF1 *fx = 0;
-  Int_t Npx = Int_t((xbinlast-xbinfirst+1)*10);
-    
-  // Choose the fitting formula
-  if(sopt.Contains("l")){
-    fx = new TF1(name, TripleAlphaLowE_Fun, fit_xlower, fit_xupper, 9);
-    fx->SetParNames("Gd","Th","Cm","fwhmCm","bg","Gd_n","Th_n","offset","gain");
-    fx->SetParLimits(5,0.8,1.3);
-    fx->SetParLimits(6,0.8,1.2);
-    fx->SetNpx(Npx);
-    fx->SetParameters(50,50,50,25,0,1,1,0,20);
-    fx->SetParLimits(0,0,ymax*10);
-    fx->SetParLimits(1,0,ymax*10);
-    fx->SetParLimits(2,0,ymax*10);
-    fx->SetParLimits(3,20,500);
-    fx->SetParLimits(4,0,ymax);    // bg should not be higher than a true peak.
-  }else{ // default fit with TripleAlphaHighE_Fun
-    fx = new TF1(name, TripleAlphaHighE_Fun, fit_xlower,fit_xupper, 9);
-    fx->SetParNames("Pu","Am","Cm","fwhmCm","bg","Pu_n","Am_n","offset","gain");
-    fx->SetParLimits(5,0.5,1.5);
-    fx->SetParLimits(6,0.5,1.5);
-    fx->SetNpx(Npx);
-    fx->SetParameters(50,50,50,25,0,1,1,0,20);
-    fx->SetParLimits(0,0,ymax*10);
-    fx->SetParLimits(1,0,ymax*10);                                                                                    
-    fx->SetParLimits(2,0,ymax*10);
-    fx->SetParLimits(3,20,500);
-    fx->SetParLimits(4,0,ymax);    // bg should not be higher than a true peak.
-    if(sopt.Contains("d")){ // if there are only two peaks in the spectrum. Assume they are from Am and Cm
-      fx->FixParameter(0,0);
-      fx->FixParameter(5,1);
-    }
-  } 
-    
-  // Need calibration for the current histogram or not
-  if(sopt.Contains("c")){
-    // TODO: chekc the size of peaks, if peaks.size() == 0, which means the zoom in range is wrong
-    // less than 3 peaks hunting in the hist. Reset the range! 
-    if(max<0 || min<0){
-      std::vector<double> xpeaks = PeakHunt(h);
-      min = xpeaks.front();
-      max = xpeaks.back();
+// =============== HistLoader =================== //
+// Reads the given TH1D keys of fname on nthreads threads, each with its own TFile, so the
+// histograms are decompressed in parallel. Next() hands them out in key order as soon as
+// each one is read: the fits start on the first channels while the later ones are loading.
+class HistLoader{
+public:
+  HistLoader(const char *fname, const std::vector<std::string> &names, int nthreads)
+    : fName(fname), fKeys(names), fHists(names.size(), nullptr), fDone(names.size(), 0) {
+    ROOT::EnableThreadSafety();
+    nthreads = std::max(1, std::min(nthreads, (int)names.size()));
+    for(int t=0;t<nthreads;t++) fThreads.emplace_back([this]{ Read(); });
+  }
+  ~HistLoader(){
+    fNext = fKeys.size();   // workers stop after their current key
+    for(std::thread &t : fThreads) t.join();
+    gPerf.AddTime("wait_for_input", fWaitSec);
+    gPerf.Count("hists_read", fNRead);
+  }
+
+  // next histogram in key order (waits until it is read); nullptr after the last one
+  TH1D *Next(){
+    while(fPos < fKeys.size()){
+      auto t0 = std::chrono::steady_clock::now();
+      std::unique_lock<std::mutex> lock(fMutex);
+      fCV.wait(lock, [this]{ return fDone[fPos] != 0; });
+      lock.unlock();
+      fWaitSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      TH1D *h = fHists[fPos++];
+      if(h) return h;   // nullptr: key could not be read
     }
-    Double_t gain, offset;
-    if(sopt.Contains("l")){
-      gain = (5804.77-3182.69)/(max-min);
-    }else{
-      if(sopt.Contains("d")){
-        gain = (5804.77-5485.56)/(max-min);
-      }else{
-        gain = (5804.77-5156.59)/(max-min);
+    return nullptr;
+  }
+
+private:
+  void Read(){
+    PerfTimer timer("read_hists");   // summed over the loader threads
+    TFile *file = TFile::Open(fName.c_str(), "read");
+    while(true){
+      size_t i = fNext++;
+      if(i >= fKeys.size()) break;
+      TH1D *h = (file && !file->IsZombie()) ? (TH1D *)file->Get(fKeys[i].c_str()) : nullptr;
+      if(h){
+        h->SetDirectory(nullptr);
+        fNRead++;
       }
+      std::lock_guard<std::mutex> lock(fMutex);
+      fHists[i] = h;
+      fDone[i] = 1;
+      fCV.notify_all();
     }
-    offset = 5804.77 - gain*max;
-    fx->SetParameter(7,offset);  
-    fx->SetParameter(8,gain); 
-  }else{
-    fx->FixParameter(7,0);  // Calibration offset = 0
-    fx->FixParameter(8,1);  // Calibration gain   = 1
-  } 
-  return fx;
-}
+    if(file) file->Close();
+    delete file;
+  }
 
+  std::string fName;
+  std::vector<std::string> fKeys;
+  std::vector<TH1D *> fHists;
+  std::vector<char> fDone;
+  std::vector<std::thread> fThreads;
+  std::atomic<size_t> fNext{0};
+  std::atomic<long> fNRead{0};
+  size_t fPos = 0;
+  double fWaitSec = 0;
+  std::mutex fMutex;
+  std::condition_variable fCV;
+};
 
-// =============== ReadHist =================== //
-void ReadHist(const char* fname){
+// =============== SelectKeys() =================== //
+// Names of the TH1D keys (hs<channel>) of fname in the selection, in key order; only the key
+// list is read here, not the histograms
+std::vector<std::string> SelectKeys(const char *fname, const ChannelSelection &sel){
+  std::vector<std::string> names;
   TFile *file = TFile::Open(fname);
   if (!file || file->IsZombie()) {
     printf("Error: cannot open file %s\n", fname);
-    return;
+    return names;
   }
   TIter nextKey(file->GetListOfKeys());
-  TKey *key = nullptr;    
+  TKey *key = nullptr;
   while ((key = (TKey *)nextKey())) {
     if (strcmp(key->GetClassName(), "TH1D") != 0) continue;
-    TH1D *h = (TH1D *)key->ReadObj();
-    if (h->GetEntries()<10) continue;
-    hlist->Add(h);
+    const char *name = key->GetName();
+    if (!sel.All() && (strncmp(name, "hs", 2) != 0 || !sel.Has(atoi(name+2)))) continue;
+    if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);   // newest cycle only
   }
+  file->Close();
+  return names;
 }
 
 // =============== CalRawHist() =================== //
-void CalRawHist(){
-  TIter nextHist(hlist);
-  TH1D *hist = nullptr;  
-  
-  while((hist = (TH1D *)nextHist())){
+// Fit every histogram of the loader as soon as it is read; channels whose histogram is
+// unchanged since the last run get their result from the fit cache
+void CalRawHist(HistLoader &loader, AlphaFitCache &cache){
+  while(TH1D *hist = loader.Next()){
+    if (hist->GetEntries()<10) {
+      delete hist;
+      continue;
+    }
+    hlist->Add(hist);
     TString hname = hist->GetName();
     TString ch = hname(2,hname.Length()-2);
-    vec_chan.push_back(std::stoi(ch.Data()));
-    std::vector<Double_t> top_xpeaks = PeakHunt(hist);   
-    if(top_xpeaks.size()<2){
-      //found # of peaks < 3. something wrong with the current hist
-      vec_gain.push_back(1);
-      vec_offs.push_back(0);
-      vec_reCm.push_back(-1);
-      vec_reAm.push_back(-1);
-      vec_rePu.push_back(-1);
-    }else{
-      Double_t min = top_xpeaks.front();
-      Double_t max = top_xpeaks.back();
-      double xwidth = (max-min)/2.;
-      hist->GetXaxis()->SetRangeUser(min-xwidth, max+xwidth);  
-      TF1 *fc;
-      if(top_xpeaks.size()==2){
-        fc = tasf(hist, Form("fc_CH%i",std::stoi(ch.Data())), min,max, "cd");
-      }else{
-        fc = tasf(hist, Form("fc_CH%i",std::stoi(ch.Data())), min,max, "c");
-      }
-      hist->Fit(fc,"LQ");     
-      hist->Fit(fc,"LQ");     
-      flist->Add(fc);
-      double gain = fc->GetParameter("gain");
-      double offset = fc->GetParameter("offset");
-      double reCm = fc->GetParameter("fwhmCm");
-      double reAm = reCm * fc->GetParameter(6);
-      double rePu = reCm * fc->GetParameter(5);
-      vec_gain.push_back(gain); 
-      vec_offs.push_back(offset); 
-      vec_reCm.push_back(reCm); 
-      vec_reAm.push_back(reAm);
-      vec_rePu.push_back(rePu);
-      flist->Add(fc);
-    }
+    AlphaFit fit = CachedFitAlphaHist(cache, hist, std::stoi(ch.Data()));
+    if(fit.fx) flist->Add(fit.fx);
+    fits.push_back(fit);
   } // hist loop over
 }
 
-// =============== WriteFile() =================== //
-void WriteFile(){
-  std::cout << "#CHANNEL" << "\t" 
-            << "FWHM(Pu)"<< "\t\t"
-            << "FWHM(Am)"<< "\t\t"
-            << "FWHM(Cm)"<< "\t\t"
-            << "GAIN"    << "\t\t"
-            << "OFFSET"  << std::endl;
-  // Write parameters into the txt file
-  std::ofstream outfile;
-  outfile.open("Calibration.txt");
-  outfile << "float GAIN[" << vec_gain.size() <<"] = {" << vec_gain[0];
-  for(int i=0;i<vec_chan.size();i++){
-    std::cout << vec_chan[i] << "\t"
-              << vec_rePu[i] << "\t\t"
-              << vec_reAm[i] << "\t\t"
-              << vec_reCm[i] << "\t\t"
-              << vec_gain[i] << "\t\t"
-              << vec_offs[i] << std::endl;
-    if(i>0){
-      outfile << ", " << vec_gain[i];
-    }
+// =============== GlobalRefit() =================== //
+// Refit the channels of each -ch range together (all channels if no -ch is given, the -list
+// channels as one more group) with shared Pu_n, Am_n and Pu/Am/Cm ratios, starting from the
+// separate fits of CalRawHist(). Return one summary line per group.
+std::string GlobalRefit(const ChannelSelection &sel){
+  std::vector<std::pair<int,int>> groups = sel.ranges;
+  if(groups.empty() || !sel.list.empty()) groups.push_back({-1, -1});   // everything else
+  std::vector<std::vector<TH1 *>> ghists(groups.size());
+  std::vector<std::vector<AlphaFit>> gfits(groups.size());
+  std::vector<std::vector<size_t>> gidx(groups.size());
+  for(size_t i=0;i<fits.size();i++){
+    size_t g = 0;
+    while(g+1<groups.size() && !(fits[i].ch>=groups[g].first && fits[i].ch<=groups[g].second)) g++;
+    ghists[g].push_back((TH1 *)hlist->At(i));
+    gfits[g].push_back(fits[i]);
+    gidx[g].push_back(i);
   }
-  outfile << "};\n" << "float OFFSET[" << vec_offs.size() << "] = {" << vec_offs[0];
-  for(int i=1;i<vec_chan.size();i++){
-    outfile << ", " << vec_offs[i];
+  std::string summary;
+  for(size_t g=0;g<groups.size();g++){
+    if(gfits[g].empty()) continue;
+    GlobalAlphaPars pars = GlobalAlphaFit(ghists[g], gfits[g]);
+    for(size_t k=0;k<gidx[g].size();k++) fits[gidx[g][k]] = gfits[g][k];
+    std::string line = FormatGlobalAlphaPars(pars);
+    if(groups[g].first >= 0) line = Form("ch %i-%i %s", groups[g].first, groups[g].second, line.c_str());
+    printf("%s\n", line.c_str());
+    summary += (summary.empty() ? "" : "; ") + line;
   }
-  outfile << "};";
-  outfile.close();
-  std::cout << "Writing gains and offsets to " << "Calibration.txt" << std::endl;
+  return summary;
 }
 
 
 // =============== main() =================== //
 // Input File:
 // 1. raw_hist.root: made by "RawHistMaker.cxx"
+// 2. [Res_Check.dat]: output table of the fit results (default Res_Check.dat)
+// Options (before the file names):
+//   -ch min max    fit only channels min~max (can be given several times)
+//   -list file     fit only the channels listed in file
+//   -nthreads N    threads reading the histograms (default 4)
+//   -refit         refit every channel, even if its fit cache entry (FitCache.h) is up to date
+//   -global        refit the channels of each -ch range (one S3 detector) together, with
+//                  shared Pu_n, Am_n and Pu/Am/Cm intensity ratios (GlobalAlphaFit.h)
 int main(int argc, char **argv){
-  
-  if(argc<2){
-    printf("Input raw_hist.root\ni");
+
+  ChannelSelection sel;
+  int nthreads = 4;
+  bool global = false;
+  bool refit = false;
+  int iarg = 1;
+  while(iarg<argc && argv[iarg][0]=='-'){
+    std::string o = argv[iarg];
+    if(o=="-ch" && iarg+2<argc){
+      sel.ranges.push_back({atoi(argv[iarg+1]), atoi(argv[iarg+2])});
+      iarg += 3;
+    }else if(o=="-list" && iarg+1<argc){
+      if(!ReadChannelList(argv[iarg+1], sel.list)) return 1;
+      iarg += 2;
+    }else if(o=="-nthreads" && iarg+1<argc){
+      nthreads = atoi(argv[iarg+1]);
+      iarg += 2;
+    }else if(o=="-refit"){
+      refit = true;
+      iarg++;
+    }else if(o=="-global"){
+      global = true;
+      iarg++;
+    }else{
+      break;
+    }
+  }
+  if(argc-iarg<1){
+    printf("Input [-ch min max] [-list channels.txt] [-nthreads N] [-refit] [-global] raw_hist.root [Res_Check.dat]\n");
     return 1;
   }
-  
-  const char *fname = argv[1];
-  // Step1: Read all hist;
+
+  gPerf.Start("FitRawHist", argc, argv);
+  const char *fname = argv[iarg];
+  const char *rescheck = (argc-iarg>1) ? argv[iarg+1] : "Res_Check.dat";
+  // Step1: list the selected hists; they are read on nthreads threads while Step2 runs
   Initialize();
-  ReadHist(fname); 
-  // Step2: Fit each hist
-  CalRawHist();
-  // Step3: Print fitting results and save gain and offset into .dat file
-  WriteFile();
+  std::vector<std::string> names = SelectKeys(fname, sel);
+  printf("%zu histograms selected in %s\n", names.size(), fname);
+  {
+    HistLoader loader(fname, names, nthreads);
+    // Step2: Fit each hist
+    AlphaFitCache cache;
+    cache.SetRefit(refit);
+    CalRawHist(loader, cache);
+    cache.Write();
+    int ncached = std::count_if(fits.begin(), fits.end(), [](const AlphaFit &f){ return f.cached; });
+    printf("%zu channels: %i refitted, %i from the fit cache\n", fits.size(), (int)fits.size()-ncached, ncached);
+  }
+  // Step2b: global fit of each detector with the shared source parameters
+  std::string comment;
+  if(global) comment = GlobalRefit(sel);
+  // Step3: Print fitting results, save gain and offset into Calibration.txt and Res_Check.dat
+  WriteCalibrationTxt(fits);
+  WriteResCheck(rescheck, fits, comment);
+  StoreAlphaFits(fits);
   // Step 4: Write raw histograms + fitting fx into fit_hist.root
   TFile *newf = new TFile("fit_hist.root","recreate");
   newf->cd();
   hlist->Write();
   flist->Write();
   newf->Close();
+  gPerf.Write();
 
   return 0;
 }
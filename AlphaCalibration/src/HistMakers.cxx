@@ -1,10 +1,11 @@
-//g++ src/HistMakers.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -lROOTTPython -o HistMakers
+//g++ src/HistMakers.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -I../Common -lROOTTPython -o HistMakers
 
 #include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <TFile.h>
+#include <TSystem.h>
 #include <TTree.h>
 #include <TChain.h>
 #include <TList.h>
@@ -19,6 +20,12 @@
 #include "TS3.h"
 #include "TRandom.h"
 #include "TRandom3.h"
+#include "ShardOptions.h"
+#include "ReadAhead.h"
+#include "InputIndex.h"
+#include "PerfReport.h"
+#include "ChannelTable.h"
+#include "DriftTracker.h"
 
 
 // ================================= Calibration data structure ============================//
@@ -118,12 +125,7 @@ TVector3 GetS3Position(int det, int ring, int sec, bool rings_facing_target = fa
 // Make uncalibrated histogram    
 // Analysis TTree                 
 void MakeHist(TChain *chain, char const *calfile){
-  long nentries = chain->GetEntries();
-  TS3 *s3 = NULL;                 
-  chain->SetBranchAddress("TS3", &s3);
-  if(chain->FindBranch("TS3")){   
-    chain->SetBranchAddress("TS3", &s3);
-  }else{                          
+  if(!chain->FindBranch("TS3")){   
     std::cout << "Branch 'TS3' not found! TS3 variable is NULL pointer" << std::endl;
     return;                       
   }                               
@@ -144,22 +146,31 @@ void MakeHist(TChain *chain, char const *calfile){
   TH2D *cal_sum   = new TH2D("cal_sum",  "Calibrated summary plot"  , 6000,0,6000, 1100,0,1100);
   // ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
   
-  if(TChannel::ReadCalFile(calfile) < 1) {
-    std::cout << "No channels found in calibration file " << calfile << "!" << std::endl;
-    return;                       
-  }                               
+  if(!LoadChannels(calfile)) return;
   std::cout<<std::endl;
 
+  SetupReadCache(chain, {"TS3"});
+  ReadAhead<TS3> reader(chain, "TS3");   // GetEntry() runs on the reader thread
+  long nentries = reader.GetEntries();
   long xentry = 0;      
-  for(xentry;xentry<nentries;xentry++){                                                                               
-    chain->GetEntry(xentry);      
+  int curtree = -1;
+  long nhits = 0;
+  while(TS3 *s3 = reader.Next()){
+    xentry = reader.Entry();
+    nhits += s3->GetSectorMultiplicity() + s3->GetRingMultiplicity();
+    if(reader.TreeNumber() != curtree){
+      // smearing seeded per input file, so any split of the file list (sharded Run.sh) gives the same histograms
+      curtree = reader.TreeNumber();
+      TString fname = gSystem->BaseName(reader.FileName().c_str());
+      rand3.SetSeed(fname.Hash() + 1);
+    }
     for(int i=0;i<s3->GetSectorMultiplicity();i++){
       TS3Hit *sec_hit = s3->GetSectorHit(i);
       int sec_det  = sec_hit->GetDetector(); 
       int sec      = sec_hit->GetSector();
-      double sec_c = sec_hit->GetCharge();
       double sec_t = sec_hit->GetTime();
-      int sec_ch   = sec_hit->GetChannelNumber();
+      int sec_ch   = gChannels.Number(sec_hit->GetAddress());
+      double sec_c = gDriftCor.Apply(sec_ch, sec_t, sec_hit->GetCharge());
       double sec_e = ApplyLinCal(calmap, sec_ch, sec_c);
       uncal_sum->Fill(sec_c, sec_ch);
       cal_sum  ->Fill(sec_e, sec_ch);
@@ -183,8 +194,8 @@ void MakeHist(TChain *chain, char const *calfile){
     }// i (sector) loop over      
     for(int j=0;j<s3->GetRingMultiplicity();j++){
       TS3Hit *ring_hit = s3->GetRingHit(j);
-      double ring_c = ring_hit->GetCharge();
-      int ring_ch   = ring_hit->GetChannelNumber();
+      int ring_ch   = gChannels.Number(ring_hit->GetAddress());
+      double ring_c = gDriftCor.Apply(ring_ch, ring_hit->GetTime(), ring_hit->GetCharge());
       double ring_e = ApplyLinCal(calmap, ring_ch, ring_c);
       uncal_sum->Fill(ring_c, ring_ch);
       cal_sum  ->Fill(ring_e, ring_ch);
@@ -195,6 +206,7 @@ void MakeHist(TChain *chain, char const *calfile){
       fflush(stdout);              
     }                              
   } // entries loop over           
+  gPerf.Count("hits", nhits);
   for(int i=0;i<2;i++){
     hlist->Add(s3_XY[i]);
     hlist->Add(dthist[i]);
@@ -205,23 +217,32 @@ void MakeHist(TChain *chain, char const *calfile){
   hlist->Add(uncal_sum);
   hlist->Add(cal_sum);
   
-  printf("Making Raw Hist DONE!  Entry: %lu / %lu \n", xentry, nentries);
+  printf("Making Raw Hist DONE!  Entry: %lu / %lu \n", xentry+1, nentries);
 }
 
 // ====================================== main() ==========================================//
+// [-o shard.root]: write the histograms to shard.root instead of hist.root
+// [-driftcor drift_s3.dat]: S3 charges corrected with the drift table of RawHistMaker -drift
 // argv1: CalibrationFile
 // argv2...: AnalysisTree File Path
 int main(int argc, char** argv){
+  gPerf.Start("HistMakers", argc, argv);
+  EnableParallelRead();   // before the reader and fill threads start
+  ShardOptions opt = ParseShardOptions(argc, argv);
+  DriftOptions dopt;
+  if(!ParseDriftOptions(argc, argv, dopt)) return 1;
   if(argc<3){
     printf("Input Calibration file and Analysistree file paths");
     return 1;
   }
   //Step 1: loop over root file if files are valid
-  TChain *chain = new TChain("AnalysisTree");
+  std::vector<std::string> files;
   for(int i=2;i<argc;i++){
     std::string rootfilename = argv[i];
-    chain->Add(rootfilename.c_str());
+    files.push_back(rootfilename);
   }
+  InputIndex index("AnalysisTree");
+  TChain *chain = index.MakeChain(files);
   if(chain->GetEntries()==0){
     printf("No valid root file input\n");
     return 1;
@@ -236,10 +257,11 @@ int main(int argc, char** argv){
   MakeHist(chain, calfile);
  
   // Step 4: Write raw histograms into output.root
-  TFile *newf = new TFile("hist.root","recreate");
+  TFile *newf = new TFile(opt.out.empty() ? "hist.root" : opt.out.c_str(),"recreate");
   newf->cd();
   hlist->Write();
   newf->Close();  
+  gPerf.Write();
  
   return 0;
 }
@@ -0,0 +1,190 @@
+//g++ QuickLook.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -I../../Common -lROOTTPython -o QuickLook
+
+// Quick-look calibration: RawHistMaker + FitRawHist on a growing random sample of the input.
+// The AnalysisTree entries of every file are cut into blocks of a fixed number of entries
+// (-block, default 20000), each read as one contiguous range. The blocks are read in a random
+// order that is stratified over the input files (every file contributes in proportion to its
+// size at any point), and Res_Check.dat is published after 1%, 2%, 4%, ... of the blocks,
+// until all entries are read and the result is the full-statistics one.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TList.h>
+#include <TH1.h>
+#include <TRandom3.h>
+#include <TStopwatch.h>
+#include "TChannel.h"
+#include "TS3.h"
+#include "ReadAhead.h"
+#include "InputIndex.h"
+#include "CalibCore.h"   // fits of FitRawHist
+
+TH1D *hs[1100]; // same histograms as RawHistMaker
+
+// ============================ Block ========================================//
+struct Block{
+  long first;   // chain entries [first, last)
+  long last;
+  double key;   // position in the sampling order
+};
+
+// ============================ MakeBlocks() ========================================//
+// Blocks of blocksize entries of every file, sorted in the stratified random order:
+// the k-th (shuffled) block of a file with n blocks gets key (k+u)/n, u uniform in [0,1).
+std::vector<Block> MakeBlocks(const std::vector<long> &counts, long blocksize, TRandom3 &rnd){
+  std::vector<Block> blocks;
+  long offset = 0;
+  for(long n : counts){
+    if(n <= 0) continue;
+    std::vector<Block> fblocks;
+    for(long first=0;first<n;first+=blocksize){
+      fblocks.push_back({offset+first, offset+std::min(first+blocksize, n), 0});
+    }
+    std::vector<int> order(fblocks.size());
+    for(size_t k=0;k<order.size();k++) order[k] = k;
+    for(size_t k=order.size();k>1;k--) std::swap(order[k-1], order[rnd.Integer(k)]);
+    for(size_t k=0;k<fblocks.size();k++){
+      fblocks[order[k]].key = (k + rnd.Rndm()) / fblocks.size();
+    }
+    blocks.insert(blocks.end(), fblocks.begin(), fblocks.end());
+    offset += n;
+  }
+  std::sort(blocks.begin(), blocks.end(), [](const Block &a, const Block &b){ return a.key < b.key; });
+  return blocks;
+}
+
+// ============================ FillBlock() ========================================//
+// Same fill as FillS3Hist() (CalibCore.h) on entries [first, last)
+void FillBlock(TChain *chain, TS3 *&s3, long first, long last){
+  for(long xentry=first;xentry<last;xentry++){
+    if(chain->GetEntry(xentry) <= 0) continue;
+    for(int i=0;i<s3->GetSectorMultiplicity();i++){
+      TS3Hit *sec_hit = s3->GetSectorHit(i);
+      int ch = gChannels.Number(sec_hit->GetAddress());
+      if(ch>=0 && ch<1100) hs[ch]->Fill(sec_hit->GetCharge());
+    }
+    for(int i=0;i<s3->GetRingMultiplicity();i++){
+      TS3Hit *ring_hit = s3->GetRingHit(i);
+      int ch = gChannels.Number(ring_hit->GetAddress());
+      if(ch>=0 && ch<1100) hs[ch]->Fill(ring_hit->GetCharge());
+    }
+  }
+}
+
+// ============================ Snapshot() ========================================//
+// Fit copies of the current histograms with FitAlphaHist() (same fits as FitRawHist) and
+// publish the result in the Res_Check.dat format with WriteResCheck().
+void Snapshot(const char *outname, long nread, long ntotal, double seconds){
+  std::vector<AlphaFit> fits;
+  for(int i=0;i<1100;i++){
+    if(hs[i]->GetEntries()<10) continue;
+    TH1D *h = (TH1D *)hs[i]->Clone();
+    h->SetDirectory(nullptr);
+    fits.push_back(FitAlphaHist(h, i));
+    delete fits.back().fx;   // only the numbers are published
+    fits.back().fx = nullptr;
+    delete h;
+  }
+  if(!WriteResCheck(outname, fits, Form("quick-look: %ld / %ld entries (%.1f%%), %.1f s",
+                                        nread, ntotal, 100.*nread/ntotal, seconds))) return;
+
+  int nbad = 0;
+  for(const AlphaFit &f : fits) if(f.fwhmCm<0) nbad++;
+  printf("Snapshot %5.1f%% (%.1f s): %zu channels fitted, %i failed -> %s\n",
+         100.*nread/ntotal, seconds, fits.size(), nbad, outname);
+}
+
+
+// ====================================== main() ==========================================//
+// [-first F]: fraction of the blocks read before the first snapshot (default 0.01)
+// [-stop F]:  stop after this fraction (default 1 = full statistics)
+// [-block N]: entries per block (default 20000)
+// [-out file]: snapshot file (default Res_Check.dat)
+// argv1: CalibrationFile
+// argv2...: AnalysisTree File Path
+int main(int argc, char** argv){
+  gPerf.Start("QuickLook", argc, argv);
+  EnableParallelRead();   // before the reader and fill threads start
+  double firstfrac = 0.01, stopfrac = 1.0;
+  long blocksize = 20000;
+  const char *outname = "Res_Check.dat";
+  int iarg = 1;
+  while(iarg+1<argc && argv[iarg][0]=='-'){
+    std::string o = argv[iarg];
+    if(o=="-first")      firstfrac = atof(argv[iarg+1]);
+    else if(o=="-stop")  stopfrac  = atof(argv[iarg+1]);
+    else if(o=="-block") blocksize = atol(argv[iarg+1]);
+    else if(o=="-out")   outname   = argv[iarg+1];
+    else break;
+    iarg += 2;
+  }
+  if(argc-iarg<2 || blocksize<1 || firstfrac<=0){
+    printf("Input [-first F] [-stop F] [-block N] [-out file] Calibration file and Analysistree file paths\n");
+    return 1;
+  }
+  const char *calfile = argv[iarg];
+  std::vector<std::string> files;
+  for(int i=iarg+1;i<argc;i++) files.push_back(argv[i]);
+
+  TStopwatch sw;
+  InputIndex index("AnalysisTree");
+  std::vector<long> counts = index.Count(files);
+  TChain *chain = index.MakeChain(files, counts);
+  long ntotal = chain->GetEntries();
+  if(ntotal==0){
+    printf("No valid root file input\n");
+    return 1;
+  }
+  if(!LoadCalFile(calfile)) return 1;
+  if(!chain->FindBranch("TS3")){
+    std::cout << "Branch 'TS3' not found! TS3 variable is NULL pointer" << std::endl;
+    return 1;
+  }
+
+  for(int i=0;i<1100;i++){
+    hs[i] = new TH1D(Form("hs%i",i),Form("uncalibrated energy histogram at CH %i",i), 4000,0,4000);
+  }
+  TRandom3 rnd(1);   // fixed seed: the same input gives the same sequence of snapshots
+  std::vector<Block> blocks = MakeBlocks(counts, blocksize, rnd);
+
+  SetupReadCache(chain, {"TS3"});
+  TS3 *s3 = nullptr;
+  chain->SetBranchAddress("TS3", &s3);
+
+  size_t nstop = std::min(blocks.size(), (size_t)std::ceil(stopfrac*blocks.size()));
+  size_t next  = std::max<size_t>(1, std::ceil(firstfrac*blocks.size()));
+  size_t done  = 0;
+  long nread   = 0;
+  while(done < nstop){
+    size_t upto = std::min(next, nstop);
+    // read this step's blocks in entry order, so each file is opened once per step
+    std::vector<Block> step(blocks.begin()+done, blocks.begin()+upto);
+    std::sort(step.begin(), step.end(), [](const Block &a, const Block &b){ return a.first < b.first; });
+    {
+      PerfTimer timer("fill");
+      for(const Block &b : step){
+        FillBlock(chain, s3, b.first, b.last);
+        nread += b.last - b.first;
+      }
+    }
+    done = upto;
+    PerfTimer timer("snapshot");
+    Snapshot(outname, nread, ntotal, sw.RealTime());
+    sw.Continue();
+    next *= 2;
+  }
+  chain->ResetBranchAddresses();
+  gPerf.Count("entries", nread);
+  printf("Quick-look DONE! %ld / %ld entries read\n", nread, ntotal);
+  gPerf.Write();
+
+  return 0;
+}
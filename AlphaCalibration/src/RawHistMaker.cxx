@@ -1,4 +1,4 @@
-//g++ RawHistMaker.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -lROOTTPython -o RawHistMaker
+//g++ RawHistMaker.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -I../../Common -lROOTTPython -o RawHistMaker
  
 #include <TFile.h>
 #include <TTree.h>
@@ -12,81 +12,119 @@
 #include <Math/SpecFuncMathCore.h>
 #include "TChannel.h"
 #include "TS3.h"
+#include "TFragment.h"
+#include "HistCache.h"
+#include "ShardOptions.h"
+#include "ReadAhead.h"
+#include "InputIndex.h"
+#include "CalibCore.h"   // EarlyStop, MakeS3Hist(), MakeS3FragHist(), DriftTracker
 
 TList *hlist;
+TH1D *hs[1100]; // # of histograms; we only write non-empty histograms in the TList
 // ================================ After this, need GRSISort Structure ======================== //
 void Initialize(){
   hlist = new TList;
-}
-
-// ============================ Make the unclibrated energy ========================================//
-// Make uncalibrated histogram
-// Analysis TTree
-void MakeRawHist(TChain *chain, char const *calfile){
-  long nentries = chain->GetEntries();
-  TS3 *s3 = NULL;
-  chain->SetBranchAddress("TS3", &s3);
-  if(chain->FindBranch("TS3")){
-    chain->SetBranchAddress("TS3", &s3);
-  }else{
-    std::cout << "Branch 'TS3' not found! TS3 variable is NULL pointer" << std::endl;
-    return;
-  }
-  
-  TH1D *hs[1100]; // # of histograms; we only write non-empty histograms in the TList
   for(int i=0;i<1100;i++){
     hs[i] = new TH1D(Form("hs%i",i),Form("uncalibrated energy histogram at CH %i",i), 4000,0,4000); 
   }
-  
-  if(TChannel::ReadCalFile(calfile) < 1) {
-    std::cout << "No channels found in calibration file " << calfile << "!" << std::endl;
-    return;     
-  }
-  std::cout<<std::endl;
-  
-  long xentry = 0;
-  for(xentry;xentry<nentries;xentry++){                                                                               
-    chain->GetEntry(xentry);
-    for(int i=0;i<s3->GetSectorMultiplicity();i++){
-      TS3Hit *sec_hit = s3->GetSectorHit(i);
-      int sec_ch   = sec_hit->GetChannelNumber();
-      double sec_c = sec_hit->GetCharge();
-      hs[sec_ch]->Fill(sec_c);
-    }// i (sector) loop over
-    for(int i=0;i<s3->GetRingMultiplicity();i++){
-      TS3Hit *ring_hit = s3->GetRingHit(i);
-      int ring_ch   = ring_hit->GetChannelNumber();
-      double ring_c = ring_hit->GetCharge();
-      hs[ring_ch]->Fill(ring_c);
-    }// i (ring) loop over
-    if((xentry%10000)==0){
-      printf("Making Hist on entry: %lu / %lu \r", xentry, nentries);
-      fflush(stdout);
-    } 
-  } // entries loop over 
+}
+
+// ============================ ListRawHist() ========================================//
+// Put the histograms with more than minentries entries in hlist
+void ListRawHist(int minentries){
+  long nentries = 0;
   for(int i=0;i<1100;i++){
-    if(hs[i]->GetEntries()>10){ // histogram must not be empty 
+    nentries += (long)hs[i]->GetEntries();
+    if(hs[i]->GetEntries()>minentries){ // histogram must not be empty 
       hlist->Add(hs[i]);
     }
   }
-  printf("Making Raw Hist DONE!  Entry: %lu / %lu \n", xentry, nentries);
+  printf("Making Raw Hist DONE!  Hits: %lu \n", nentries);
+}
+
+// ============================ Make the unclibrated energy ========================================//
+// Make uncalibrated histogram (MakeS3Hist() in CalibCore.h)
+// minentries: only histograms with more entries are kept (0 for a shard, see MergeHists -min)
+// stop: adaptive mode (stop->target > 0), see EarlyStop
+// drift: gain drift tracking, see DriftTracker.h
+void MakeRawHist(const std::vector<std::string> &files, TChain *chain, char const *calfile,
+                 int minentries=10, EarlyStop *stop=nullptr, DriftTracker *drift=nullptr){
+  if(!LoadCalFile(calfile)) return;
+  std::cout<<std::endl;
+  
+  std::vector<TH1 *> hv(hs, hs+1100);
+  MakeS3Hist(files, chain, calfile, hv, stop, drift);
+  ListRawHist(minentries);
+}
+
+// ============================ Make from fragments ========================================//
+// Fragment mode: FragmentTree files, one subrun per thread (MakeS3FragHist() in CalibCore.h)
+void MakeFragHist(const std::vector<std::string> &files, char const *calfile,
+                  int minentries, int nthreads, int minCH, int maxCH){
+  if(!LoadCalFile(calfile)) return;
+  std::cout<<std::endl;
+
+  std::vector<TH1 *> hv(hs, hs+1100);
+  MakeS3FragHist(files, calfile, hv, nthreads, minCH, maxCH);
+  ListRawHist(minentries);
 }
 
 
 // ====================================== main() ==========================================//
+// [-o shard.root]: write this shard's histograms to shard.root instead of raw_hist.root
+// [-target N]: adaptive mode, stop once every active channel has N counts in the peak region
+// [-prec P]:   adaptive mode, target from a relative FWHM precision P (eg 0.02 for 2%)
+// [-window lo hi]: adaptive mode, count the ADC range lo...hi of every channel instead of the
+//              peak window found from the seed of each channel
+// [-frag]:     the input files are FragmentTree files (no AnalysisTree needed)
+// [-nthreads N]: fragment mode, subrun files filled in parallel (default 4)
+// [-ch min max]: fragment mode, only channels min...max (eg the S3 channels)
+// [-drift S]:  also track the gain drift of every channel in slices of S seconds, write drift_s3.dat
+// [-driftcor drift_s3.dat]: fill the charges corrected with this drift table
 // argv1: CalibrationFile
-// argv2...: AnalysisTree File Path
+// argv2...: AnalysisTree (or FragmentTree) File Path
 int main(int argc, char** argv){
+  gPerf.Start("RawHistMaker", argc, argv);
+  EnableParallelRead();   // before the reader and fill threads start
+  ShardOptions opt = ParseShardOptions(argc, argv);
+  EarlyStop stop;
+  bool frag = false;
+  int nthreads = 4, minCH = 0, maxCH = 1099;
+  double driftslice = 0;
+  while(argc>2 && argv[1][0]=='-'){
+    int n = 2;   // option + value
+    if(strcmp(argv[1], "-target") == 0)        stop.target = atof(argv[2]);
+    else if(strcmp(argv[1], "-prec") == 0)     stop.target = 3./(2.*atof(argv[2])*atof(argv[2]));
+    else if(strcmp(argv[1], "-nthreads") == 0) nthreads = atoi(argv[2]);
+    else if(strcmp(argv[1], "-frag") == 0)     { frag = true; n = 1; }
+    else if(strcmp(argv[1], "-drift") == 0)    driftslice = atof(argv[2]);
+    else if(strcmp(argv[1], "-driftcor") == 0){ if(!gDriftCor.Read(argv[2])) return 1; }
+    else if(strcmp(argv[1], "-ch") == 0 && argc>3){ minCH = atoi(argv[2]); maxCH = atoi(argv[3]); n = 3; }
+    else if(strcmp(argv[1], "-window") == 0 && argc>3){ stop.SetWindow(atof(argv[2]), atof(argv[3])); n = 3; }
+    else break;
+    argv[n] = argv[0];
+    argv += n;
+    argc -= n;
+  }
   if(argc<2){
     printf("Input Calibration file and Analysistree file paths");
     return 1;
   }
+  if(frag && stop.target>0){
+    printf("-target/-prec/-window only apply to AnalysisTree input, reading all fragments\n");
+  }
+  if(frag && driftslice>0){
+    printf("-drift only applies to AnalysisTree input, no drift tracking\n");
+    driftslice = 0;
+  }
   //Step 1: loop over root file if files are valid
-  TChain *chain = new TChain("AnalysisTree");
+  std::vector<std::string> files;
   for(int i=2;i<argc;i++){
     std::string rootfilename = argv[i];
-    chain->Add(rootfilename.c_str());
+    files.push_back(rootfilename);
   }
+  InputIndex index(frag ? "FragmentTree" : "AnalysisTree");
+  TChain *chain = index.MakeChain(files);
   if(chain->GetEntries()==0){
     printf("No valid root file input\n");
     return 1;
@@ -95,13 +133,23 @@ int main(int argc, char** argv){
   // Step 2: make uncalibrate energy
   char const *calfile = argv[1];
   Initialize();
-  MakeRawHist(chain, calfile);
+  DriftTracker drift(driftslice, 1100);
+  if(frag){
+    MakeFragHist(files, calfile, opt.out.empty() ? 10 : 0, nthreads, minCH, maxCH);
+  }else{
+    MakeRawHist(files, chain, calfile, opt.out.empty() ? 10 : 0, &stop, drift.Enabled() ? &drift : nullptr);
+  }
+  if(drift.Enabled()){
+    PerfTimer timer("drift_solve");
+    WriteDriftTable(drift, "drift_s3.dat");
+  }
 
   // Step 3: Write raw histograms into output.root
-  TFile *newf = new TFile("raw_hist.root","recreate");
+  TFile *newf = new TFile(opt.out.empty() ? "raw_hist.root" : opt.out.c_str(),"recreate");
   newf->cd();
   hlist->Write();
   newf->Close();  
+  gPerf.Write();
 
   return 0;
 }
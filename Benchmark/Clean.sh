@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# ============================================
+# Clean script for the benchmark outputs
+# ============================================
+
+for target in bench_data bench_work bench_results.dat; do
+  if [[ -e "$target" ]]; then
+    read -p "⚠️  Delete $target? [y/N]: " ans
+    case "$ans" in
+      y|Y) rm -rf "$target"; echo "🗑️  Deleted: $target" ;;
+      *)   echo "⏩ Skipped: $target" ;;
+    esac
+  fi
+done
+echo "✅ Clean finished."
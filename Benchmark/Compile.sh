@@ -0,0 +1,25 @@
+#!/bin/bash
+
+# =============================
+# Build script for the benchmark tools
+# The pipeline programs themselves are built by ../AlphaCalibration/Compile.sh and
+# ../HPGe_Codes/Compile.sh
+# =============================
+
+CXX=g++
+CXXFLAGS="-O2 -Wl,--no-as-needed -Wl,--copy-dt-needed-entries"
+
+BINDIR="bins"
+mkdir -p "$BINDIR"
+
+ROOTFLAGS=$(root-config --cflags --libs --glibs)
+GRSIFLAGS=$(grsi-config --cflags --all-libs --GRSIData-libs)
+INCLUDES="-I$GRSISYS/GRSIData/include"
+
+echo "Compiling SynthGen..."
+$CXX src/SynthGen.cxx $CXXFLAGS $ROOTFLAGS $GRSIFLAGS $INCLUDES -o "$BINDIR/SynthGen"
+echo "✔ SynthGen built → $BINDIR/SynthGen"
+
+echo "Compiling CheckTruth..."
+$CXX src/CheckTruth.cxx -O2 -o "$BINDIR/CheckTruth"
+echo "✔ CheckTruth built → $BINDIR/CheckTruth"
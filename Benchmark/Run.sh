@@ -0,0 +1,145 @@
+#!/bin/bash
+
+# ============================================
+# Pipeline benchmark on synthetic data
+# Times every stage (events/s or fits/s, peak RSS) and checks the recovered calibration
+# against the SynthGen truth. One line per stage is appended to bench_results.dat, so the
+# numbers of different versions can be compared.
+# Build first: bash Compile.sh here, in ../AlphaCalibration and in ../HPGe_Codes
+# ============================================
+
+BIN_DIR="./bins"
+ALPHA_BIN="../AlphaCalibration/bins"
+HPGE_BIN="../HPGe_Codes/bin"
+SOURCES_DIR="../HPGe_Codes/sources"
+
+# hist: histogram files only (fit stages, no GRSISort data needed)
+# tree: also AnalysisTree/FragmentTree files (fill stages), needs a calibration file with
+#       S3 (SU...) and TIGRESS (TI...) channels
+MODE=hist
+CAL_FILE=""
+
+SEED=1
+ALPHA_COUNTS=20000     # hist mode: counts per S3 channel
+GAMMA_COUNTS=200000    # hist mode: counts per crystal
+NFILES=4               # tree mode: subrun files per source
+NEVENTS=250000         # tree mode: events per file
+
+DATA="bench_data"
+WORK="bench_work"
+RESULTS="bench_results.dat"
+ROOT_DIR=$(pwd)
+
+# ============================================
+# run_timed NAME CMD...: run CMD, log to $WORK/logs/NAME.log
+# sets SECS (wall time), RSS_MB (peak resident memory) and RC (exit code)
+# ============================================
+run_timed() {
+  local name="$1"
+  shift
+  local tfile="$ROOT_DIR/$WORK/logs/${name}.time"
+  /usr/bin/time -f "%e %M" -o "$tfile" "$@" > "$ROOT_DIR/$WORK/logs/${name}.log" 2>&1
+  RC=$?
+  read SECS RSS_KB < <(tail -1 "$tfile")
+  RSS_MB=$(awk -v k="$RSS_KB" 'BEGIN{printf "%.1f", k/1024}')
+}
+
+# record NAME NUNITS UNIT CHECK: one result line (CHECK = PASS/FAIL/-)
+record() {
+  local name="$1" n="$2" unit="$3" check="$4"
+  local rate=$(awk -v n="$n" -v s="$SECS" 'BEGIN{ if(s>0) printf "%.1f", n/s; else print "inf" }')
+  printf "%-24s %8.2f s %12s %-7s %12s %s/s %9s MB  rc=%s  %s\n" \
+         "$name" "$SECS" "$n" "$unit" "$rate" "$unit" "$RSS_MB" "$RC" "$check" | tee -a "$RESULTS"
+}
+
+# check KIND TRUTH FIT: CheckTruth summary in the stage log, PASS/FAIL
+check() {
+  if "$ROOT_DIR/$BIN_DIR/CheckTruth" "$@" >> "$ROOT_DIR/$WORK/logs/check.log" 2>&1; then
+    echo PASS
+  else
+    echo FAIL
+  fi
+}
+
+count_lines() { grep -v '^#' "$1" 2>/dev/null | grep -c . ; }
+
+rm -rf "$WORK"
+mkdir -p "$DATA" "$WORK/logs" "$WORK/alpha" "$WORK/hpge/co60"
+ln -s "$ROOT_DIR/$SOURCES_DIR" "$WORK/hpge/sources"
+export SYNTH_SOURCES="$ROOT_DIR/$SOURCES_DIR"
+export FIT_CACHE=""   # time the fits themselves, not fit_cache.dat
+echo "# $(date '+%F %T')  $(git rev-parse --short HEAD 2>/dev/null)  mode=$MODE seed=$SEED" | tee -a "$RESULTS"
+
+# ============================================
+# Step 1: synthetic data
+# ============================================
+echo "[STEP 1] Generating synthetic data in $DATA/"
+run_timed gen_alpha "$BIN_DIR/SynthGen" hist alpha "$DATA" "$ALPHA_COUNTS" "$SEED"
+run_timed gen_60co  "$BIN_DIR/SynthGen" hist 60co  "$DATA" "$GAMMA_COUNTS" "$SEED"
+run_timed gen_152eu "$BIN_DIR/SynthGen" hist 152eu "$DATA" "$GAMMA_COUNTS" "$SEED"
+if [[ "$MODE" == "tree" ]]; then
+  for src in alpha 60co; do
+    run_timed gen_tree_$src "$BIN_DIR/SynthGen" tree $src "$DATA/trees" "$CAL_FILE" "$NFILES" "$NEVENTS" "$SEED"
+  done
+fi
+NEV=$(( NFILES * NEVENTS ))
+
+# ============================================
+# Step 2: fit stages on the synthetic histograms
+# ============================================
+echo "[STEP 2] Fit stages"
+cd "$WORK/alpha"
+run_timed FitRawHist "$ROOT_DIR/$ALPHA_BIN/FitRawHist" "$ROOT_DIR/$DATA/raw_hist.root" Res_Check.dat
+record FitRawHist "$(count_lines Res_Check.dat)" fits "$(check s3 "$ROOT_DIR/$DATA/truth_s3.dat" Res_Check.dat)"
+
+cd "$ROOT_DIR/$WORK/hpge"
+run_timed co60_linfit "$ROOT_DIR/$HPGE_BIN/co60_linfit" -i "$ROOT_DIR/$DATA/raw_60co.root" none
+record co60_linfit "$(count_lines co60_linfit.dat)" fits "$(check tig "$ROOT_DIR/$DATA/truth_tig.dat" co60_linfit.dat)"
+cp co60_linfit.dat co60/
+
+run_timed Calibration_HistMaker "$ROOT_DIR/$HPGE_BIN/Calibration_HistMaker" -i "$ROOT_DIR/$DATA/raw_152eu.root" none 152eu
+record Calibration_HistMaker "$(count_lines peaks_152eu.dat)" fits -
+cd "$ROOT_DIR"
+
+# ============================================
+# Step 3: fill stages on the synthetic trees (hist_cache/ is removed before every run)
+# ============================================
+if [[ "$MODE" == "tree" ]]; then
+  echo "[STEP 3] Fill stages"
+  ALPHA_TREES=("$ROOT_DIR/$DATA"/trees/analysis90001_*.root)
+  ALPHA_FRAGS=("$ROOT_DIR/$DATA"/trees/fragment90001_*.root)
+  CO60_TREES=("$ROOT_DIR/$DATA"/trees/analysis90002_*.root)
+  CO60_FRAGS=("$ROOT_DIR/$DATA"/trees/fragment90002_*.root)
+
+  cd "$WORK/alpha"
+  rm -rf hist_cache
+  run_timed RawHistMaker "$ROOT_DIR/$ALPHA_BIN/RawHistMaker" "$CAL_FILE" "${ALPHA_TREES[@]}"
+  record RawHistMaker "$NEV" events -
+  run_timed FitRawHist_tree "$ROOT_DIR/$ALPHA_BIN/FitRawHist" raw_hist.root Res_Check.dat
+  record FitRawHist_tree "$(count_lines Res_Check.dat)" fits "$(check s3 "$ROOT_DIR/$DATA/truth_s3.dat" Res_Check.dat)"
+
+  rm -rf hist_cache
+  run_timed CalibChain_alpha "$ROOT_DIR/$ALPHA_BIN/CalibChain" alpha "$CAL_FILE" "${ALPHA_TREES[@]}"
+  record CalibChain_alpha "$NEV" events "$(check s3 "$ROOT_DIR/$DATA/truth_s3.dat" Res_Check.dat)"
+
+  rm -rf hist_cache
+  run_timed RawHistMaker_frag "$ROOT_DIR/$ALPHA_BIN/RawHistMaker" -o frag_hist.root -frag "$CAL_FILE" "${ALPHA_FRAGS[@]}"
+  record RawHistMaker_frag "$NEV" events -
+
+  run_timed HistMakers "$ROOT_DIR/$ALPHA_BIN/HistMakers" "$CAL_FILE" "${ALPHA_TREES[@]}"
+  record HistMakers "$NEV" events -
+
+  run_timed EventBuilder "$ROOT_DIR/$ALPHA_BIN/EventBuilder" -out events.root "$CAL_FILE" "${CO60_FRAGS[@]}"
+  record EventBuilder "$NEV" events -
+
+  cd "$ROOT_DIR/$WORK/hpge"
+  rm -rf hist_cache
+  run_timed co60_linfit_tree "$ROOT_DIR/$HPGE_BIN/co60_linfit" "$CAL_FILE" "${CO60_TREES[@]}"
+  record co60_linfit_tree "$NEV" events "$(check tig "$ROOT_DIR/$DATA/truth_tig.dat" co60_linfit.dat)"
+  cd "$ROOT_DIR"
+fi
+
+echo
+echo "============================================"
+echo "✅ Benchmark finished. Results appended to $RESULTS, logs in $WORK/logs/"
+echo "============================================"
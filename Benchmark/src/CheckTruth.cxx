@@ -0,0 +1,115 @@
+//g++ CheckTruth.cxx -O2 -o CheckTruth
+
+// Compare a recovered calibration with the truth of SynthGen.
+//   CheckTruth s3  truth_s3.dat  Res_Check.dat   [tolE] [tolFWHM]
+//   CheckTruth tig truth_tig.dat co60_linfit.dat [tolE] [tolFWHM]
+// For every channel of the truth: energy error at the reference line (5804.77 keV for S3,
+// 1332.5 keV for TIGRESS) of the fitted gain/offset, and relative FWHM error.
+// A channel passes if |dE| < tolE (default 5 keV S3, 0.5 keV TIGRESS) and
+// |dFWHM|/FWHM < tolFWHM (default 0.15). Exit code 0 only if every channel passes.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+struct Cal{
+  double gain;
+  double offset;
+  double fwhm;
+};
+
+// truth_*.dat: ch gain offset fwhm
+std::map<int, Cal> ReadTruth(const std::string &filename){
+  std::map<int, Cal> cal;
+  std::ifstream infile(filename);
+  std::string line;
+  while(std::getline(infile, line)){
+    if(line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    int ch;
+    Cal c;
+    if(ss >> ch >> c.gain >> c.offset >> c.fwhm) cal[ch] = c;
+  }
+  return cal;
+}
+
+// Res_Check.dat: CHANNEL FWHM(Pu) FWHM(Am) FWHM(Cm) Res% GAIN OFFSET
+// co60_linfit.dat: ArrayNum Gain Offset FWHM(1332) Res%
+std::map<int, Cal> ReadFit(const std::string &filename, bool s3){
+  std::map<int, Cal> cal;
+  std::ifstream infile(filename);
+  std::string line;
+  while(std::getline(infile, line)){
+    if(line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    int ch;
+    Cal c;
+    double fpu, fam, res;
+    if(s3){
+      if(ss >> ch >> fpu >> fam >> c.fwhm >> res >> c.gain >> c.offset) cal[ch] = c;
+    }else{
+      if(ss >> ch >> c.gain >> c.offset >> c.fwhm) cal[ch] = c;
+    }
+  }
+  return cal;
+}
+
+
+// ====================================== main() ==========================================//
+int main(int argc, char **argv){
+  if(argc<4){
+    printf("Input s3|tig truth.dat fit.dat [tolE] [tolFWHM]\n");
+    return 1;
+  }
+  bool s3 = std::string(argv[1]) == "s3";
+  double eref    = s3 ? 5804.77 : 1332.5;
+  double tolE    = (argc>4) ? atof(argv[4]) : (s3 ? 5. : 0.5);
+  double tolFWHM = (argc>5) ? atof(argv[5]) : 0.15;
+  std::map<int, Cal> truth = ReadTruth(argv[2]);
+  std::map<int, Cal> fit   = ReadFit(argv[3], s3);
+  if(truth.empty()){
+    printf("No truth in %s\n", argv[2]);
+    return 1;
+  }
+
+  int nmissing = 0, nfail = 0;
+  double sumE = 0, maxE = 0, sumW = 0, maxW = 0;
+  for(const auto &it : truth){
+    int ch = it.first;
+    const Cal &t = it.second;
+    auto found = fit.find(ch);
+    if(found == fit.end() || found->second.fwhm < 0){
+      printf("  CH %4i: no fit\n", ch);
+      nmissing++;
+      continue;
+    }
+    const Cal &f = found->second;
+    double x  = (eref - t.offset)/t.gain;       // true charge of the reference line
+    double dE = f.offset + f.gain*x - eref;
+    double dW = (f.fwhm - t.fwhm)/t.fwhm;
+    sumE += std::fabs(dE);
+    sumW += std::fabs(dW);
+    maxE = std::max(maxE, std::fabs(dE));
+    maxW = std::max(maxW, std::fabs(dW));
+    if(std::fabs(dE) > tolE || std::fabs(dW) > tolFWHM){
+      printf("  CH %4i: dE = %8.3f keV, dFWHM = %6.1f%%  FAIL\n", ch, dE, 100*dW);
+      nfail++;
+    }
+  }
+  int nfit = truth.size() - nmissing;
+  printf("%s: %zu channels, %i fitted, %i missing, %i out of tolerance\n",
+         argv[3], truth.size(), nfit, nmissing, nfail);
+  if(nfit>0){
+    printf("|dE| at %.1f keV: mean %.3f max %.3f keV (tol %.3f); |dFWHM|: mean %.1f%% max %.1f%% (tol %.0f%%)\n",
+           eref, sumE/nfit, maxE, tolE, 100*sumW/nfit, 100*maxW, 100*tolFWHM);
+  }
+  bool pass = (nmissing == 0 && nfail == 0);
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 2;
+}
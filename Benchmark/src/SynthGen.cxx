@@ -0,0 +1,292 @@
+//g++ SynthGen.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -O2 -Wl,--copy-dt-needed-entries `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -o SynthGen
+
+// Synthetic data for the benchmarks: triple-alpha S3 spectra and 60Co/152Eu TIGRESS spectra
+// with known gain, offset and resolution of every channel.
+//
+// hist mode: histogram files in the layout of the pipeline, no GRSISort data needed
+//   alpha -> raw_hist.root  (hs<channel>, input of FitRawHist)
+//   60co  -> raw_60co.root  (hs0~hs63,   input of co60_linfit -i)
+//   152eu -> raw_152eu.root (hs0~hs63,   input of Calibration_HistMaker -i)
+// tree mode: AnalysisTree (TS3 or TTigress) and FragmentTree subrun files built from the
+//   channels of a calibration file, input of RawHistMaker, HistMakers, co60_linfit...
+//   alpha -> analysis<run>_<sub>.root / fragment<run>_<sub>.root with one ring + one sector hit
+//   60co/152eu -> same names, 1~2 gamma hits per event in random crystals
+//
+// The truth is written next to the data: truth_s3.dat (channel, gain, offset, FWHM of the
+// 5.8 MeV Cm line in keV) and truth_tig.dat (array number, gain, offset, FWHM at 1332 keV).
+// E = offset + gain*charge, the convention of FitRawHist and co60_linfit. The parameters of a
+// channel only depend on the seed and the channel, so hist and tree data of a seed agree.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <memory>
+#include <sys/stat.h>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TH1.h>
+#include <TRandom3.h>
+#include "TChannel.h"
+#include "TFragment.h"
+#include "TS3.h"
+#include "TTigress.h"
+
+// ============================ Source lines ========================================//
+struct Line{
+  double energy;
+  double intensity;
+};
+
+// Alpha lines of TripleAlphaHighE_Fun (FitRawHist), one third of the decays per isotope
+std::vector<Line> AlphaLines(){
+  return { {5156.59, 0.7077/3}, {5144.30, 0.1711/3}, {5105.80, 0.1194/3},        // 239Pu
+           {5544.5, 0.0036/3}, {5388.0, 0.0166/3}, {5485.56, 0.848/3}, {5442.8, 0.131/3}, // 241Am
+           {5804.77, 0.769/3}, {5762.16, 0.231/3} };                           // 244Cm
+}
+
+// Gamma lines from HPGe_Codes/sources/<source>.dat (isotope energy intensity ...)
+std::vector<Line> GammaLines(const std::string &source, const std::string &dir){
+  std::vector<Line> lines;
+  std::ifstream infile(dir + "/" + source + ".dat");
+  std::string line;
+  while(std::getline(infile, line)){
+    if(line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    std::string isotope;
+    double energy, intensity;
+    if(ss >> isotope >> energy >> intensity) lines.push_back({energy, intensity});
+  }
+  return lines;
+}
+
+double PickLine(const std::vector<Line> &lines, TRandom3 &rnd){
+  double sum = 0;
+  for(const auto &l : lines) sum += l.intensity;
+  double u = rnd.Rndm()*sum;
+  for(const auto &l : lines){
+    if(u < l.intensity) return l.energy;
+    u -= l.intensity;
+  }
+  return lines.back().energy;
+}
+
+// ============================ Truth ========================================//
+struct Truth{
+  double gain;
+  double offset;
+  double fwhm;   // keV, at 5804.77 (S3) or 1332.5 keV (TIGRESS)
+};
+
+Truth S3Truth(int seed, int ch){
+  TRandom3 r(seed*100003 + ch + 1);
+  return {r.Uniform(1.6, 2.4), r.Uniform(-50, 50), r.Uniform(25, 60)};
+}
+
+Truth TigTruth(int seed, int arr){
+  TRandom3 r(seed*100003 + 50000 + arr + 1);
+  return {r.Uniform(0.35, 0.45), r.Uniform(-5, 5), r.Uniform(2.0, 2.6)};
+}
+
+// HPGe resolution: FWHM(E) = FWHM(1332)*sqrt(0.2 + 0.8 E/1332)
+double TigFWHM(const Truth &t, double e){ return t.fwhm*std::sqrt(0.2 + 0.8*e/1332.5); }
+
+// ============================ Samplers ========================================//
+// charge of one S3 hit (-1 = no hit): 20% low-ADC noise, 2% flat tail, the rest in the lines
+double AlphaCharge(const Truth &t, const std::vector<Line> &lines, TRandom3 &rnd){
+  double u = rnd.Rndm();
+  if(u < 0.20) return rnd.Exp(15.);
+  double e;
+  if(u < 0.22) e = rnd.Uniform(0, 6000);
+  else         e = rnd.Gaus(PickLine(lines, rnd), t.fwhm/2.35);
+  return (e - t.offset)/t.gain;
+}
+
+// charge of one gamma hit: 35% full energy, else Compton continuum up to the edge
+double GammaCharge(const Truth &t, const std::vector<Line> &lines, TRandom3 &rnd){
+  double e = PickLine(lines, rnd);
+  if(rnd.Rndm() < 0.35){
+    e = rnd.Gaus(e, TigFWHM(t, e)/2.35);
+  }else{
+    double edge = e*(2*e/511.)/(1 + 2*e/511.);
+    e = rnd.Uniform(0, edge);
+  }
+  return (e - t.offset)/t.gain;
+}
+
+// ============================ Hist mode ========================================//
+int MakeHists(const std::string &source, const std::string &outdir, long ncounts, int seed,
+              int nchannels, const std::string &srcdir){
+  TRandom3 rnd(seed);
+  bool alpha = (source == "alpha");
+  std::vector<Line> lines = alpha ? AlphaLines() : GammaLines(source, srcdir);
+  if(lines.empty()){
+    std::cerr << "No lines for source " << source << " in " << srcdir << std::endl;
+    return 1;
+  }
+  std::string outname = outdir + (alpha ? "/raw_hist.root" : "/raw_" + source + ".root");
+  std::ofstream truth(outdir + (alpha ? "/truth_s3.dat" : "/truth_tig.dat"));
+  truth << (alpha ? "# CH  GAIN  OFFSET  FWHM(Cm)\n" : "# ArrayNum  Gain  Offset  FWHM(1332)\n");
+
+  TFile *outfile = new TFile(outname.c_str(), "recreate");
+  int nch = alpha ? nchannels : 64;
+  for(int ch=0;ch<nch;ch++){
+    Truth t = alpha ? S3Truth(seed, ch) : TigTruth(seed, ch);
+    truth << ch << "\t" << t.gain << "\t" << t.offset << "\t" << t.fwhm << "\n";
+    TH1D *h = new TH1D(Form("hs%i",ch), Form("synthetic uncalibrated energy histogram at CH %i",ch), 4000, 0, 4000);
+    for(long i=0;i<ncounts;i++){
+      h->Fill(alpha ? AlphaCharge(t, lines, rnd) : GammaCharge(t, lines, rnd));
+    }
+    h->Write();
+    delete h;
+  }
+  outfile->Close();
+  printf("%s: %i channels x %ld counts\n", outname.c_str(), nch, ncounts);
+  return 0;
+}
+
+// ============================ Tree mode ========================================//
+int MakeTrees(const std::string &source, const std::string &outdir, const char *calfile,
+              int nfiles, long nevents, int seed, const std::string &srcdir){
+  if(TChannel::ReadCalFile(calfile) < 1){
+    std::cout << "No channels found in calibration file " << calfile << "!" << std::endl;
+    return 1;
+  }
+  bool alpha = (source == "alpha");
+  std::vector<Line> lines = alpha ? AlphaLines() : GammaLines(source, srcdir);
+  if(lines.empty()){
+    std::cerr << "No lines for source " << source << " in " << srcdir << std::endl;
+    return 1;
+  }
+  // channels of the calibration file: S3 rings/sectors, TIGRESS core A channels
+  std::vector<TChannel *> rings, sectors, cores;
+  std::map<int, int> coreArray;   // channel number -> array number
+  for(auto &it : *TChannel::GetChannelMap()){
+    TChannel *chan = it.second;
+    std::string name = chan->GetName();
+    if(name.compare(0, 2, "SU") == 0){
+      // S3 mnemonics: ...P (ring, front) / ...N (sector, back)
+      if(name.size() > 9 && name[9] == 'P') rings.push_back(chan);
+      else sectors.push_back(chan);
+    }else if(name.compare(0, 2, "TI") == 0 && chan->GetSegmentNumber() == 0 && name.back() == 'A'){
+      cores.push_back(chan);
+      coreArray[chan->GetNumber()] = (chan->GetDetectorNumber()-1)*4 + chan->GetCrystalNumber();
+    }
+  }
+  if(alpha ? (rings.empty() || sectors.empty()) : cores.empty()){
+    std::cerr << "No " << (alpha ? "S3 (SU...)" : "TIGRESS core (TI...00A)") << " channels in " << calfile << std::endl;
+    return 1;
+  }
+
+  std::ofstream truth(outdir + (alpha ? "/truth_s3.dat" : "/truth_tig.dat"));
+  truth << (alpha ? "# CH  GAIN  OFFSET  FWHM(Cm)\n" : "# ArrayNum  Gain  Offset  FWHM(1332)\n");
+  if(alpha){
+    for(auto *v : {&rings, &sectors}){
+      for(TChannel *c : *v){
+        Truth t = S3Truth(seed, c->GetNumber());
+        truth << c->GetNumber() << "\t" << t.gain << "\t" << t.offset << "\t" << t.fwhm << "\n";
+      }
+    }
+  }else{
+    for(auto &it : coreArray){
+      Truth t = TigTruth(seed, it.second);
+      truth << it.second << "\t" << t.gain << "\t" << t.offset << "\t" << t.fwhm << "\n";
+    }
+  }
+
+  TRandom3 rnd(seed);
+  int run = alpha ? 90001 : (source == "60co" ? 90002 : 90003);
+  Long64_t timestamp = 0;
+  for(int ifile=0;ifile<nfiles;ifile++){
+    std::string aname = outdir + Form("/analysis%05d_%03d.root", run, ifile);
+    std::string fname = outdir + Form("/fragment%05d_%03d.root", run, ifile);
+    TFile *ffile = new TFile(fname.c_str(), "recreate");
+    TTree *ftree = new TTree("FragmentTree", "synthetic fragments");
+    TFragment *frag = new TFragment;
+    ftree->Branch("TFragment", &frag);
+    TFile *afile = new TFile(aname.c_str(), "recreate");
+    TTree *atree = new TTree("AnalysisTree", "synthetic events");
+    TS3 *s3 = new TS3;
+    TTigress *tig = new TTigress;
+    if(alpha) atree->Branch("TS3", &s3);
+    else      atree->Branch("TTigress", &tig);
+
+    for(long iev=0;iev<nevents;iev++){
+      timestamp += (Long64_t)rnd.Exp(1000.) + 1;   // 1 kHz average rate, 1 ns units
+      std::vector<std::pair<TChannel *, double>> hits;
+      if(alpha){
+        TChannel *r = rings[rnd.Integer(rings.size())];
+        TChannel *s = sectors[rnd.Integer(sectors.size())];
+        double e = rnd.Gaus(PickLine(lines, rnd), 1.);   // same alpha on both sides
+        for(TChannel *c : {r, s}){
+          Truth t = S3Truth(seed, c->GetNumber());
+          double q = (rnd.Rndm() < 0.2) ? rnd.Exp(15.) : (rnd.Gaus(e, t.fwhm/2.35) - t.offset)/t.gain;
+          hits.push_back({c, q});
+        }
+      }else{
+        int ngamma = (rnd.Rndm() < 0.3) ? 2 : 1;
+        for(int g=0;g<ngamma;g++){
+          TChannel *c = cores[rnd.Integer(cores.size())];
+          hits.push_back({c, GammaCharge(TigTruth(seed, coreArray[c->GetNumber()]), lines, rnd)});
+        }
+      }
+      s3->Clear();
+      tig->Clear();
+      for(auto &h : hits){
+        auto f = std::make_shared<TFragment>();
+        f->SetAddress(h.first->GetAddress());
+        f->SetCharge((Float_t)h.second);
+        f->SetTimeStamp(timestamp/10);   // 10 ns ticks
+        *frag = *f;
+        ftree->Fill();
+        if(alpha) s3->AddFragment(f, h.first);
+        else      tig->AddFragment(f, h.first);
+      }
+      atree->Fill();
+    }
+    ffile->cd();
+    ftree->Write();
+    ffile->Close();
+    afile->cd();
+    atree->Write();
+    afile->Close();
+    printf("%s, %s: %ld events\n", aname.c_str(), fname.c_str(), nevents);
+  }
+  return 0;
+}
+
+
+// ====================================== main() ==========================================//
+// SynthGen hist <alpha|60co|152eu> <outdir> [counts per channel] [seed] [S3 channels]
+// SynthGen tree <alpha|60co|152eu> <outdir> <calfile> [nfiles] [events per file] [seed]
+// Gamma lines are read from ../HPGe_Codes/sources (SYNTH_SOURCES to change it).
+int main(int argc, char **argv){
+  if(argc<4){
+    printf("Input: hist <alpha|60co|152eu> outdir [counts] [seed] [nS3]\n"
+           "   or: tree <alpha|60co|152eu> outdir calfile [nfiles] [nevents] [seed]\n");
+    return 1;
+  }
+  std::string mode = argv[1], source = argv[2], outdir = argv[3];
+  mkdir(outdir.c_str(), 0755);
+  const char *env = getenv("SYNTH_SOURCES");
+  std::string srcdir = env ? env : "../HPGe_Codes/sources";
+  TH1::AddDirectory(kFALSE);
+  if(mode == "hist"){
+    long counts = (argc>4) ? atol(argv[4]) : (source == "alpha" ? 20000 : 200000);
+    int seed    = (argc>5) ? atoi(argv[5]) : 1;
+    int ns3     = (argc>6) ? atoi(argv[6]) : 112;
+    return MakeHists(source, outdir, counts, seed, ns3, srcdir);
+  }
+  if(mode == "tree" && argc>4){
+    int nfiles   = (argc>5) ? atoi(argv[5]) : 4;
+    long nevents = (argc>6) ? atol(argv[6]) : 250000;
+    int seed     = (argc>7) ? atoi(argv[7]) : 1;
+    return MakeTrees(source, outdir, argv[4], nfiles, nevents, seed, srcdir);
+  }
+  printf("Unknown mode %s\n", mode.c_str());
+  return 1;
+}
@@ -0,0 +1,292 @@
+// AlphaSeed.h: starting gain/offset of a triple-alpha channel from a template cross-correlation.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// tasf() takes its starting gain and offset from the first and last of the three tallest
+// PeakHunt() peaks, so one noise peak among them spoils the seed (or forces the two-peak "d"
+// fallback). The seeder matches the whole source instead, every line of TripleAlpha*_Fun():
+//  1. coarse: in log space a gain is a shift, log(x) = log(E) - log(gain). The spectrum is
+//     rebinned on a log(ADC) grid and cross-correlated with the line template on a log(E)
+//     grid with one FFT per channel (template transform computed once); the best lag gives
+//     the gain with offset 0, to a few 0.1%.
+//  2. fine: scale x shift search in ADC channels. The positions of the Cm and Am (Th) lines
+//     give gain and offset; every line of the source is placed with them and scored on the
+//     smoothed spectrum, on three grids of decreasing step (coarse-to-fine).
+// Both steps work on the square root of the counts (Poisson-scaled), so one tall noise peak
+// does not outweigh the three alpha groups.
+//   AlphaSeed s = SeedAlphaHist(hist);       // s.ok: s.xlow, s.xhigh for tasf(h, name, xlow, xhigh, "c")
+#ifndef ALPHASEED_H
+#define ALPHASEED_H
+
+#include <vector>
+#include <complex>
+#include <algorithm>
+#include <cmath>
+#include <TH1.h>
+
+// ============================ FFT ========================================//
+// In-place radix-2 FFT, a.size() must be a power of 2
+inline void FFT(std::vector<std::complex<double>> &a, bool inverse = false){
+  size_t n = a.size();
+  for(size_t i=1, j=0;i<n;i++){
+    size_t bit = n >> 1;
+    for(;j & bit;bit >>= 1) j ^= bit;
+    j ^= bit;
+    if(i < j) std::swap(a[i], a[j]);
+  }
+  for(size_t len=2;len<=n;len<<=1){
+    double ang = 2*M_PI/len * (inverse ? 1 : -1);
+    std::complex<double> wlen(cos(ang), sin(ang));
+    for(size_t i=0;i<n;i+=len){
+      std::complex<double> w(1);
+      for(size_t j=0;j<len/2;j++){
+        std::complex<double> u = a[i+j], v = a[i+j+len/2]*w;
+        a[i+j] = u + v;
+        a[i+j+len/2] = u - v;
+        w *= wlen;
+      }
+    }
+  }
+  if(inverse){
+    for(auto &x : a) x /= (double)n;
+  }
+}
+
+// ============================ AlphaSeed ========================================//
+struct AlphaSeed{
+  bool ok = false;
+  double gain = 0;
+  double offset = 0;
+  double xlow = -1;       // main line of the first group (Pu, or Am if twopeaks; Gd for lowE)
+  double xhigh = -1;      // main Cm line
+  bool twopeaks = false;  // no Pu group: seed for tasf(..., "cd")
+  double score = 0;       // correlation coefficient of the coarse match
+};
+
+class AlphaTemplate{
+public:
+  struct Line{
+    double e;
+    double w;
+    int group;
+  };
+
+  // lowE: Gd/Th/Cm source, otherwise Pu/Am/Cm; fwhm: nominal resolution (keV) of the template
+  explicit AlphaTemplate(bool lowE = false, double fwhm = 40, double du = 2e-3,
+                         double xmin = 50, double xmax = 4096)
+    : fLowE(lowE), fSigma(fwhm/2.35), fDu(du), fXmin(xmin) {
+    if(lowE){
+      fLines = {{3182.690, 1.0, 0},
+                {4620.5, 0.2340, 1}, {4687.0, 0.763, 1},
+                {5804.77, 0.769, 2}, {5762.16, 0.231, 2}};
+      fMain = {3182.690, 4687.0, 5804.77};
+    }else{
+      fLines = {{5156.59, 0.7077, 0}, {5144.30, 0.1711, 0}, {5105.80, 0.1194, 0},
+                {5544.5, 0.0036, 1}, {5388, 0.0166, 1}, {5485.56, 0.848, 1}, {5442.8, 0.131, 1},
+                {5804.77, 0.769, 2}, {5762.16, 0.231, 2}};
+      fMain = {5156.59, 5485.56, 5804.77};
+    }
+    // template on the log(E) grid, zero mean so a flat background does not correlate
+    double emin = fLines.front().e, emax = fLines.front().e;
+    for(const Line &l : fLines){
+      emin = std::min(emin, l.e);
+      emax = std::max(emax, l.e);
+    }
+    fVlo = log(emin - 4*fSigma);
+    int nt = (int)ceil((log(emax + 4*fSigma) - fVlo)/fDu) + 1;
+    std::vector<double> t(nt, 0);
+    double mean = 0;
+    for(int j=0;j<nt;j++){
+      double e = exp(fVlo + j*fDu);
+      for(const Line &l : fLines) t[j] += l.w * exp(-0.5*(e-l.e)*(e-l.e)/(fSigma*fSigma));
+      mean += t[j];
+    }
+    mean /= nt;
+    fTNorm = 0;
+    for(double &v : t){
+      v -= mean;
+      fTNorm += v*v;
+    }
+    fTNorm = sqrt(fTNorm);
+    fT = t;
+    fNS = (int)ceil(log(xmax/xmin)/fDu);
+    fN = 1;
+    while(fN < fNS + nt) fN <<= 1;   // zero padding: no wrap-around of the correlation
+    fTF.assign(fN, 0);
+    for(int j=0;j<nt;j++) fTF[j] = t[j];
+    FFT(fTF);
+    for(auto &c : fTF) c = std::conj(c);
+  }
+
+  // content: bin contents of a spectrum with nbins bins of width binw from xlow
+  // gmin, gmax: gains (keV/channel) searched; the default keeps Cm above channel 580, away
+  // from the noise at low ADC
+  AlphaSeed Seed(const double *content, int nbins, double xlow, double binw,
+                 double gmin = 0.5, double gmax = 10) const {
+    AlphaSeed seed;
+    // cumulative counts, so a log cell sums exactly the bins (or parts of bins) it covers
+    std::vector<double> cum(nbins+1, 0);
+    for(int b=0;b<nbins;b++) cum[b+1] = cum[b] + std::max(0., content[b]);
+    auto integral = [&](double x){   // counts below x
+      double u = (x - xlow)/binw;
+      if(u <= 0) return 0.;
+      if(u >= nbins) return cum[nbins];
+      int b = (int)u;
+      return cum[b] + (u-b)*(cum[b+1]-cum[b]);
+    };
+    if(integral(xlow + nbins*binw) - integral(fXmin) < 50) return seed;
+
+    // 1. coarse: gain from the lag of the log-space correlation
+    std::vector<std::complex<double>> s(fN, 0);
+    std::vector<double> sv(fNS);
+    double prev = integral(fXmin);
+    for(int i=0;i<fNS;i++){
+      double next = integral(fXmin*exp((i+1)*fDu));
+      sv[i] = sqrt(next - prev);
+      s[i] = sv[i];
+      prev = next;
+    }
+    FFT(s);
+    for(int k=0;k<fN;k++) s[k] *= fTF[k];
+    FFT(s, true);
+    // normalized per lag (correlation coefficient, the template has zero mean): the steep
+    // noise edge at low ADC has many counts but not the shape of the source
+    int nt = fT.size();
+    std::vector<double> sum1(fNS+1, 0), sum2(fNS+1, 0);
+    for(int i=0;i<fNS;i++){
+      sum1[i+1] = sum1[i] + sv[i];
+      sum2[i+1] = sum2[i] + sv[i]*sv[i];
+    }
+    std::vector<double> ncc(fNS, 0);
+    int kbest = -1;
+    int kmin = std::max(0, (int)floor((fVlo - log(fXmin) - log(gmax))/fDu));
+    int kmax = std::min(fNS-nt, (int)ceil((fVlo - log(fXmin) - log(gmin))/fDu));
+    for(int k=kmin;k<=kmax;k++){
+      double m = (sum1[k+nt]-sum1[k])/nt;
+      double var = (sum2[k+nt]-sum2[k]) - nt*m*m;
+      ncc[k] = (var > 1e-9) ? s[k].real()/(fTNorm*sqrt(var)) : 0;
+      if(kbest < 0 || ncc[k] > ncc[kbest]) kbest = k;
+    }
+    if(kbest < 0 || ncc[kbest] <= 0) return seed;
+    seed.score = ncc[kbest];
+    double delta = 0;
+    if(kbest > kmin && kbest < kmax){
+      double c0 = ncc[kbest-1], c1 = ncc[kbest], c2 = ncc[kbest+1];
+      double den = c0 - 2*c1 + c2;
+      if(den < 0) delta = 0.5*(c0 - c2)/den;
+    }
+    // x = E/gain: log(fXmin) + (k+j)*du = fVlo + j*du - log(gain)
+    double g0 = exp(fVlo - log(fXmin) - (kbest+delta)*fDu);
+
+    // 2. fine: positions of the Cm and Am (Th) main lines on the smoothed spectrum
+    double sig = std::max(1., fSigma/g0/binw);     // resolution in bins
+    double xcm0 = fMain[2]/g0, xmid0 = fMain[1]/g0;
+    double range = 0.04*xcm0 + 4*sig*binw;
+    double xlo = fLines.front().e, xhi = fLines.front().e;
+    for(const Line &l : fLines){
+      xlo = std::min(xlo, l.e);
+      xhi = std::max(xhi, l.e);
+    }
+    int b0 = std::max(0, (int)((xlo/g0 - 1.5*range - 4*sig*binw - xlow)/binw));
+    int b1 = std::min(nbins-1, (int)((xhi/g0 + 1.5*range + 4*sig*binw - xlow)/binw));
+    if(b1 - b0 < 4) return seed;
+    std::vector<double> sm(b1-b0+1, 0);
+    int hw = (int)ceil(3*sig);
+    std::vector<double> kern(2*hw+1);
+    for(int d=-hw;d<=hw;d++) kern[d+hw] = exp(-0.5*d*d/(sig*sig));
+    for(int b=b0;b<=b1;b++){
+      double v = 0;
+      for(int d=-hw;d<=hw;d++){
+        int bb = b + d;
+        if(bb >= 0 && bb < nbins) v += kern[d+hw]*std::max(0., content[bb]);
+      }
+      sm[b-b0] = sqrt(v);
+    }
+    auto smooth = [&](double x){
+      double u = (x - xlow)/binw - 0.5 - b0;
+      int i = (int)floor(u);
+      if(i < 0 || i+1 >= (int)sm.size()) return 0.;
+      return sm[i] + (u-i)*(sm[i+1]-sm[i]);
+    };
+    // the offset moves the lines by up to a few % of the pure-gain estimate; a much narrower
+    // Cm-Am spacing would stack all the lines on one peak
+    auto score = [&](double xcm, double xmid){
+      double ratio = (xcm - xmid)/(xcm0 - xmid0);
+      if(ratio < 0.9 || ratio > 1.1) return -1.;
+      double g = (fMain[2] - fMain[1])/(xcm - xmid);
+      double o = fMain[2] - g*xcm;
+      double sc = 0;
+      for(const Line &l : fLines) sc += l.w * smooth((l.e - o)/g);
+      return sc;
+    };
+    double bestcm = xcm0, bestmid = xmid0;
+    auto search = [&](double xcm, double xmid, double width){
+      double best = score(xcm, xmid);
+      bestcm = xcm;
+      bestmid = xmid;
+      double step = width/10;
+      for(int pass=0;pass<3;pass++){
+        double ccm = bestcm, cmid = bestmid;
+        int n = (pass == 0) ? 10 : 5;
+        for(int i=-n;i<=n;i++){
+          for(int j=-n;j<=n;j++){
+            double sc = score(ccm + i*step, cmid + j*step);
+            if(sc > best){
+              best = sc;
+              bestcm = ccm + i*step;
+              bestmid = cmid + j*step;
+            }
+          }
+        }
+        step /= 5;
+      }
+    };
+    search(xcm0, xmid0, range);
+    if(!fLowE){
+      // The Pu-Am and Am-Cm spacings differ by 3%: a spectrum with two groups also matches
+      // with Pu/Am on them and Cm on nothing, for the same score. Two groups are Am and Cm (as
+      // the "d" option of tasf); the second search stays within a third of the group spacing.
+      double spacing = bestcm - bestmid;
+      double xpu = bestmid - (fMain[1] - fMain[0])/(fMain[2] - fMain[1])*spacing;
+      if(smooth(bestcm) < 0.2*std::max(smooth(bestmid), smooth(xpu))) search(bestmid, xpu, spacing/3);
+    }
+    seed.gain   = (fMain[2] - fMain[1])/(bestcm - bestmid);
+    seed.offset = fMain[2] - seed.gain*bestcm;
+    seed.xhigh  = bestcm;
+    seed.xlow   = (fMain[0] - seed.offset)/seed.gain;
+    if(!fLowE && smooth(seed.xlow) < 0.2*smooth(bestmid)){   // no Pu group (counts ratio below 4%)
+      seed.twopeaks = true;
+      seed.xlow = bestmid;
+    }
+    seed.ok = seed.gain > 0 && seed.xlow > xlow && seed.xhigh < xlow + nbins*binw;
+    return seed;
+  }
+
+private:
+  bool fLowE;
+  double fSigma;                 // keV
+  double fDu;                    // log step of both grids
+  double fXmin;                  // start of the log(ADC) grid, below it is noise
+  double fVlo;                   // start of the log(E) grid
+  std::vector<Line> fLines;
+  std::vector<double> fMain;     // main line of every group
+  std::vector<double> fT;        // template, log(E) grid
+  double fTNorm = 0;
+  int fNS = 0;                   // log(ADC) cells
+  int fN = 0;                    // FFT size
+  std::vector<std::complex<double>> fTF;   // conj(FFT(template))
+};
+
+// ============================ SeedAlphaHist() ========================================//
+// Seed of h for tasf() / FitAlphaHist(); seeds with a coarse correlation below minscore are
+// returned with ok = false (the caller falls back to PeakHunt())
+inline AlphaSeed SeedAlphaHist(TH1 *h, bool lowE = false, double minscore = 0.2){
+  static const AlphaTemplate high(false), low(true);
+  int nbins = h->GetNbinsX();
+  std::vector<double> content(nbins);
+  for(int b=1;b<=nbins;b++) content[b-1] = h->GetBinContent(b);
+  AlphaSeed seed = (lowE ? low : high).Seed(content.data(), nbins, h->GetXaxis()->GetXmin(), h->GetBinWidth(1));
+  if(seed.score < minscore) seed.ok = false;
+  return seed;
+}
+
+#endif
@@ -0,0 +1,268 @@
+//g++ CalibChain.cxx -Wl,--no-as-needed `root-config --cflags --libs` -lSpectrum -lMinuit -O2 -pthread -Wl,--copy-dt-needed-entries `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -o CalibChain
+
+// Whole calibration chain in one process, built on CalibCore.h:
+//   CalibChain alpha [-target N | -prec P] [-window lo hi] [-frag [-nthreads N] [-ch min max]] calfile files...
+//     = RawHistMaker + FitRawHist: raw_hist.root, fit_hist.root, Calibration.txt, Res_Check.dat
+//   CalibChain hpge [-nthreads N] calfile -s 60co files... [-s 152eu files...] ...
+//     = co60_linfit + Calibration_HistMaker (every source) + Calibration:
+//       co60/co60_linfit.{dat,root}, peaks/peaks_<source>.{dat,root}, cal_pars.dat, calibration.root
+// Libraries, dictionaries and the calibration file are loaded once, and the histograms stay in
+// memory from one stage to the next. The outputs are the files of the single-stage programs, so
+// any stage can still be re-run on its own, and hist_cache/ is shared with them.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#include <TFile.h>
+#include <TChain.h>
+#include <TList.h>
+#include <TH1.h>
+#include <TH2.h>
+#include "InputIndex.h"
+#include "CalibCore.h"
+#include "FitCache.h"
+
+// ============================ WriteList() ========================================//
+void WriteList(const std::string &filename, std::initializer_list<TList *> lists){
+  TFile *newf = new TFile(filename.c_str(), "recreate");
+  newf->cd();
+  for(TList *l : lists) l->Write();
+  newf->Close();
+}
+
+// ============================ CloneHists() ========================================//
+// Every stage fits its own copy, so its output file only holds its own fit functions
+std::vector<TH1 *> CloneHists(const std::vector<TH1 *> &h){
+  std::vector<TH1 *> c;
+  for(TH1 *hs : h){
+    TH1 *copy = (TH1 *)hs->Clone(hs->GetName());
+    copy->SetDirectory(nullptr);
+    c.push_back(copy);
+  }
+  return c;
+}
+
+
+// ====================================== RunAlpha() ==========================================//
+int RunAlpha(int argc, char **argv){
+  EarlyStop stop;
+  bool frag = false;
+  int nthreads = 4, minCH = 0, maxCH = 1099;
+  int iarg = 0;
+  while(iarg<argc && argv[iarg][0]=='-'){
+    std::string o = argv[iarg];
+    if(o=="-frag"){ frag = true; iarg++; continue; }
+    if(iarg+1>=argc) break;
+    if(o=="-target")        stop.target = atof(argv[iarg+1]);
+    else if(o=="-prec")     stop.target = 3./(2.*atof(argv[iarg+1])*atof(argv[iarg+1]));
+    else if(o=="-nthreads") nthreads = atoi(argv[iarg+1]);
+    else if(o=="-ch" && iarg+2<argc){ minCH = atoi(argv[iarg+1]); maxCH = atoi(argv[iarg+2]); iarg++; }
+    else if(o=="-window" && iarg+2<argc){ stop.SetWindow(atof(argv[iarg+1]), atof(argv[iarg+2])); iarg++; }
+    else break;
+    iarg += 2;
+  }
+  if(argc-iarg<2){
+    printf("Input alpha [-target N | -prec P] [-window lo hi] [-frag [-nthreads N] [-ch min max]] Calibration file and Analysistree (FragmentTree) file paths\n");
+    return 1;
+  }
+  const char *calfile = argv[iarg];
+  std::vector<std::string> files(argv+iarg+1, argv+argc);
+  if(!LoadCalFile(calfile)) return 1;
+  InputIndex index(frag ? "FragmentTree" : "AnalysisTree");
+  TChain *chain = index.MakeChain(files);
+  if(chain->GetEntries()==0){
+    printf("No valid root file input\n");
+    return 1;
+  }
+
+  // Step 1: raw histograms (RawHistMaker)
+  std::vector<TH1 *> hv;
+  for(int i=0;i<1100;i++) hv.push_back(NewRawHist(i, "uncalibrated energy histogram at CH"));
+  {
+    PerfTimer timer("stage_rawhist");
+    if(frag) MakeS3FragHist(files, calfile, hv, nthreads, minCH, maxCH);
+    else     MakeS3Hist(files, chain, calfile, hv, &stop);
+  }
+  TList *hlist = new TList;
+  for(TH1 *h : hv){
+    if(h->GetEntries()>10) hlist->Add(h);
+  }
+  WriteList("raw_hist.root", {hlist});
+  printf("\nraw_hist.root: %i channels\n", hlist->GetSize());
+
+  // Step 2: triple-alpha fits (FitRawHist)
+  TList *flist = new TList;
+  std::vector<AlphaFit> fits;
+  {
+    PerfTimer timer("stage_fit");
+    AlphaFitCache cache;   // shared with FitRawHist
+    TIter next(hlist);
+    while(TH1 *h = (TH1 *)next()){
+      fits.push_back(CachedFitAlphaHist(cache, h, atoi(h->GetName()+2)));
+      if(fits.back().fx) flist->Add(fits.back().fx);
+    }
+    cache.Write();
+  }
+  WriteCalibrationTxt(fits);
+  WriteResCheck("Res_Check.dat", fits);
+  StoreAlphaFits(fits);
+  WriteList("fit_hist.root", {hlist, flist});
+  printf("Res_Check.dat: %zu channels\n", fits.size());
+  return 0;
+}
+
+
+// ====================================== RunHPGe() ==========================================//
+struct Source{
+  std::string name;
+  std::vector<std::string> files;
+  std::vector<TH1 *> hists;   // uncalibrated hs0~hs63 of all files of the source
+};
+
+int RunHPGe(int argc, char **argv){
+  int nthreads = 1;
+  int iarg = 0;
+  if(iarg+1<argc && strcmp(argv[iarg], "-nthreads")==0){
+    nthreads = atoi(argv[iarg+1]);
+    iarg += 2;
+  }
+  if(iarg>=argc){
+    printf("Input hpge [-nthreads N] Calibration file -s 60co files... [-s source files...]\n");
+    return 1;
+  }
+  const char *calfile = argv[iarg++];
+  // a source given twice (eg 60co for the linear fit and in the source list) is one source
+  std::vector<Source> sources;
+  int cur = -1;
+  for(;iarg<argc;iarg++){
+    if(strcmp(argv[iarg], "-s")==0 && iarg+1<argc){
+      std::string name = FormatIsotopeName(argv[++iarg]);
+      for(cur=0;cur<(int)sources.size() && sources[cur].name!=name;cur++);
+      if(cur==(int)sources.size()) sources.push_back({name, {}, {}});
+    }else if(cur>=0){
+      std::vector<std::string> &f = sources[cur].files;
+      if(std::find(f.begin(), f.end(), argv[iarg]) == f.end()) f.push_back(argv[iarg]);
+    }
+  }
+  Source *co60 = nullptr;
+  for(Source &s : sources) if(s.name=="60co") co60 = &s;
+  if(!co60){
+    printf("The 60co files are needed for the linear calibration (-s 60co files...)\n");
+    return 1;
+  }
+  if(!LoadCalFile(calfile)) return 1;
+
+  // Step 0: raw histograms of every source
+  InputIndex index("AnalysisTree");
+  {
+    PerfTimer timer("stage_rawhist");
+    for(size_t k=0;k<sources.size();k++){
+      printf("Filling %s: %zu files\n", sources[k].name.c_str(), sources[k].files.size());
+      for(int i=0;i<64;i++) sources[k].hists.push_back(NewRawHist(i, "uncalibrated energy histogram at array"));
+      MakeTigressHist(sources[k].files, index.Count(sources[k].files), calfile, sources[k].hists, nthreads);
+    }
+  }
+  mkdir("co60", 0755);
+  mkdir("peaks", 0755);
+
+  // Step 1: linear calibration with 60Co (co60_linfit)
+  std::vector<double> energies = ReadSourceFile("60co");
+  std::vector<double> energy_err(energies.size(), 0.0);
+  std::vector<LinFit> linfits(64);
+  TList *hlist = new TList, *glist = new TList;
+  {
+    PerfTimer timer("stage_co60");
+    std::vector<TH1 *> hs = CloneHists(co60->hists);
+    for(int i=0;i<64;i++){
+      hlist->Add(hs[i]);
+      if(hs[i]->GetEntries()==0) continue;
+      TGraphErrors *gr = FitCo60Hist(hs[i], i, energies, energy_err, linfits[i]);
+      if(gr) glist->Add(gr);
+    }
+  }
+  WriteLinFitFile(linfits, "co60/co60_linfit.dat");
+  StoreLinFits(linfits);
+  WriteList("co60/co60_linfit.root", {hlist, glist});
+  std::vector<double> lingain(64, -1.0), linoff(64, -1.0);
+  for(int i=0;i<64;i++){
+    const LinFit &f = linfits[i];
+    if(f.gain == 0 && f.offset == 0 && f.sigma == 0) continue;   // same crystals as co60_linfit.dat
+    lingain[i] = f.gain;
+    linoff[i]  = f.offset;
+  }
+
+  // Step 2: peaks of every source at the positions given by the linear calibration (Calibration_HistMaker)
+  std::vector<std::vector<double>> uncalE(64), uncalE_err(64), calE(64);
+  std::vector<std::vector<TH1 *>> fitted;
+  {
+    PerfTimer timer("stage_peaks");
+    for(Source &s : sources){
+      std::vector<double> srcE = ReadSourceFile(s.name);
+      std::vector<std::vector<double>> uncal = UncalCentroids(lingain, linoff, srcE);
+      std::vector<std::vector<double>> cent(64), err(64);
+      std::vector<TH1 *> hs = CloneHists(s.hists);
+      TList *plist = new TList;
+      for(int i=0;i<64;i++){
+        plist->Add(hs[i]);
+        if(hs[i]->GetEntries()==0) continue;
+        FitSourcePeaks(hs[i], i, uncal[i], cent[i], err[i]);
+        uncalE[i].insert(uncalE[i].end(), cent[i].begin(), cent[i].end());
+        uncalE_err[i].insert(uncalE_err[i].end(), err[i].begin(), err[i].end());
+        calE[i].insert(calE[i].end(), srcE.begin(), srcE.begin()+cent[i].size());
+      }
+      WritePeaksFile("peaks/peaks_" + s.name + ".dat", cent, err, srcE);
+      StorePeaks(s.name, cent, err, srcE);
+      WriteList("peaks/peaks_" + s.name + ".root", {plist});
+      fitted.push_back(hs);
+      printf("peaks/peaks_%s.dat written\n", s.name.c_str());
+    }
+  }
+
+  // Step 3: quadratic calibration with all sources (Calibration)
+  double quad[64] = {0}, gain[64] = {0}, offset[64] = {0};
+  TList *qlist = new TList;
+  TH2D *sumc = new TH2D("sumc","uncalibrated summary plot", 4000,0,4000,64,0,64);
+  TH2D *sume = new TH2D("sume","calibrated summary plot"  , 4000,0,4000,64,0,64);
+  {
+    PerfTimer timer("stage_calibration");
+    for(int i=0;i<64;i++){
+      if(uncalE[i].empty()) continue;
+      qlist->Add(FitQuadCal(i, uncalE[i], uncalE_err[i], calE[i], quad[i], gain[i], offset[i]));
+    }
+    for(const std::vector<TH1 *> &hs : fitted){
+      for(int i=0;i<64;i++){
+        if(hs[i]->GetEntries()>0) FillSummary(sumc, sume, hs[i], i, quad[i], gain[i], offset[i]);
+      }
+    }
+  }
+  WriteCalPars(quad, gain, offset);
+  StoreQuadCal(quad, gain, offset, qlist);
+  TFile *newf = new TFile("calibration.root", "recreate");
+  newf->cd();
+  sumc->Write();
+  sume->Write();
+  qlist->Write();
+  newf->Close();
+  printf("cal_pars.dat and calibration.root written (%zu sources)\n", sources.size());
+  return 0;
+}
+
+
+// ====================================== main() ==========================================//
+// argv1: alpha or hpge, then the arguments of RunAlpha() / RunHPGe()
+int main(int argc, char **argv){
+  if(argc<2 || (strcmp(argv[1], "alpha")!=0 && strcmp(argv[1], "hpge")!=0)){
+    printf("Input alpha [options] calfile files...  or  hpge [-nthreads N] calfile -s 60co files... [-s source files...]\n");
+    return 1;
+  }
+  gPerf.Start(std::string("CalibChain_") + argv[1], argc, argv);
+  EnableParallelRead();   // before the reader and fill threads start
+  int rc = strcmp(argv[1], "alpha")==0 ? RunAlpha(argc-2, argv+2) : RunHPGe(argc-2, argv+2);
+  gPerf.Write();
+  return rc;
+}
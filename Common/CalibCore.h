@@ -0,0 +1,1048 @@
+// CalibCore.h: pieces shared by the S3 alpha and TIGRESS calibration programs.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// Everything that used to be copied between RawHistMaker/FitRawHist/QuickLook and
+// co60_linfit/Calibration_HistMaker/Calibration lives here, without global histograms or
+// lists, so the same functions can run one stage per program or the whole chain in one
+// process (CalibChain.cxx):
+//   sources    FormatIsotopeName(), ReadSourceFile()
+//   peaks      PeakHunt()
+//   alpha      TripleAlpha*_Fun(), tasf(), FitAlphaHist(), WriteResCheck(), WriteCalibrationTxt()
+//              (template seed of the gain and offset: AlphaSeed.h; per-channel result cache: FitCache.h)
+//   S3 fill    EarlyStop, FillS3Hist(), FillFragHist(), MakeS3Hist(), MakeS3FragHist()
+//              (gain drift tracking and correction of the fills: DriftTracker.h)
+//   TIGRESS    peak_eqn(), gaus_eqn(), FillTigressHist(), MakeTigressHist(), ReadTigressHist(),
+//              FitCo60Hist(), UncalCentroids(), FitSourcePeaks(), FitQuadCal(), FillSummary()
+//              and the .dat readers/writers
+//   results    StoreAlphaFits(), StoreLinFits(), StorePeaks(), StoreQuadCal() (ResultsStore.h)
+#ifndef CALIBCORE_H
+#define CALIBCORE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+#include <TFile.h>
+#include <TChain.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TList.h>
+#include <TF1.h>
+#include <TGraphErrors.h>
+#include <TMath.h>
+#include <TString.h>
+#include <TSpectrum.h>
+#include <Math/SpecFuncMathCore.h>
+#include "TChannel.h"
+#include "TS3.h"
+#include "TTigress.h"
+#include "TTigressHit.h"
+#include "TFragment.h"
+#include "HistCache.h"
+#include "ChannelTable.h"
+#include "HistPyramid.h"
+#include "AlphaSeed.h"
+#include "ResultsStore.h"
+#include "DriftTracker.h"
+#include "ReadAhead.h"
+#include "PerfReport.h"
+
+// ============================ LoadCalFile() ========================================//
+// Channels of calfile once per process, from its binary snapshot if it has one (ChannelTable.h):
+// a second call with the same file does nothing.
+inline bool LoadCalFile(const char *calfile){
+  return LoadChannels(calfile);
+}
+
+// ============================ Source Name Format ========================================//
+// convert input source name to number + lowercase letter (eg, 60co, 133ba)
+inline std::string FormatIsotopeName(const std::string& srcName="60co") {
+  std::string number, letters;
+  for (char c : srcName) {
+    if (std::isdigit(c))
+      number += c;
+    else if (std::isalpha(c))
+      letters += std::tolower(c);  // ensure lowercase
+  }
+  return number + letters;
+}
+
+// ============================ Read Source File ========================================//
+// Return vector<double> energies = energy of this source for the calibration
+inline std::vector<double> ReadSourceFile(const std::string& source="60co", const std::string& dir="sources"){
+  std::vector<double> energies;
+  std::ifstream infile(dir + "/" + source + ".dat");
+  if (!infile.is_open()) {
+    std::cerr << "Failed to open file: " << source << ".dat" << std::endl;
+    return energies;
+  }
+  std::string line;
+  while (std::getline(infile, line)) {
+    // Skip comment lines starting with '#'
+    if (line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    std::string isotope;
+    double energy, intensity;
+    // Only read the second column (after the isotope string)
+    if (ss >> isotope >> energy >> intensity) {
+      energies.push_back(energy);
+    }
+  }
+  return energies;
+}
+
+// ============================ NewRawHist() ========================================//
+// Uncalibrated charge histogram hs<i> (4000 bins, 0~4000), not attached to any directory
+inline TH1D *NewRawHist(int i, const char *title){
+  TH1D *h = new TH1D(Form("hs%i",i), Form("%s %i",title,i), 4000,0,4000);
+  h->SetDirectory(nullptr);
+  return h;
+}
+
+// ============== PeakHunt() ================ //
+// Peak search in TH1 *hist by using TSpectrum, above xmin (skips the noise at low ADC channel);
+// Return a vector of x-axis position of the npeaks peaks with highest y-values, in increasing x.
+// Defaults are the S3 alpha ones; TIGRESS uses PeakHunt(hist, nref, 20, 2, 0.13).
+inline std::vector<Double_t> PeakHunt(TH1 *hist, int npeaks=3, double xmin=50, double sigma=1, double threshold=0.08){
+  TSpectrum s(10); //max positions = 10
+  hist->GetXaxis()->SetRangeUser(xmin, hist->GetXaxis()->GetXmax()-1); // skip the nosiy peak
+  Int_t nfound = s.Search(hist,sigma,"",threshold); // rough peak-search through the entire hist
+  Double_t *xpeaks = s.GetPositionX();
+  Double_t *ypeaks = s.GetPositionY();
+  std::vector<std::pair<Double_t, Double_t>> peaks;
+  for(int ipeak=0;ipeak<nfound;ipeak++){
+    peaks.emplace_back(xpeaks[ipeak], ypeaks[ipeak]);
+  }
+  // order peaks based on y-values from highest to lowest;
+  // extract the first npeaks elements and put their x-values in a new vector top_xpeaks;
+  // then order top_xpeaks from lowest to highest based on their values;
+  std::sort(peaks.begin(), peaks.end(), [](const auto &m, const auto &n){return m.second > n.second;});
+  std::vector<Double_t> top_xpeaks;
+  for(int ipeak=0;ipeak<std::min(npeaks, nfound);ipeak++){
+    top_xpeaks.push_back(peaks[ipeak].first);
+  }
+  std::sort(top_xpeaks.begin(), top_xpeaks.end());
+  return top_xpeaks;
+}
+
+// Same search on level `level` of the pyramid (2^level merged bins, TSpectrum sigma scaled
+// down to at least 1 bin); every position is then moved to the highest full-resolution bin
+// within one coarse bin, so the peaks are as precise as a full-resolution search.
+inline std::vector<Double_t> PeakHunt(HistPyramid &pyr, int level, int npeaks=3, double xmin=50,
+                                      double sigma=1, double threshold=0.08){
+  TH1 *coarse = pyr.Level(level);
+  double f = pyr.Factor(level);
+  std::vector<Double_t> xpeaks = PeakHunt(coarse, npeaks, xmin, std::max(1., sigma/f), threshold);
+  for(Double_t &x : xpeaks) x = RefinePeak(pyr.Base(), x, coarse->GetBinWidth(1));
+  return xpeaks;
+}
+
+
+// ================================ S3 alpha ======================================== //
+
+// ============= TripleAlphaHighE_Fun() ======================= //
+// TF1 formula for triple alpha source, 239Pu, 241Am, and 244Cm
+// Simulate a triple alpha spectrum for comparison to a histogram
+// Energy calibration and width of peaks are parameters given up to quadratic linear
+inline Double_t TripleAlphaHighE_Fun(Double_t *x, Double_t *par){
+// Parameters:
+// par[0] -- Normalization factor for 239Pu group
+// par[1] -- Normalization factor for 241Am group
+// par[2] -- Normalization factor for 244Cm group
+// par[3] -- FWHM of peaks in keV
+// par[4] -- Bg: Constant offset in counts*
+// par[5] -- Width of Pu peaks relative to Cm
+// par[6] -- Width of Am peaks relative to Cm
+// par[7] -- Offset
+// par[8] -- Linear gain
+
+  Double_t E = par[7]+par[8]*x[0];
+  Double_t sigmaCm = par[3]/2.35;
+  Double_t sigmaPu = sigmaCm*par[5];
+  Double_t sigmaAm = sigmaCm*par[6];
+
+  Double_t return_f = par[0] * ( 0.7077 * TMath::Gaus(E,5156.59,sigmaPu)    // Pu
+                              +0.1711 * TMath::Gaus(E,5144.30,sigmaPu)
+                              +0.1194 * TMath::Gaus(E,5105.80,sigmaPu) )
+                     +par[1] * ( 0.0036 * TMath::Gaus(E,5544.5,sigmaAm)     // Am
+                              +0.0166 * TMath::Gaus(E,5388,sigmaAm)
+                              +0.848 * TMath::Gaus(E,5485.56,sigmaAm)
+                              +0.131 * TMath::Gaus(E,5442.8,sigmaAm) )
+                     +par[2] * ( 0.769 * TMath::Gaus(E,5804.77,sigmaCm)     // Cm
+                              +0.231 * TMath::Gaus(E,5762.16,sigmaCm ) )
+                     +par[4];                                               // Bg
+  return return_f;
+}
+
+// ============= TripleAlphaLowE_Fun() ======================= //
+// TF1 formula for triple alpha source, 148Gd, 230Th, 244Cm
+// Simulate a triple alpha spectrum for comparison to a histogram
+// Energy calibration and width of peaks are parameters given up to quadratic linear
+inline Double_t TripleAlphaLowE_Fun(Double_t *x, Double_t *par){
+// Parameters:
+// par[0] -- Normalization factor for 148Gd group
+// par[1] -- Normalization factor for 230Th group
+// par[2] -- Normalization factor for 244Cm group
+// par[3] -- FWHM of peaks in keV
+// par[4] -- Bg: Constant offset in counts*
+// par[5] -- Width of Gd peaks relative to Cm
+// par[6] -- Width of Th peaks relative to Cm
+// par[7] -- Offset
+// par[8] -- Linear gain
+
+  Double_t E = par[7]+par[8]*x[0];
+  Double_t sigmaCm = par[3]/2.35;
+  Double_t sigmaGd = sigmaCm*par[5];
+  Double_t sigmaTh = sigmaCm*par[6];
+
+  Double_t return_f = par[0] * ( 1.0 * TMath::Gaus(E,3182.690,sigmaGd))
+                     +par[1] * ( 0.2340 * TMath::Gaus(E,4620.5,sigmaTh)
+                              +0.763 * TMath::Gaus(E,4687.0,sigmaTh) )
+                     +par[2] * ( 0.769 * TMath::Gaus(E,5804.77,sigmaCm)
+                              +0.231 * TMath::Gaus(E,5762.16,sigmaCm ) )
+                     +par[4];
+  return return_f;
+}
+
+// ============== tasf() =================== //
+// Return a well defined TF1 for TH1 *h fit
+// TH1 *h needs to zoom in a reasonable range to skip noise at low ADC channel.
+// max and min should be centroids of the first and the last true alpha peaks from the source.
+// if max or min <0, which means PeakHunt() never been called. Call PeakHunt() to obtain max and min values.
+// Options:
+// c: open 2 linear calibration parameters. These two parameters are fixed as default.
+// l: set the TF1 math formula to LowE_Fun. HighE_Fun as default.
+// d: for double peaks
+inline TF1 *tasf(TH1 *h, const char* name = "tas", Double_t min=-1, Double_t max=-1, Option_t *opt=""){
+
+  int xbinfirst = h->GetXaxis()->GetFirst();
+  int xbinlast  = h->GetXaxis()->GetLast();
+  double fit_xlower = h->GetBinLowEdge(xbinfirst);
+  double fit_xupper = h->GetBinLowEdge(xbinlast) + h->GetBinWidth(xbinlast);
+  double ymax = h->GetMaximum();
+
+  TString sopt(opt);
+  sopt.ToLower();
+  sopt.ReplaceAll(" ","");
+
+  TF1 *fx = 0;
+  Int_t Npx = Int_t((xbinlast-xbinfirst+1)*10);
+
+  // Choose the fitting formula
+  if(sopt.Contains("l")){
+    fx = new TF1(name, TripleAlphaLowE_Fun, fit_xlower, fit_xupper, 9);
+    fx->SetParNames("Gd","Th","Cm","fwhmCm","bg","Gd_n","Th_n","offset","gain");
+    fx->SetParLimits(5,0.8,1.3);
+    fx->SetParLimits(6,0.8,1.2);
+    fx->SetNpx(Npx);
+    fx->SetParameters(50,50,50,25,0,1,1,0,20);
+    fx->SetParLimits(0,0,ymax*10);
+    fx->SetParLimits(1,0,ymax*10);
+    fx->SetParLimits(2,0,ymax*10);
+    fx->SetParLimits(3,20,500);
+    fx->SetParLimits(4,0,ymax);    // bg should not be higher than a true peak.
+  }else{ // default fit with TripleAlphaHighE_Fun
+    fx = new TF1(name, TripleAlphaHighE_Fun, fit_xlower,fit_xupper, 9);
+    fx->SetParNames("Pu","Am","Cm","fwhmCm","bg","Pu_n","Am_n","offset","gain");
+    fx->SetParLimits(5,0.5,1.5);
+    fx->SetParLimits(6,0.5,1.5);
+    fx->SetNpx(Npx);
+    fx->SetParameters(50,50,50,25,0,1,1,0,20);
+    fx->SetParLimits(0,0,ymax*10);
+    fx->SetParLimits(1,0,ymax*10);
+    fx->SetParLimits(2,0,ymax*10);
+    fx->SetParLimits(3,20,500);
+    fx->SetParLimits(4,0,ymax);    // bg should not be higher than a true peak.
+    if(sopt.Contains("d")){ // if there are only two peaks in the spectrum. Assume they are from Am and Cm
+      fx->FixParameter(0,0);
+      fx->FixParameter(5,1);
+    }
+  }
+
+  // Need calibration for the current histogram or not
+  if(sopt.Contains("c")){
+    // TODO: chekc the size of peaks, if peaks.size() == 0, which means the zoom in range is wrong
+    // less than 3 peaks hunting in the hist. Reset the range!
+    if(max<0 || min<0){
+      std::vector<double> xpeaks = PeakHunt(h);
+      min = xpeaks.front();
+      max = xpeaks.back();
+    }
+    Double_t gain, offset;
+    if(sopt.Contains("l")){
+      gain = (5804.77-3182.69)/(max-min);
+    }else{
+      if(sopt.Contains("d")){
+        gain = (5804.77-5485.56)/(max-min);
+      }else{
+        gain = (5804.77-5156.59)/(max-min);
+      }
+    }
+    offset = 5804.77 - gain*max;
+    fx->SetParameter(7,offset);
+    fx->SetParameter(8,gain);
+  }else{
+    fx->FixParameter(7,0);  // Calibration offset = 0
+    fx->FixParameter(8,1);  // Calibration gain   = 1
+  }
+  return fx;
+}
+
+// ============================ FitAlphaHist() ========================================//
+// Triple-alpha fit of one S3 channel. A channel with less than 2 peaks found is reported
+// with gain 1, offset 0 and FWHM -1 (no fit function).
+// The peak search, the gain estimate and the first fit pass run on the 4x level of the
+// spectrum (level = 2 of HistPyramid.h, 1000 bins); only the final fit uses the
+// full-resolution bins, and only those of the peak region. level = 0 is the old full-resolution path.
+// The Pu and Cm positions come from the template seed (SeedAlphaHist(), AlphaSeed.h) when
+// seed is true; PeakHunt() is only used for the channels the seeder cannot match.
+struct AlphaFit{
+  int ch;
+  double gain = 1;
+  double offset = 0;
+  double fwhmPu = -1;
+  double fwhmAm = -1;
+  double fwhmCm = -1;
+  double gainErr = 0;
+  double offsetErr = 0;
+  double fwhmCmErr = 0;
+  double chi2ndf = 0;
+  int status = -1;       // status of the final fit, -1 = not fitted
+  double seconds = 0;    // wall time of all fit passes
+  TF1 *fx = nullptr;
+  std::string opt;       // tasf() options of fx
+  bool cached = false;   // taken from the fit cache (FitCache.h), not refitted
+};
+
+// Version of the alpha fit (FitAlphaHist(), tasf(), TripleAlpha*_Fun()). Part of the key of the
+// cached fits: increase it with any change of these that changes the results.
+constexpr int kAlphaFitVersion = 1;
+
+// ============================ ReadAlphaPars() ========================================//
+// gain, offset, FWHMs, errors and chi2/ndf of fit from its function fit.fx
+inline void ReadAlphaPars(AlphaFit &fit){
+  TF1 *fc = fit.fx;
+  fit.gain   = fc->GetParameter(8);
+  fit.offset = fc->GetParameter(7);
+  fit.fwhmCm = fc->GetParameter(3);
+  fit.fwhmAm = fit.fwhmCm * fc->GetParameter(6);
+  fit.fwhmPu = fit.fwhmCm * fc->GetParameter(5);
+  fit.gainErr   = fc->GetParError(8);
+  fit.offsetErr = fc->GetParError(7);
+  fit.fwhmCmErr = fc->GetParError(3);
+  fit.chi2ndf   = fc->GetNDF()>0 ? fc->GetChisquare()/fc->GetNDF() : 0;
+}
+
+inline AlphaFit FitAlphaHist(TH1 *hist, int ch, int level=2, bool seed=true){
+  AlphaFit fit;
+  fit.ch = ch;
+  auto t0 = std::chrono::steady_clock::now();
+  HistPyramid pyr(hist, level);
+  Double_t min, max;
+  bool dpeaks;
+  AlphaSeed s;
+  if(seed){
+    PerfTimer timer("seed");
+    s = SeedAlphaHist(hist);
+  }
+  if(s.ok){
+    gPerf.Count("seed_template", 1);
+    min = s.xlow;
+    max = s.xhigh;
+    dpeaks = s.twopeaks;
+  }else{
+    gPerf.Count("seed_peakhunt", 1);
+    std::vector<Double_t> top_xpeaks = PeakHunt(pyr, level);
+    if(top_xpeaks.size()<2) return fit;   // something wrong with the current hist
+    min = top_xpeaks.front();
+    max = top_xpeaks.back();
+    dpeaks = top_xpeaks.size()==2;
+  }
+  double xwidth = (max-min)/2.;
+  hist->GetXaxis()->SetRangeUser(min-xwidth, max+xwidth);
+  fit.opt = dpeaks ? "cd" : "c";
+  TF1 *fc = tasf(hist, Form("fc_CH%i",ch), min, max, fit.opt.c_str());
+  if(level>0){
+    // first pass on the coarse level; counts per bin are Factor() times larger there
+    TH1 *coarse = pyr.Level(level);
+    coarse->GetXaxis()->SetRangeUser(min-xwidth, max+xwidth);
+    TF1 *fcoarse = tasf(coarse, Form("fc_CH%i_x%i",ch,pyr.Factor(level)), min, max, dpeaks ? "cd" : "c");
+    gPerf.TimedFit(ch, coarse, fcoarse, "LQN");
+    for(int ip=0;ip<fc->GetNpar();ip++){
+      if(dpeaks && (ip==0 || ip==5)) continue;   // fixed by "d"
+      double v = fcoarse->GetParameter(ip);
+      fc->SetParameter(ip, (ip<=2 || ip==4) ? v/pyr.Factor(level) : v);   // Pu/Am/Cm and bg scale with the bin size
+    }
+    delete fcoarse;
+  }else{
+    gPerf.TimedFit(ch, hist, fc, "LQ");
+  }
+  TFitResultPtr r = gPerf.TimedFit(ch, hist, fc, "LQ");
+  fit.fx     = fc;
+  ReadAlphaPars(fit);
+  fit.status    = (int)r;
+  fit.seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return fit;
+}
+
+// ============================ WriteResCheck() ========================================//
+// Res_Check.dat: CHANNEL FWHM(Pu) FWHM(Am) FWHM(Cm) Res%(5.8MeV) GAIN OFFSET CACHED, one line
+// per channel, after an optional comment line. CACHED = 1: result reused from the fit cache.
+// Written to a temporary file (one per process) and renamed, so a reader never sees a
+// half-written file.
+inline bool WriteResCheck(const std::string &filename, const std::vector<AlphaFit> &fits,
+                          const std::string &comment = ""){
+  std::string tmp = filename + ".tmp" + std::to_string((long)getpid());
+  FILE *out = fopen(tmp.c_str(), "w");
+  if(!out){
+    printf("Cannot write %s\n", tmp.c_str());
+    return false;
+  }
+  if(!comment.empty()) fprintf(out, "# %s\n", comment.c_str());
+  fprintf(out, "#CHANNEL\tFWHM(Pu)\tFWHM(Am)\tFWHM(Cm)\tRes%%(5.8MeV)\tGAIN\tOFFSET\tCACHED\n");
+  for(const AlphaFit &f : fits){
+    fprintf(out, "%d\t%.4f\t%.4f\t%.4f\t%.2f\t%.4f\t%.4f\t%d\n",
+            f.ch, f.fwhmPu, f.fwhmAm, f.fwhmCm, f.fwhmCm/5800.0*100.0, f.gain, f.offset, (int)f.cached);
+  }
+  fclose(out);
+  std::rename(tmp.c_str(), filename.c_str());
+  return true;
+}
+
+// ============================ WriteCalibrationTxt() ========================================//
+// Print the fit results and save the gains and offsets as C arrays
+inline void WriteCalibrationTxt(const std::vector<AlphaFit> &fits, const std::string &filename = "Calibration.txt"){
+  std::cout << "#CHANNEL" << "\t"
+            << "FWHM(Pu)"<< "\t\t"
+            << "FWHM(Am)"<< "\t\t"
+            << "FWHM(Cm)"<< "\t\t"
+            << "GAIN"    << "\t\t"
+            << "OFFSET"  << std::endl;
+  for(const AlphaFit &f : fits){
+    std::cout << f.ch << "\t"
+              << f.fwhmPu << "\t\t"
+              << f.fwhmAm << "\t\t"
+              << f.fwhmCm << "\t\t"
+              << f.gain << "\t\t"
+              << f.offset << std::endl;
+  }
+  std::ofstream outfile(filename);
+  outfile << "float GAIN[" << fits.size() << "] = {";
+  for(size_t i=0;i<fits.size();i++) outfile << (i ? ", " : "") << fits[i].gain;
+  outfile << "};\n" << "float OFFSET[" << fits.size() << "] = {";
+  for(size_t i=0;i<fits.size();i++) outfile << (i ? ", " : "") << fits[i].offset;
+  outfile << "};";
+  outfile.close();
+  std::cout << "Writing gains and offsets to " << filename << std::endl;
+}
+
+// ============================ Early stop ========================================//
+// Adaptive mode: count the hits in the Pu/Am/Cm peak window of every channel while filling,
+// and stop reading once every active channel has target of them. The window is the fit range
+// of FitAlphaHist() around the template seed (SeedAlphaHist()) of the warm-up histogram, or
+// the ADC range given with -window; until then, and for channels without a seed, every hit
+// above the low-ADC noise is counted. A relative FWHM precision p needs about 1/(2p^2) counts
+// in a peak, so -prec p is turned into target = 3/(2p^2) (three peaks of similar intensity).
+struct EarlyStop{
+  double target = 0;           // peak-window counts per channel, 0 = read everything
+  long warmup = 100000;        // entries read before the windows are set and the first check
+  bool windows = false;        // lo/hi set, from the seeds or SetWindow()
+  std::vector<long> counts = std::vector<long>(1100, 0);
+  std::vector<double> lo = std::vector<double>(1100, 50);     // ADC below 50 is noise (see PeakHunt)
+  std::vector<double> hi = std::vector<double>(1100, 1e30);
+
+  void Count(int ch, double c){ if(c>=lo[ch] && c<hi[ch]) counts[ch]++; }
+
+  // the same ADC window [xlo, xhi) for every channel (-window), no seeding
+  void SetWindow(double xlo, double xhi){
+    std::fill(lo.begin(), lo.end(), xlo);
+    std::fill(hi.begin(), hi.end(), xhi);
+    windows = true;
+  }
+
+  // window of every active channel from its seed on h, counts restart from the contents of h
+  void SetWindows(const std::vector<TH1 *> &h){
+    PerfTimer timer("seed");
+    int nseed = 0;
+    for(int ch=0;ch<1100 && ch<(int)h.size();ch++){
+      if(!Active(ch)) continue;
+      AlphaSeed s = SeedAlphaHist(h[ch]);
+      if(!s.ok) continue;
+      double xwidth = (s.xhigh-s.xlow)/2.;   // as the fit range of FitAlphaHist()
+      lo[ch] = s.xlow - xwidth;
+      hi[ch] = s.xhigh + xwidth;
+      TAxis *ax = h[ch]->GetXaxis();
+      counts[ch] = (long)h[ch]->Integral(ax->FindBin(lo[ch]), ax->FindBin(hi[ch]));
+      nseed++;
+    }
+    windows = true;
+    printf("\nPeak windows from the seeds of %i channels, the others count every hit above ADC 50\n", nseed);
+  }
+
+  // channels with enough hits to be real; a handful of noise hits does not block the stop
+  bool Active(int ch) const { return counts[ch] >= std::max(10., 0.01*target); }
+  bool Reached() const {
+    int nactive = 0;
+    for(int ch=0;ch<1100;ch++){
+      if(!Active(ch)) continue;
+      if(counts[ch] < target) return false;
+      nactive++;
+    }
+    return nactive > 0;
+  }
+};
+
+// ============================ Fill the unclibrated S3 energy ========================================//
+// Fill sector/ring charges of all entries in chain into h[channel number], corrected with
+// gDriftCor if a drift table is loaded
+// stop: adaptive mode, reading ends once stop->Reached()
+// drift: also fill the time slices of the drift tracking (uncorrected charges)
+inline void FillS3Hist(TChain *chain, std::vector<TH1 *> &h, EarlyStop *stop=nullptr,
+                       DriftTracker *drift=nullptr){
+  if(!chain->FindBranch("TS3")){
+    std::cout << "Branch 'TS3' not found! TS3 variable is NULL pointer" << std::endl;
+    return;
+  }
+  SetupReadCache(chain, {"TS3"});
+  ReadAhead<TS3> reader(chain, "TS3");   // GetEntry() runs on the reader thread
+  long nentries = reader.GetEntries();
+
+  long xentry = 0;
+  long nhits = 0;
+  while(TS3 *s3 = reader.Next()){
+    xentry = reader.Entry();
+    nhits += s3->GetSectorMultiplicity() + s3->GetRingMultiplicity();
+    for(int i=0;i<s3->GetSectorMultiplicity();i++){
+      TS3Hit *sec_hit = s3->GetSectorHit(i);
+      int sec_ch   = gChannels.Number(sec_hit->GetAddress());
+      if(sec_ch<0 || sec_ch>=(int)h.size()) continue;
+      double sec_c = sec_hit->GetCharge();
+      double sec_t = sec_hit->GetTime();
+      if(drift) drift->Fill(sec_ch, sec_t, sec_c);
+      double sec_e = gDriftCor.Apply(sec_ch, sec_t, sec_c);
+      h[sec_ch]->Fill(sec_e);
+      if(stop) stop->Count(sec_ch, sec_e);
+    }// i (sector) loop over
+    for(int i=0;i<s3->GetRingMultiplicity();i++){
+      TS3Hit *ring_hit = s3->GetRingHit(i);
+      int ring_ch   = gChannels.Number(ring_hit->GetAddress());
+      if(ring_ch<0 || ring_ch>=(int)h.size()) continue;
+      double ring_c = ring_hit->GetCharge();
+      double ring_t = ring_hit->GetTime();
+      if(drift) drift->Fill(ring_ch, ring_t, ring_c);
+      double ring_e = gDriftCor.Apply(ring_ch, ring_t, ring_c);
+      h[ring_ch]->Fill(ring_e);
+      if(stop) stop->Count(ring_ch, ring_e);
+    }// i (ring) loop over
+    if((xentry%10000)==0){
+      printf("Making Hist on entry: %lu / %lu \r", xentry, nentries);
+      fflush(stdout);
+      if(stop && xentry>=stop->warmup && !stop->windows) stop->SetWindows(h);
+      if(stop && xentry>=stop->warmup && stop->Reached()){
+        printf("\nEvery active channel has %.0f peak counts, stop at entry %lu / %lu (%.1f%%)\n",
+               stop->target, xentry+1, nentries, 100.*(xentry+1)/nentries);
+        break;
+      }
+    }
+  } // entries loop over
+  gPerf.Count("hits", nhits);
+}
+
+// ============================ Fill from fragments ========================================//
+// Fragment mode: fill the charge of every fragment with channel number in [minCH, maxCH] into
+// h[channel number] (same histograms as the TS3 fill, no event building needed)
+inline void FillFragHist(TChain *chain, std::vector<TH1 *> &h, int minCH, int maxCH){
+  if(!chain->FindBranch("TFragment")){
+    std::cout << "Branch 'TFragment' not found! TFragment variable is NULL pointer" << std::endl;
+    return;
+  }
+  chain->SetBranchStatus("*", 0);
+  chain->SetBranchStatus("TFragment*", 1);
+  chain->SetCacheSize(50*1024*1024);
+  chain->AddBranchToCache("TFragment*", true);
+  TFragment *frag = nullptr;
+  chain->SetBranchAddress("TFragment", &frag);
+  long nentries = chain->GetEntries();
+  PerfTimer timer("fill_fragments");   // summed over the fill threads
+  for(long xentry=0;xentry<nentries;xentry++){
+    if(chain->GetEntry(xentry) <= 0) continue;
+    int ch = gChannels.Number(frag->GetAddress());
+    if(ch<minCH || ch>maxCH || ch<0 || ch>=(int)h.size()) continue;
+    h[ch]->Fill(gDriftCor.Apply(ch, frag->GetTime(), frag->GetCharge()));
+  }
+  gPerf.Count("entries", nentries);
+  gPerf.Count("hits", nentries);
+  gPerf.Tree(chain->GetTree());
+  chain->ResetBranchAddresses();
+  delete frag;
+}
+
+// ============================ MakeS3Hist() ========================================//
+// Fill h (1100 S3 channels) from AnalysisTree files, one file at a time: files already filled
+// with the same calibration file are taken from hist_cache/ (see HistCache.h).
+// stop: adaptive mode (stop->target > 0), the whole chain is read in one go without the cache,
+//       up to the point where every active channel has enough peak counts
+// drift: drift tracking, the whole chain is read in one go without the cache as well
+inline void MakeS3Hist(const std::vector<std::string> &files, TChain *chain, const char *calfile,
+                       std::vector<TH1 *> &h, EarlyStop *stop=nullptr, DriftTracker *drift=nullptr){
+  if(drift && !(stop && stop->target>0)){
+    FillS3Hist(chain, h, nullptr, drift);
+    return;
+  }
+  if(stop && stop->target>0){
+    FillS3Hist(chain, h, stop, drift);
+    std::vector<int> low;
+    for(int ch=0;ch<1100;ch++){
+      if(stop->Active(ch) && stop->counts[ch] < stop->target) low.push_back(ch);
+    }
+    if(!low.empty()){
+      printf("%zu channels below %.0f peak counts:\n", low.size(), stop->target);
+      for(int ch : low) printf("  CH %i: %ld\n", ch, stop->counts[ch]);
+    }
+    return;
+  }
+  HistCache cache(gDriftCor.Tag("RawHistMaker"), calfile);
+  CachedFill(cache, files, h, [](const std::string &file, std::vector<TH1 *> &parts){
+    TChain chain("AnalysisTree");
+    chain.Add(file.c_str());
+    FillS3Hist(&chain, parts);
+  });
+}
+
+// ============================ MakeS3FragHist() ========================================//
+// Fragment mode: FragmentTree files, one subrun per thread (nthreads at a time); files already
+// filled with the same calibration file are taken from hist_cache/ like the AnalysisTree mode
+inline void MakeS3FragHist(const std::vector<std::string> &files, const char *calfile,
+                           std::vector<TH1 *> &h, int nthreads, int minCH, int maxCH){
+  HistCache cache(gDriftCor.Tag(Form("RawHistMakerFrag%i_%i", minCH, maxCH)), calfile);
+  ParallelCachedFill(cache, files, h, nthreads, [minCH, maxCH](const std::string &file, std::vector<TH1 *> &parts){
+    TChain chain("FragmentTree");
+    chain.Add(file.c_str());
+    FillFragHist(&chain, parts, minCH, maxCH);
+  });
+}
+
+
+// ================================ TIGRESS ======================================== //
+
+// ============================ TF1: fancy gaus fitting function ========================================//
+// I don't understand "erf" part;
+// I copied from Stephen's code;
+// He probably copied from Red-Ware;
+//fit[j] = new TF1(Form("Fit %i-%i", i, j), "[0]*(exp(-((x-[1])^2/(2*[2]^2))))*(1+ROOT::Math::erf([5]*((x-[1]))/([2]*pow(2,0.5)))) + [3] + [4]*(0.5*(1-(ROOT::Math::erf(((x-[1])/([2]*2^(0.5)))))))", x_pos - 50, x_pos + 50);
+//fit[j]->SetParameters(y_pos, x_pos, 1, 15, 1, -1);
+//fit[j]->SetParLimits(0, 10, 1e6); //area
+//fit[j]->SetParLimits(1, x_pos - 10, x_pos + 10); //centroid
+//fit[j]->SetParLimits(2, 0.2, 15); //sigma
+//fit[j]->SetParLimits(4, 0.1, 100); //magnitude of step in background noise
+//fit[j]->SetParLimits(5, -10, -0.1); //background noise constant
+inline Double_t peak_eqn(Double_t *x, Double_t *par){
+
+  Double_t gaus_val = par[0]*exp(-(pow((x[0]-par[1]),2))/(2*par[2]*par[2]));
+  Double_t erf_inp  = (x[0]-par[1])/(par[2]*pow(2,0.5));
+  Double_t return_val = gaus_val * (1+ROOT::Math::erf(par[5]*erf_inp))
+                      + par[3] + par[4]*(0.5*(1-ROOT::Math::erf(erf_inp)));
+  return return_val;
+}
+
+// ============================ TF1: simple gaus + linear bg ===================================//
+inline Double_t gaus_eqn(Double_t *x, Double_t *par){
+  // Gussian part
+  double A = par[0];
+  double x0 = par[1];
+  double sigma = par[2];
+  double gaus = A*TMath::Exp(-(x[0]-x0)*(x[0]-x0))/(2*sigma*sigma);
+  // linear bg
+  double bg = par[3] + par[4]*x[0];
+
+  return gaus + bg;
+}
+
+// ============================ Fill the unclibrated TIGRESS energy ========================================//
+// Fill the charge of every crystal hit of chain into h[array number], corrected with gDriftCor
+// drift: also fill the time slices of the drift tracking (uncorrected charges)
+inline void FillTigressHist(TChain *chain, std::vector<TH1 *> &h, DriftTracker *drift=nullptr){
+  if(!chain->FindBranch("TTigress")){
+    std::cout << "Branch 'TTigress' not found! TTigress variable is NULL pointer" << std::endl;
+    return;
+  }
+  SetupReadCache(chain, {"TTigress"});
+  ReadAhead<TTigress> reader(chain, "TTigress");   // GetEntry() runs on the reader thread
+  long nentries = reader.GetEntries();
+
+  long xentry = 0;
+  long nhits = 0;
+  while(TTigress *tig = reader.Next()){
+    xentry = reader.Entry();
+    nhits += tig->GetMultiplicity();
+    for(int i=0;i<tig->GetMultiplicity();i++){
+      TTigressHit* tig_hit = tig->GetTigressHit(i);
+      int arryn = gChannels.Array(tig_hit->GetAddress()); // xtal number, FulVA and FulVB from the same xtal give the same number. Eg, TIG01BN00A=0 TIG01GN00B=1 TIG05BN00A=16
+      if(arryn<0 || arryn>=(int)h.size()) continue;
+      double charge = tig_hit->GetCharge();
+      double t = tig_hit->GetTime();
+      if(drift) drift->Fill(arryn, t, charge);
+      h[arryn]->Fill(gDriftCor.Apply(arryn, t, charge));
+    }// loop xtal hits
+    if((xentry%10000)==0){
+      printf("Making Hist on entry: %lu / %lu \r", xentry, nentries);
+      fflush(stdout);
+    }
+  } // entries loop over
+  gPerf.Count("hits", nhits);
+}
+
+// ============================ MakeTigressHist() ========================================//
+// Fill h (64 crystals) from AnalysisTree files, one file at a time: files already filled with
+// the same calibration file are taken from hist_cache/ (see HistCache.h). co60_linfit,
+// Calibration_HistMaker and CalibChain fill the same histograms, so they share the cache
+// entries. nthreads > 1 fills that many files at once.
+// counts: entries of each file (InputIndex::Count()), so a chain never scans a file for its
+//         count; files with no entries or without AnalysisTree (count <= 0) are skipped
+// drift: drift tracking, all files are read in one go without the cache
+inline void MakeTigressHist(const std::vector<std::string> &files, const std::vector<long> &counts,
+                            const char *calfile, std::vector<TH1 *> &h, int nthreads=1,
+                            DriftTracker *drift=nullptr){
+  std::vector<std::string> good;
+  std::map<std::string, long> entries;
+  for(size_t i=0;i<files.size();i++){
+    if(counts[i] < 0) std::cerr << "Skip file without AnalysisTree: " << files[i] << std::endl;
+    if(counts[i] <= 0) continue;
+    good.push_back(files[i]);
+    entries[files[i]] = counts[i];
+  }
+  HistCache cache(gDriftCor.Tag("TigressRaw"), calfile);
+  auto fill = [&entries](const std::string &file, std::vector<TH1 *> &parts){
+    TChain chain("AnalysisTree");
+    chain.Add(file.c_str(), entries.at(file));
+    FillTigressHist(&chain, parts);
+  };
+  if(drift){
+    TChain chain("AnalysisTree");
+    for(const std::string &file : good) chain.Add(file.c_str(), entries.at(file));
+    FillTigressHist(&chain, h, drift);
+  }else if(nthreads>1){
+    ParallelCachedFill(cache, good, h, nthreads, fill);
+  }else{
+    CachedFill(cache, good, h, fill);
+  }
+  long nhits = 0;
+  for(TH1 *hs : h) nhits += (long)hs->GetEntries();
+  printf("Making Raw Hist DONE!  Hits: %lu \n", nhits);
+}
+
+// ============================ Read merged raw hist ========================================//
+// -i: take hs0~hs63 from the merged shards (MergeHists) instead of filling them; crystals
+// missing from the file get an empty histogram
+inline bool ReadTigressHist(const std::string &filename, std::vector<TH1 *> &h){
+  TFile *infile = TFile::Open(filename.c_str(), "read");
+  if(!infile || infile->IsZombie()){
+    std::cerr << "Cannot open file: " << filename << std::endl;
+    return false;
+  }
+  h.clear();
+  for(int i=0;i<64;i++){
+    TH1D *hs = (TH1D *)infile->Get(Form("hs%i",i));
+    if(hs){
+      hs = (TH1D *)hs->Clone(Form("hs%i",i));
+      hs->SetDirectory(nullptr);
+    }else{
+      hs = NewRawHist(i, "uncalibrated energy histogram at array");
+    }
+    h.push_back(hs);
+  }
+  infile->Close();
+  return true;
+}
+
+// ============================ FitCo60Hist() ========================================//
+// Linear calibration of crystal i from the nref = energies.size() strongest peaks of hs:
+// every peak is fitted with peak_eqn, then the centroids against energies with a line.
+// sigma is the width of the last (1332-keV) peak in keV.
+struct LinFit{
+  double gain = 0;
+  double offset = 0;
+  double sigma = 0;
+  double gainErr = 0;
+  double offsetErr = 0;
+  double chi2ndf = 0;    // of the line through the centroids
+  int status = -1;       // -1 = not fitted, otherwise the worst status of the fits
+  double seconds = 0;
+};
+
+inline TGraphErrors *FitCo60Hist(TH1 *hs, int i, const std::vector<double> &energies,
+                                 const std::vector<double> &energy_err, LinFit &fit){
+  int nref = energies.size(); // how many peaks used for the calibration (nref = 2 for 60Co)
+  auto t0 = std::chrono::steady_clock::now();
+  HistPyramid pyr(hs, 1);
+  std::vector<Double_t> xpeaks = PeakHunt(pyr, 1, nref, 20, 2, 0.13); // search on the 2x level, refined on hs
+  if((int)xpeaks.size()<nref){
+    printf("Arraynumber[%i] has %zu peaks less than %i peaks listed in source.dat\n", i, xpeaks.size(), nref);
+    return nullptr;
+  }
+  std::vector<double> centroids(nref), centroid_errs(nref);
+  double sigma = -1;
+  for(int j=0;j<nref;j++){
+    double binc = hs->GetBinContent(hs->FindBin(xpeaks[j]));
+    TF1 *fx = new TF1(Form("fx%i_peak%i",i,j), peak_eqn, xpeaks[j]-50, xpeaks[j]+50,5);
+    fx->SetParameters(binc, xpeaks[j], 1, 15, 1, -1);
+    fx->SetParLimits(0, 10, 1e6); //area
+    fx->SetParLimits(1, xpeaks[j] - 10, xpeaks[j] + 10); //centroid
+    fx->SetParLimits(2, 0.2, 15); //sigma
+    fx->SetParLimits(4, 0.1, 100); //magnitude of step in background noise
+    fx->SetParLimits(5, -10, -0.1); //background noise constant
+    int status = gPerf.TimedFit(i, hs, fx, "RQ+");
+    fit.status = std::max(fit.status, status);
+    centroids[j] = fx->GetParameter(1);
+    centroid_errs[j] = fx->GetParError(1);
+    sigma = fx->GetParameter(2); // Report resolution with sigma from 1332-keV peak
+  }// peaks loop over
+  TGraphErrors *gr = new TGraphErrors(nref, centroids.data(), energies.data(), centroid_errs.data(), energy_err.data());
+  gr->SetName(Form("gr%i",i));
+  TF1 *flin = new TF1(Form("flin%i",i),"[0]+[1]*x");
+  flin->SetParameters(10,1);
+  int status = gPerf.TimedFit(i, gr, flin, "Q+");
+  fit.status = std::max(fit.status, status);
+  fit.offset = flin->GetParameter(0);
+  fit.gain   = flin->GetParameter(1);
+  fit.sigma  = sigma * fit.gain;
+  fit.offsetErr = flin->GetParError(0);
+  fit.gainErr   = flin->GetParError(1);
+  fit.chi2ndf   = flin->GetNDF()>0 ? flin->GetChisquare()/flin->GetNDF() : 0;
+  fit.seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return gr;
+}
+
+// =========================== WriteLinFitFile() ================================ //
+inline void WriteLinFitFile(const std::vector<LinFit> &fits, const std::string &filename = "co60_linfit.dat"){
+  std::ofstream outfile(filename);
+  outfile << "# ArrayNum  Gain   Offset  FWHM(1332)  Res%(1332)\n";
+  for (size_t i = 0; i < fits.size(); ++i) {
+    const LinFit &f = fits[i];
+    if (f.gain == 0 && f.offset == 0 && f.sigma == 0) continue; // skip unused channels
+    double fwhm = f.sigma * 2.35;
+    double resolution = fwhm / 1332.0 * 100;
+    outfile << std::setw(9) << i
+            << std::setw(10) << std::fixed << std::setprecision(6) << f.gain
+            << std::setw(10) << f.offset
+            << std::setw(13) << fwhm
+            << std::setw(11) << resolution << '\n';
+  }
+  outfile.close();
+}
+
+// ============================ Read co60_linfit.dat File ========================================//
+// Return gain and offset saved in the file (-1 for crystals not in the file).
+inline std::pair<std::vector<double>, std::vector<double>> ReadLinFitFile(const std::string& filename = "co60/co60_linfit.dat"){
+  std::vector<double> lingain(64,-1.0);
+  std::vector<double> linoffset(64,-1.0);
+  std::ifstream infile(filename);
+  if (!infile.is_open()) {
+    std::cerr << "Failed to open file: " << filename << std::endl;
+    return {lingain,linoffset};
+  }
+  std::string line;
+  while (std::getline(infile, line)) {
+    // Skip comment lines starting with '#'
+    if (line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    int arryn;
+    double g, o, fwhm, res;
+    // Only read the second and third column (after the array number)
+    if (ss >> arryn >> g >> o >> fwhm >> res) {
+      lingain[arryn] = g;
+      linoffset[arryn] = o;
+    } // if over
+  } // while loop over
+  return {lingain, linoffset};
+}
+
+// ============================ UncalCentroids() ========================================//
+// uncal[i][j] = expected uncalibrated centroid of energy j in crystal i from the linear
+// calibration, uncal_E = (cal_E - offset) / gain (0 for crystals without one, lingain < 0)
+inline std::vector<std::vector<double>> UncalCentroids(const std::vector<double> &lingain, const std::vector<double> &linoff,
+                                                       const std::vector<double> &energies){
+  std::vector<std::vector<double>> uncal(64, std::vector<double>(energies.size()));
+  for(size_t i=0;i<lingain.size() && i<64;i++){
+    if(lingain[i]<0) continue; // skip non-existent crystals
+    for(size_t j=0;j<energies.size();j++){
+      uncal[i][j] = (energies[j]-linoff[i])/lingain[i];
+    }// j (ref energy) loop over
+  } // i (array number) loop over
+  return uncal;
+}
+
+// ============================ FitSourcePeaks() ========================================//
+// Gaus fit of the peaks of crystal i around the uncalibrated centroids expected from the
+// 60Co linear calibration; the fitted centroids and errors are appended to cent/err.
+inline void FitSourcePeaks(TH1 *hs, int i, const std::vector<double> &uncal,
+                           std::vector<double> &cent, std::vector<double> &err){
+  for(size_t j=0;j<uncal.size();j++){
+    Int_t bin_guess = hs->FindBin(uncal[j]);
+    Int_t peak_bin = MaxBinIn(hs, bin_guess-15, bin_guess+15); // highest bin near the guess, no zoom/unzoom
+    double x_guess = hs->GetBinCenter(peak_bin);
+    double y_guess = hs->GetBinContent(peak_bin);
+    TF1 *fx = new TF1(Form("fx%i_peak%zu",i,j), gaus_eqn, x_guess-8, x_guess+8,5);
+    fx->SetParameters(y_guess, x_guess, 0.5, y_guess/100., -0.1);
+    fx->SetParLimits(0, y_guess*0.8, y_guess*1.2); //area
+    fx->SetParLimits(1, x_guess - 10, x_guess + 10); //centroid
+    fx->SetParLimits(2, 0., 15); //sigma of gaussian distribution
+    gPerf.TimedFit(i, hs, fx, "QR+");
+    cent.push_back(fx->GetParameter(1));
+    err.push_back(fx->GetParError(1));
+  } // j (peak number) loop over
+}
+
+// ============================ WritePeaksFile() ========================================//
+// peaks_<source>.dat: array number, uncalibrated centroid, error and energy of every peak
+inline void WritePeaksFile(const std::string &filename, const std::vector<std::vector<double>> &centroids,
+                           const std::vector<std::vector<double>> &centroids_err, const std::vector<double> &energies){
+  std::ofstream outfile(filename);
+  outfile << "# ArrayNum\tUncal_E\tErr\tEnergies\n";
+  for(size_t i=0; i<centroids.size(); i++){
+    for(size_t j=0; j<centroids[i].size(); j++){
+      outfile << i << '\t'
+              << centroids[i][j] << '\t'
+              << centroids_err[i][j] << '\t'
+              << energies[j] << '\n';
+    }
+  }
+  outfile.close();
+}
+
+// ============================ FitQuadCal() ========================================//
+// Quadratic calibration of crystal i from the peaks of all sources
+inline TGraphErrors *FitQuadCal(int i, const std::vector<double> &uncalE, const std::vector<double> &uncalE_err,
+                                const std::vector<double> &energies, double &quad, double &gain, double &offset){
+  std::vector<double> energies_err(energies.size(), 0.0);
+  TGraphErrors *gr = new TGraphErrors(uncalE.size(),
+                                      uncalE.data(), energies.data(),
+                                      uncalE_err.data(), energies_err.data());
+  gr->SetName(Form("gr%i",i));
+  TF1 *fx = new TF1(Form("fx%i",i), "[0]+[1]*x+[2]*x*x");
+  fx->SetParameters(30,1.5,1e-6);
+  gPerf.TimedFit(i, gr, fx, "Q");
+  offset = fx->GetParameter(0);
+  gain = fx->GetParameter(1);
+  quad = fx->GetParameter(2);
+  return gr;
+}
+
+// ====================================== WriteCalPars() ========================================//
+inline void WriteCalPars(const double *quad, const double *gain, const double *offset,
+                         const std::string& filename="cal_pars.dat") {
+  std::ofstream fout(filename);
+  const double *pars[3] = {quad, gain, offset};
+  const char *names[3] = {"non_lin", "gain", "offset"};
+  for(int p=0;p<3;p++){
+    fout << "float " << names[p] << "[64] = {";
+    for (int i = 0; i < 64; ++i) {
+      fout << pars[p][i];
+      if (i != 63) fout << ", ";
+    }
+    fout << "};\n";
+  }
+  fout.close();
+}
+
+// ====================================== FillSummary() ====================================//
+// Add the uncalibrated and calibrated spectrum of crystal i to the summary plots
+inline void FillSummary(TH2D *sumc, TH2D *sume, TH1 *h, int i, double quad, double gain, double offset){
+  for(int n=1;n<=h->GetNbinsX();n++){
+    double content = h->GetBinContent(n);
+    if(content==0) continue;
+    double charge = h->GetBinCenter(n);
+    double energy = offset + gain*charge + quad*charge*charge;
+    sumc->Fill(charge, i, content);
+    sume->Fill(energy, i, content);
+  }
+}
+
+// ====================================== Results store ====================================//
+// Append the results of one stage to the store of all runs (ResultsStore.h, directory from
+// $RESULTS_STORE, run number from $CAL_RUN); the .dat files of the stage are still written.
+inline void StoreAlphaFits(const std::vector<AlphaFit> &fits){
+  std::vector<ResultRec> recs;
+  for(const AlphaFit &f : fits){
+    ResultRec r = MakeResult("alpha", f.ch);
+    const double val[6] = {f.gain, f.offset, f.fwhmPu, f.fwhmAm, f.fwhmCm, f.fwhmCm/5800.0*100.0};
+    const double err[6] = {f.gainErr, f.offsetErr, 0, 0, f.fwhmCmErr, f.fwhmCmErr/5800.0*100.0};
+    std::copy(val, val+6, r.val);
+    std::copy(err, err+6, r.err);
+    r.chi2ndf = f.chi2ndf;
+    r.status  = f.status;
+    r.seconds = f.seconds;
+    recs.push_back(r);
+  }
+  ResultsStore().Append(recs);
+}
+
+// crystals without a fit (same as in co60_linfit.dat) are not stored
+inline void StoreLinFits(const std::vector<LinFit> &fits){
+  std::vector<ResultRec> recs;
+  for(size_t i=0;i<fits.size();i++){
+    const LinFit &f = fits[i];
+    if(f.gain == 0 && f.offset == 0 && f.sigma == 0) continue;
+    ResultRec r = MakeResult("co60", i);
+    r.val[0] = f.gain;    r.err[0] = f.gainErr;
+    r.val[1] = f.offset;  r.err[1] = f.offsetErr;
+    r.val[2] = f.sigma*2.35;
+    r.val[3] = f.sigma*2.35/1332.0*100;
+    r.chi2ndf = f.chi2ndf;
+    r.status  = f.status;
+    r.seconds = f.seconds;
+    recs.push_back(r);
+  }
+  ResultsStore().Append(recs);
+}
+
+// one record per peak (sub = peak number), stage "peaks_<source>"
+inline void StorePeaks(const std::string &source, const std::vector<std::vector<double>> &centroids,
+                       const std::vector<std::vector<double>> &centroids_err, const std::vector<double> &energies){
+  std::vector<ResultRec> recs;
+  for(size_t i=0;i<centroids.size();i++){
+    for(size_t j=0;j<centroids[i].size() && j<energies.size();j++){
+      ResultRec r = MakeResult("peaks_" + source, i, j);
+      r.val[0] = energies[j];
+      r.val[1] = centroids[i][j];
+      r.err[1] = centroids_err[i][j];
+      recs.push_back(r);
+    }
+  }
+  ResultsStore().Append(recs);
+}
+
+// graphs: the gr<i> of FitQuadCal(), with their fx<i>
+inline void StoreQuadCal(const double *quad, const double *gain, const double *offset, TList *graphs){
+  std::vector<ResultRec> recs;
+  TIter next(graphs);
+  while(TGraphErrors *gr = (TGraphErrors *)next()){
+    int i = atoi(gr->GetName()+2);
+    if(i<0 || i>=64) continue;
+    ResultRec r = MakeResult("quad", i);
+    r.val[0] = quad[i];
+    r.val[1] = gain[i];
+    r.val[2] = offset[i];
+    TF1 *fx = gr->GetFunction(Form("fx%i",i));
+    if(fx){
+      for(int p=0;p<3;p++) r.err[p] = fx->GetParError(2-p);   // fx = [0]+[1]*x+[2]*x*x
+      r.chi2ndf = fx->GetNDF()>0 ? fx->GetChisquare()/fx->GetNDF() : 0;
+    }else{
+      r.status = -1;
+    }
+    recs.push_back(r);
+  }
+  ResultsStore().Append(recs);
+}
+
+#endif
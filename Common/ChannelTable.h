@@ -0,0 +1,290 @@
+// ChannelTable.h: binary snapshot of a GRSI calibration file and flat channel lookups.
+// Header only (C++17), include it after the ROOT/GRSI headers and compile with -I<repo>/Common.
+//
+// TChannel::ReadCalFile() parses the whole text calibration file in every program, every
+// shard process and (in AlphaCalibration.c) every MakeHist call. gChannels.Load(calfile)
+//  1. hashes the calibration file and looks for its snapshot, "<caldir>/.<calname>.chsnap"
+//     (or "<calname>.chsnap" in the working directory if the calibration directory is
+//     read-only), valid only for the same file size and content hash;
+//  2. if valid, maps it with one mmap() and rebuilds the TChannels from it (no text parsing);
+//     otherwise parses the file with TChannel::ReadCalFile() and writes a new snapshot;
+//  3. gives flat lookups for our own fill loops, without the TChannel map:
+//       gChannels.Number(address)   channel number (-1 if unknown)
+//       gChannels.Array(address)    TIGRESS crystal index (detector-1)*4 + crystal, -1 otherwise
+//       gChannels.Get(number)       ChannelRec (name, address, detector, crystal, segment, ...)
+// The snapshot keeps name, number, address, digitizer, time offset, integration and the ENG
+// coefficients (range 0). Channels with EFF/CFD/LED/TIME coefficients or more ENG terms are
+// flagged when the snapshot is written; the TChannels are then read from the text file as
+// before, and only the lookups come from the snapshot.
+#ifndef CHANNELTABLE_H
+#define CHANNELTABLE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <type_traits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "TChannel.h"
+#include "HistCache.h"   // HashBytes()
+
+struct ChannelRec{
+  uint32_t address;
+  int32_t  number;
+  char     name[32];
+  char     digitizer[16];
+  int16_t  detector;     // array position of the mnemonic (TIG05... = 5, SU01... = 1)
+  int16_t  crystal;      // B/G/R/W = 0~3 for TIGRESS
+  int16_t  segment;
+  int16_t  array;        // TIGRESS crystal index (detector-1)*4 + crystal, -1 otherwise
+  int32_t  integration;
+  int32_t  neng;
+  int64_t  timeoffset;
+  float    eng[6];
+};
+static_assert(std::is_trivially_copyable<ChannelRec>::value, "ChannelRec is written as raw bytes");
+
+class ChannelTable{
+public:
+  static constexpr int kMaxENG = 6;
+
+  // Set up the channels of calfile (TChannel + lookups); false if it holds no channel.
+  // A second call with the same file does nothing.
+  bool Load(const std::string &calfile){
+    if(fLoaded == calfile) return true;
+    std::ifstream infile(calfile, std::ios::binary);
+    if(!infile.is_open()){
+      std::cout << "Cannot open calibration file " << calfile << "!" << std::endl;
+      return false;
+    }
+    std::stringstream ss;
+    ss << infile.rdbuf();
+    std::string content = ss.str();
+    uint64_t hash = HashBytes(content.data(), content.size());
+
+    std::vector<std::string> paths = SnapshotPaths(calfile);
+    for(const std::string &p : paths){
+      if(!Map(p, hash, content.size())) continue;
+      if(fHeader->complete){
+        Restore();
+      }else if(TChannel::ReadCalFile(calfile.c_str()) < 1){
+        return false;
+      }
+      std::cout << "Channels: " << fNRec << " from snapshot " << p << std::endl;
+      fLoaded = calfile;
+      return true;
+    }
+
+    if(TChannel::ReadCalFile(calfile.c_str()) < 1) return false;
+    std::vector<char> buf = Build(hash, content.size());
+    for(const std::string &p : paths){
+      if(Save(p, buf)) break;
+    }
+    Use(std::move(buf));
+    fLoaded = calfile;
+    return fNRec > 0;
+  }
+
+  int Size() const { return fNRec; }
+
+  const ChannelRec *Find(uint32_t address) const {
+    if(fSlots.empty()) return nullptr;
+    for(size_t s = Slot(address);; s = (s+1) & fMask){
+      int32_t k = fSlots[s];
+      if(k < 0) return nullptr;
+      if(fRec[k].address == address) return &fRec[k];
+    }
+  }
+
+  int Number(uint32_t address) const {
+    const ChannelRec *r = Find(address);
+    return r ? r->number : -1;
+  }
+
+  int Array(uint32_t address) const {
+    const ChannelRec *r = Find(address);
+    return r ? r->array : -1;
+  }
+
+  const ChannelRec *Get(int number) const {
+    if(number < 0 || number >= (int)fByNumber.size() || fByNumber[number] < 0) return nullptr;
+    return &fRec[fByNumber[number]];
+  }
+
+private:
+  struct Header{
+    char     magic[8];     // "CHSNAP\0\0"
+    uint32_t version;
+    uint32_t nrec;
+    uint64_t srchash;
+    uint64_t srcsize;
+    uint32_t recsize;
+    uint32_t complete;     // 1: the TChannels can be rebuilt from the records alone
+  };
+  static constexpr uint32_t kVersion = 1;
+
+  static std::vector<std::string> SnapshotPaths(const std::string &calfile){
+    size_t slash = calfile.find_last_of('/');
+    std::string dir  = (slash == std::string::npos) ? "." : calfile.substr(0, slash);
+    std::string base = (slash == std::string::npos) ? calfile : calfile.substr(slash+1);
+    return {dir + "/." + base + ".chsnap", base + ".chsnap"};
+  }
+
+  // mmap the snapshot at path; false if missing or not made from this calibration file
+  bool Map(const std::string &path, uint64_t hash, size_t srcsize){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)){
+      close(fd);
+      return false;
+    }
+    void *m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(m == MAP_FAILED) return false;
+    const Header *h = (const Header *)m;
+    bool ok = memcmp(h->magic, "CHSNAP", 6) == 0 && h->version == kVersion
+           && h->recsize == sizeof(ChannelRec) && h->srchash == hash && h->srcsize == srcsize
+           && (size_t)st.st_size == sizeof(Header) + (size_t)h->nrec*sizeof(ChannelRec);
+    if(!ok){
+      munmap(m, st.st_size);
+      return false;
+    }
+    fHeader = h;            // mapped for the lifetime of the process
+    fRec  = (const ChannelRec *)((const char *)m + sizeof(Header));
+    fNRec = h->nrec;
+    Index();
+    return true;
+  }
+
+  // snapshot of the TChannels just read from the text file
+  std::vector<char> Build(uint64_t hash, size_t srcsize) const {
+    std::vector<ChannelRec> recs;
+    bool complete = true;
+    for(auto &it : *TChannel::GetChannelMap()){
+      TChannel *chan = it.second;
+      ChannelRec r;
+      memset(&r, 0, sizeof(r));
+      r.address = chan->GetAddress();
+      r.number  = chan->GetNumber();
+      strncpy(r.name, chan->GetName(), sizeof(r.name)-1);
+      if(chan->GetDigitizerTypeString()) strncpy(r.digitizer, chan->GetDigitizerTypeString(), sizeof(r.digitizer)-1);
+      r.detector = chan->GetDetectorNumber();
+      r.crystal  = chan->GetCrystalNumber();
+      r.segment  = chan->GetSegmentNumber();
+      r.array    = (strncmp(r.name, "TI", 2) == 0 && r.detector > 0) ? (r.detector-1)*4 + r.crystal : -1;
+      r.integration = chan->GetIntegration();
+      r.timeoffset  = chan->GetTimeOffset();
+      std::vector<Float_t> eng = chan->GetENGCoeff();
+      r.neng = std::min((int)eng.size(), kMaxENG);
+      std::copy(eng.begin(), eng.begin()+r.neng, r.eng);
+      if((int)eng.size() > kMaxENG || strlen(chan->GetName()) >= sizeof(r.name)
+         || !chan->GetEFFCoeff().empty() || !chan->GetCFDCoeff().empty()
+         || !chan->GetLEDCoeff().empty() || !chan->GetTIMECoeff().empty()) complete = false;
+      recs.push_back(r);
+    }
+    std::sort(recs.begin(), recs.end(), [](const ChannelRec &a, const ChannelRec &b){ return a.address < b.address; });
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "CHSNAP", 6);
+    h.version  = kVersion;
+    h.nrec     = recs.size();
+    h.srchash  = hash;
+    h.srcsize  = srcsize;
+    h.recsize  = sizeof(ChannelRec);
+    h.complete = complete ? 1 : 0;
+    std::vector<char> buf(sizeof(Header) + recs.size()*sizeof(ChannelRec));
+    memcpy(buf.data(), &h, sizeof(h));
+    if(!recs.empty()) memcpy(buf.data() + sizeof(Header), recs.data(), recs.size()*sizeof(ChannelRec));
+    return buf;
+  }
+
+  // written to a temporary file first, so parallel shards never map half a snapshot
+  static bool Save(const std::string &path, const std::vector<char> &buf){
+    std::string tmp = path + ".tmp" + std::to_string((long)getpid());
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if(!out) return false;
+    bool ok = fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+    ok = (fclose(out) == 0) && ok;
+    if(ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if(!ok) remove(tmp.c_str());
+    return ok;
+  }
+
+  void Use(std::vector<char> buf){
+    fOwn = std::move(buf);
+    fHeader = (const Header *)fOwn.data();
+    fRec  = (const ChannelRec *)(fOwn.data() + sizeof(Header));
+    fNRec = fHeader->nrec;
+    Index();
+  }
+
+  // TChannels from the records, instead of TChannel::ReadCalFile()
+  void Restore() const {
+    for(int i=0;i<fNRec;i++){
+      const ChannelRec &r = fRec[i];
+      TChannel *chan = new TChannel(r.name);
+      chan->SetAddress(r.address);
+      chan->SetNumber(TPriorityValue<int>(r.number, EPriority::kInputFile));
+      chan->SetDigitizerType(TPriorityValue<std::string>(r.digitizer, EPriority::kInputFile));
+      chan->SetIntegration(TPriorityValue<int>(r.integration, EPriority::kInputFile));
+      chan->SetTimeOffset(TPriorityValue<Long64_t>(r.timeoffset, EPriority::kInputFile));
+      chan->SetENGCoefficients(std::vector<Float_t>(r.eng, r.eng + r.neng));
+      TChannel::AddChannel(chan);
+    }
+  }
+
+  // open-addressing table address -> record, and number -> record
+  void Index(){
+    size_t n = 16;
+    while(n < 4*(size_t)fNRec) n *= 2;
+    fMask = n-1;
+    fSlots.assign(n, -1);
+    int maxnum = -1;
+    for(int i=0;i<fNRec;i++){
+      size_t s = Slot(fRec[i].address);
+      while(fSlots[s] >= 0) s = (s+1) & fMask;
+      fSlots[s] = i;
+      maxnum = std::max(maxnum, (int)fRec[i].number);
+    }
+    fByNumber.assign(maxnum+1, -1);
+    for(int i=0;i<fNRec;i++){
+      if(fRec[i].number >= 0) fByNumber[fRec[i].number] = i;
+    }
+  }
+
+  size_t Slot(uint32_t address) const { return (size_t)((address * 2654435761u) >> 7) & fMask; }
+
+  std::string fLoaded;
+  std::vector<char> fOwn;              // freshly built snapshot (otherwise the records are mmapped)
+  const Header *fHeader = nullptr;
+  const ChannelRec *fRec = nullptr;
+  int fNRec = 0;
+  std::vector<int32_t> fSlots;
+  size_t fMask = 0;
+  std::vector<int32_t> fByNumber;
+};
+
+inline ChannelTable gChannels;
+
+// ============================ LoadChannels() ========================================//
+// Replaces TChannel::ReadCalFile(calfile) in the programs: snapshot if possible, text otherwise.
+inline bool LoadChannels(const char *calfile){
+  if(!gChannels.Load(calfile)) {
+    std::cout << "No channels found in calibration file " << calfile << "!" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,46 @@
+// CompactEvent.h: events written by EventBuilder (Common/EventBuilder.cxx).
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// "EventTree" holds one entry per coincidence window, with plain branches (no GRSISort
+// classes needed to read it, TTree::Draw works directly):
+//   t0        Long64_t   time stamp of the first hit [ns]
+//   nhits     Int_t
+//   ch[nhits] Int_t      TChannel number
+//   q[nhits]  Float_t    raw charge (calibrate with TChannel or cal_pars.dat as usual)
+//   dt[nhits] Float_t    time of the hit - t0 [ns]
+//
+//   TChain chain("EventTree"); chain.Add("events.root");
+//   CompactEvent ev;
+//   ev.SetBranches(&chain);
+//   for(long i=0;i<chain.GetEntries();i++){ chain.GetEntry(i); ... ev.ch[j], ev.q[j] ... }
+#ifndef COMPACTEVENT_H
+#define COMPACTEVENT_H
+
+#include <TTree.h>
+
+struct CompactEvent{
+  static const int kMaxHits = 256;   // hits beyond this are dropped by EventBuilder
+  Long64_t t0 = 0;
+  Int_t nhits = 0;
+  Int_t ch[kMaxHits];
+  Float_t q[kMaxHits];
+  Float_t dt[kMaxHits];
+
+  void MakeBranches(TTree *tree){
+    tree->Branch("t0", &t0, "t0/L");
+    tree->Branch("nhits", &nhits, "nhits/I");
+    tree->Branch("ch", ch, "ch[nhits]/I");
+    tree->Branch("q", q, "q[nhits]/F");
+    tree->Branch("dt", dt, "dt[nhits]/F");
+  }
+
+  void SetBranches(TTree *tree){
+    tree->SetBranchAddress("t0", &t0);
+    tree->SetBranchAddress("nhits", &nhits);
+    tree->SetBranchAddress("ch", ch);
+    tree->SetBranchAddress("q", q);
+    tree->SetBranchAddress("dt", dt);
+  }
+};
+
+#endif
@@ -0,0 +1,369 @@
+// DriftTracker.h: time-sliced gain-drift tracking and on-the-fly correction.
+// Header only (C++17), include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// The calibrations assume one gain per channel for the whole run; a gain that drifts during
+// a long run broadens the summed peaks. In tracking mode (-drift <seconds>) the histogram
+// makers also fill, in the same pass, a compact spectrum per channel and time slice
+// (DriftTracker::Fill, hit time from GetTime()). DriftTracker::Solve() then finds the gain
+// of every slice relative to the full-run spectrum with a cross-correlation over a range of
+// scale factors (no fit): the scale s that best lines up slice(s*x) with reference(x),
+// refined with a parabola through the three best points. The table holds the correction
+// factor = 1/s per channel and slice:
+//   # CH  SLICE  T0(s)  T1(s)  COUNTS  FACTOR
+// With -driftcor <table> the table is loaded into gDriftCor and every charge is filled as
+// gDriftCor.Apply(ch, t, charge) = FACTOR(t) * charge, interpolated between slice centres.
+// CH is the index of the histogram: channel number for S3, array number for TIGRESS.
+//
+// Memory: every channel keeps its full-run spectrum and the slice being filled (2 x 1975 bins
+// of 4 bytes with the defaults, 17 MB for the 1100 S3 channels). Once a channel has moved on
+// to the next slice, the finished one keeps only the bins of the peak windows of the full-run
+// spectrum so far (see Pack()), as 16-bit counts. For triple-alpha S3 spectra with low-ADC
+// noise that is ~350 bins, so the 1100 S3 channels in 60-s slices take ~55 MB per hour of data
+// on top of the 17 MB (full spectra per slice were ~0.5 GB per hour); 64 TIGRESS crystals take
+// at most 15 MB per hour. Late hits of a finished slice outside its windows are dropped.
+#ifndef DRIFTTRACKER_H
+#define DRIFTTRACKER_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "HistCache.h"   // HashFile()
+
+// ============================ DriftTable ========================================//
+class DriftTable{
+public:
+  struct Slice{
+    int    slice;
+    double t0, t1;       // s
+    long   counts;
+    double factor;
+  };
+
+  bool Empty() const { return fNSlices == 0; }
+
+  // corrected charge of channel ch at time t (ns); charge unchanged for channels not in the table
+  double Apply(int ch, double t, double charge) const {
+    if(fNSlices == 0) return charge;
+    return Factor(ch, t) * charge;
+  }
+
+  double Factor(int ch, double t) const {
+    if(ch<0 || ch>=(int)fSlices.size() || fSlices[ch].empty()) return 1;
+    const std::vector<Slice> &v = fSlices[ch];
+    double ts = t*1e-9;
+    if(ts <= Centre(v.front())) return v.front().factor;
+    if(ts >= Centre(v.back()))  return v.back().factor;
+    auto hi = std::upper_bound(v.begin(), v.end(), ts, [](double x, const Slice &s){ return x < 0.5*(s.t0+s.t1); });
+    auto lo = hi - 1;
+    double w = (ts - Centre(*lo)) / (Centre(*hi) - Centre(*lo));
+    return lo->factor + w*(hi->factor - lo->factor);
+  }
+
+  void Add(int ch, const Slice &s){
+    if(ch<0) return;
+    if(ch >= (int)fSlices.size()) fSlices.resize(ch+1);
+    fSlices[ch].push_back(s);
+    fNSlices++;
+  }
+
+  const std::vector<Slice> &Channel(int ch) const {
+    static const std::vector<Slice> none;
+    return (ch>=0 && ch<(int)fSlices.size()) ? fSlices[ch] : none;
+  }
+  int NChannels() const { return fSlices.size(); }
+
+  bool Read(const std::string &filename){
+    std::ifstream infile(filename);
+    if(!infile.is_open()){
+      std::cout << "Cannot open drift table " << filename << "!" << std::endl;
+      return false;
+    }
+    fSlices.clear();
+    fNSlices = 0;
+    std::string line;
+    while(std::getline(infile, line)){
+      if(line.empty() || line[0] == '#') continue;
+      std::stringstream ss(line);
+      int ch;
+      Slice s;
+      if(ss >> ch >> s.slice >> s.t0 >> s.t1 >> s.counts >> s.factor) Add(ch, s);
+    }
+    for(auto &v : fSlices){
+      std::sort(v.begin(), v.end(), [](const Slice &a, const Slice &b){ return a.t0 < b.t0; });
+    }
+    fHash = HashFile(filename);
+    printf("Drift table %s: %i slices in %zu channels\n", filename.c_str(), fNSlices,
+           std::count_if(fSlices.begin(), fSlices.end(), [](const std::vector<Slice> &v){ return !v.empty(); }));
+    return fNSlices > 0;
+  }
+
+  bool Write(const std::string &filename, double slicelen) const {
+    FILE *out = fopen(filename.c_str(), "w");
+    if(!out){
+      printf("Cannot write %s\n", filename.c_str());
+      return false;
+    }
+    fprintf(out, "# Gain drift table (DriftTracker.h): corrected charge = FACTOR * charge, slices of %g s\n", slicelen);
+    fprintf(out, "#CH\tSLICE\tT0(s)\tT1(s)\tCOUNTS\tFACTOR\n");
+    for(size_t ch=0;ch<fSlices.size();ch++){
+      for(const Slice &s : fSlices[ch]){
+        fprintf(out, "%zu\t%d\t%.1f\t%.1f\t%ld\t%.6f\n", ch, s.slice, s.t0, s.t1, s.counts, s.factor);
+      }
+    }
+    fclose(out);
+    return true;
+  }
+
+  // histogram cache tag: histograms filled with a drift table are cached apart, per table
+  std::string Tag(const std::string &tag) const {
+    return fNSlices == 0 ? tag : tag + "_drift" + fHash;
+  }
+
+private:
+  static double Centre(const Slice &s){ return 0.5*(s.t0+s.t1); }
+
+  std::vector<std::vector<Slice>> fSlices;   // [ch], in time order
+  int fNSlices = 0;
+  std::string fHash;
+};
+
+inline DriftTable gDriftCor;   // correction applied by the fill loops (empty = none)
+
+// ============================ DriftTracker ========================================//
+class DriftTracker{
+public:
+  // slicelen: slice length (s); charges in [xmin, xmax) in bins of binw, coarser than the
+  // raw histograms (memory: see the top of the file)
+  DriftTracker(double slicelen, int nch, double xmin = 50, double xmax = 4000, double binw = 2)
+    : fSliceLen(slicelen), fXmin(xmin), fBinW(binw), fNBins((int)((xmax-xmin)/binw)), fChan(nch) {}
+
+  static constexpr int kMaxSlices = 10000;
+  static constexpr double kWindowMargin = 0.025;   // gain margin of the kept windows, >= maxdrift of Solve()
+
+  bool Enabled() const { return fSliceLen > 0; }
+  double SliceLength() const { return fSliceLen; }
+
+  // uncorrected charge of channel ch at time t (ns)
+  void Fill(int ch, double t, double charge){
+    if(ch<0 || ch>=(int)fChan.size()) return;
+    int bin = (int)((charge - fXmin)/fBinW);
+    if(charge < fXmin || bin >= fNBins) return;
+    double ts = t*1e-9/fSliceLen;
+    if(ts < 0 || ts >= kMaxSlices) return;
+    int slice = (int)ts;
+    Chan &c = fChan[ch];
+    if(c.full.empty()) c.full.assign(fNBins, 0);
+    c.full[bin]++;
+    if(slice > c.open){
+      if(c.open >= 0) Pack(c, c.slices[c.open]);   // the channel has moved on: keep its windows only
+      c.open = slice;
+    }
+    if((int)c.slices.size() <= slice) c.slices.resize(slice+1);
+    Slice &s = c.slices[slice];
+    if(slice == c.open){
+      if(s.dense.empty()) s.dense.assign(fNBins, 0);
+      s.dense[bin]++;
+      return;
+    }
+    // late hit of a finished slice
+    for(size_t r=0, off=0;r<s.ranges.size();off+=s.ranges[r].second-s.ranges[r].first, r++){
+      if(bin < s.ranges[r].first || bin >= s.ranges[r].second) continue;
+      uint16_t &n = s.packed[off + bin - s.ranges[r].first];
+      if(n < UINT16_MAX) n++;
+      return;
+    }
+  }
+
+  // Slice gains relative to the full run, see the top of the file.
+  // A drifting gain also broadens the full-run spectrum, which pulls the correlation maximum
+  // towards the edges of the drift; the reference is therefore rebuilt from the slices lined
+  // up with the previous estimate, niter times.
+  // maxdrift: largest relative gain change searched; mincounts: slices with fewer counts in the
+  // reference peak region are left out of the table (their factor is interpolated)
+  DriftTable Solve(double maxdrift = 0.02, long mincounts = 200, int niter = 3) const {
+    DriftTable table;
+    int nedge = 0;
+    for(size_t ch=0;ch<fChan.size();ch++){
+      const std::vector<std::vector<uint32_t>> v = Unpack(fChan[ch]);
+      if(v.empty()) continue;
+      int ns = v.size();
+      std::vector<double> scale(ns, 1.);
+      std::vector<long> counts(ns, 0);
+      std::vector<char> found(ns, 0);
+      for(int iter=0;iter<niter;iter++){
+        std::vector<double> ref(fNBins, 0);
+        for(int is=0;is<ns;is++){
+          if(v[is].empty()) continue;
+          for(int b=0;b<fNBins;b++) ref[b] += Interp(v[is], scale[is]*X(b));
+        }
+        int peak = std::max_element(ref.begin(), ref.end()) - ref.begin();
+        if(ref[peak] <= 0) break;
+        // correlate on the peaks only: bins above 2% of the highest one
+        std::vector<int> sel;
+        for(int b=0;b<fNBins;b++){
+          if(ref[b] > 0.02*ref[peak]) sel.push_back(b);
+        }
+        double step = 0.25*fBinW/X(peak);   // quarter of a bin at the highest peak
+        int nstep = (int)std::ceil(maxdrift/step);
+        std::vector<double> corr(2*nstep+1);
+        std::vector<double> own(sel.size());
+        for(int is=0;is<ns;is++){
+          const std::vector<uint32_t> &s = v[is];
+          found[is] = 0;
+          if(s.empty()) continue;
+          counts[is] = 0;
+          for(int b : sel) counts[is] += s[b];
+          if(counts[is] < mincounts) continue;
+          // reference without this slice, so a slice never lines up with itself
+          for(size_t j=0;j<sel.size();j++) own[j] = Interp(s, scale[is]*X(sel[j]));
+          for(int k=-nstep;k<=nstep;k++){
+            double sc = 1 + k*step;
+            double c = 0;
+            for(size_t j=0;j<sel.size();j++) c += (ref[sel[j]] - own[j]) * Interp(s, sc*X(sel[j]));
+            corr[k+nstep] = c;
+          }
+          int kbest = std::max_element(corr.begin(), corr.end()) - corr.begin();
+          if(kbest == 0 || kbest == 2*nstep) continue;   // drift beyond maxdrift (or no peak)
+          double c0 = corr[kbest-1], c1 = corr[kbest], c2 = corr[kbest+1];
+          double den = c0 - 2*c1 + c2;
+          double delta = (den < 0) ? 0.5*(c0 - c2)/den : 0;
+          scale[is] = 1 + (kbest - nstep + delta)*step;
+          found[is] = 1;
+        }
+      }
+      for(int is=0;is<ns;is++){
+        if(found[is]) table.Add(ch, {is, is*fSliceLen, (is+1)*fSliceLen, counts[is], 1./scale[is]});
+        else if(counts[is] >= mincounts) nedge++;
+      }
+    }
+    if(nedge>0) printf("%i slices with a drift beyond %.1f%% left out of the drift table\n", nedge, 100*maxdrift);
+    return table;
+  }
+
+private:
+  // dense while it is filled; then only the counts of the bin ranges [first, second)
+  struct Slice{
+    std::vector<uint32_t> dense;
+    std::vector<std::pair<int, int>> ranges;
+    std::vector<uint16_t> packed;   // counts of the ranges one after the other, saturated
+  };
+  struct Chan{
+    std::vector<uint32_t> full;     // full-run spectrum, sets the windows
+    std::vector<Slice> slices;
+    int open = -1;                  // slice being filled
+  };
+
+  // keep the bins of s within the peak windows of c.full: bins above 1% of its highest one
+  // (and above 2 counts, so that the single counts of the tails early in the run do not open
+  // windows), widened by kWindowMargin in gain
+  void Pack(const Chan &c, Slice &s) const {
+    if(s.dense.empty()) return;
+    double cut = std::max(0.01**std::max_element(c.full.begin(), c.full.end()), 2.);
+    std::vector<char> keep(fNBins, 0);
+    for(int b=0;b<fNBins;b++){
+      if(c.full[b] <= cut) continue;
+      int m = (int)std::ceil(kWindowMargin*X(b)/fBinW) + 1;
+      std::fill(keep.begin()+std::max(0, b-m), keep.begin()+std::min(fNBins, b+m+1), 1);
+    }
+    s.packed.reserve(std::count(keep.begin(), keep.end(), 1));
+    for(int b=0;b<fNBins;b++){
+      if(!keep[b]) continue;
+      int e = b;
+      while(e < fNBins && keep[e]){
+        s.packed.push_back((uint16_t)std::min<uint32_t>(s.dense[e], UINT16_MAX));
+        e++;
+      }
+      s.ranges.push_back({b, e});
+      b = e;
+    }
+    s.ranges.shrink_to_fit();
+    std::vector<uint32_t>().swap(s.dense);
+  }
+
+  // dense spectra of every slice of c (empty for slices without hits)
+  std::vector<std::vector<uint32_t>> Unpack(const Chan &c) const {
+    std::vector<std::vector<uint32_t>> v(c.slices.size());
+    for(size_t is=0;is<c.slices.size();is++){
+      const Slice &s = c.slices[is];
+      if(!s.dense.empty()){
+        v[is] = s.dense;
+        continue;
+      }
+      if(s.ranges.empty()) continue;
+      v[is].assign(fNBins, 0);
+      size_t off = 0;
+      for(const auto &r : s.ranges){
+        for(int b=r.first;b<r.second;b++) v[is][b] = s.packed[off++];
+      }
+    }
+    return v;
+  }
+
+  double X(int bin) const { return fXmin + (bin+0.5)*fBinW; }
+
+  // slice content at charge x, linear between bin centres
+  double Interp(const std::vector<uint32_t> &s, double x) const {
+    double u = (x - fXmin)/fBinW - 0.5;
+    int i = (int)std::floor(u);
+    if(i < 0 || i+1 >= fNBins) return 0;
+    double w = u - i;
+    return (1-w)*s[i] + w*s[i+1];
+  }
+
+  double fSliceLen;
+  double fXmin, fBinW;
+  int fNBins;
+  std::vector<Chan> fChan;   // [ch], spectra made on first hit
+};
+
+// ============================ Drift options ========================================//
+// Leading options of the histogram makers, after the ShardOptions ones:
+//   -drift <s>        track the gain drift in slices of <s> seconds, write the drift table
+//   -driftcor <file>  fill the charges corrected with this drift table (gDriftCor)
+struct DriftOptions{
+  double slice = 0;
+  std::string table;
+};
+
+// Strips the options from argc/argv like ParseShardOptions(); false if the table cannot be read
+inline bool ParseDriftOptions(int &argc, char **&argv, DriftOptions &opt){
+  int n = 1;
+  while(n+1 < argc && argv[n][0] == '-'){
+    if(strcmp(argv[n], "-drift") == 0)         opt.slice = atof(argv[n+1]);
+    else if(strcmp(argv[n], "-driftcor") == 0) opt.table = argv[n+1];
+    else break;
+    n += 2;
+  }
+  argv[n-1] = argv[0];
+  argv += n-1;
+  argc -= n-1;
+  return opt.table.empty() || gDriftCor.Read(opt.table);
+}
+
+// ============================ WriteDriftTable() ========================================//
+// Solve the drift of tracker, write the table and print the largest correction per channel
+inline void WriteDriftTable(const DriftTracker &tracker, const std::string &filename){
+  DriftTable table = tracker.Solve();
+  table.Write(filename, tracker.SliceLength());
+  int nch = 0;
+  for(int ch=0;ch<table.NChannels();ch++){
+    const std::vector<DriftTable::Slice> &v = table.Channel(ch);
+    if(v.empty()) continue;
+    double worst = 0;
+    for(const DriftTable::Slice &s : v) worst = std::max(worst, std::fabs(s.factor-1));
+    if(worst > 1e-3) printf("  CH %i: %zu slices, largest gain correction %.2f%%\n", ch, v.size(), 100*worst);
+    nch++;
+  }
+  printf("Drift table: %s (%i channels, %g-s slices)\n", filename.c_str(), nch, tracker.SliceLength());
+}
+
+#endif
@@ -0,0 +1,331 @@
+//g++ EventBuilder.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -O2 -pthread -Wl,--copy-dt-needed-entries `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -o EventBuilder
+
+// Lightweight event builder: FragmentTree subruns -> compact coincidence events (CompactEvent.h).
+// Only the hits of the kept detectors (eg S3 and TIGRESS) are used, and only channel number,
+// raw charge and time stamp are kept.
+//  1. every open subrun is read by its own thread into chunks of hits (bounded queue per file);
+//  2. each stream is put back in time order with a bounded reorder buffer (-depth hits), since
+//     fragments are only approximately time ordered inside a file;
+//  3. the streams are merged with a k-way heap merge on the time stamp;
+//  4. consecutive hits within -window ns of the first hit of the event form one event.
+// The subruns of a run follow each other in time, so only -open of them (default 4) are open
+// at once, in the order given (FindSubruns() order): the next one is opened, and read ahead,
+// as soon as one is drained and closed. Memory and threads are bounded by -open x (queue +
+// reorder buffer), independent of the run length and the number of subruns. Hits of a later
+// subrun that fall before hits already written are counted as out of order.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cstdlib>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TStopwatch.h>
+#include "TChannel.h"
+#include "TFragment.h"
+#include "InputIndex.h"
+#include "CompactEvent.h"
+#include "ChannelTable.h"
+
+// ============================ Hit ========================================//
+struct Hit{
+  Long64_t t;   // time stamp [ns]
+  int ch;
+  float q;
+};
+
+struct Later{
+  bool operator()(const Hit &a, const Hit &b) const { return a.t > b.t; }
+};
+
+// ============================ HitStream ========================================//
+// One FragmentTree file, read on its own thread, handed out in time order.
+class HitStream{
+public:
+  static const size_t kChunk = 4096;  // hits per chunk
+  static const size_t kQueue = 4;     // chunks waiting per file
+
+  HitStream(const std::string &file, const std::vector<std::string> &keep, size_t depth)
+    : fFile(file), fKeep(keep), fDepth(depth) {
+    fThread = std::thread(&HitStream::Run, this);
+  }
+
+  ~HitStream(){
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fStop = true;
+    }
+    fCV.notify_all();
+    fThread.join();
+  }
+
+  // Earliest hit still in the reorder buffer; false at the end of the file.
+  bool Head(Hit &hit){
+    while(fBuffer.size() < fDepth){
+      Hit h;
+      if(!NextRaw(h)) break;
+      fBuffer.push(h);
+    }
+    if(fBuffer.empty()) return false;
+    hit = fBuffer.top();
+    return true;
+  }
+
+  void Pop(){ fBuffer.pop(); }
+
+  long GetHits() const { return fNRead; }
+
+private:
+  // next hit in file order
+  bool NextRaw(Hit &hit){
+    if(fPos >= fCur.size()){
+      std::unique_lock<std::mutex> lock(fMutex);
+      fCV.wait(lock, [this]{ return !fChunks.empty() || fDone; });
+      if(fChunks.empty()) return false;
+      fCur = std::move(fChunks.front());
+      fChunks.pop_front();
+      fPos = 0;
+      lock.unlock();
+      fCV.notify_all();
+    }
+    hit = fCur[fPos++];
+    fNRead++;
+    return true;
+  }
+
+  bool Keep(TFragment *frag){
+    if(fKeep.empty()) return true;
+    unsigned int address = frag->GetAddress();
+    auto found = fKeepAddress.find(address);
+    if(found != fKeepAddress.end()) return found->second;
+    bool keep = false;
+    const ChannelRec *chan = gChannels.Find(address);
+    if(chan){
+      for(const auto &k : fKeep){
+        if(strncmp(chan->name, k.c_str(), k.size()) == 0) keep = true;
+      }
+    }
+    fKeepAddress[address] = keep;
+    return keep;
+  }
+
+  // blocks while kQueue chunks are waiting; false if the stream is being destroyed
+  bool Push(std::vector<Hit> &chunk){
+    std::unique_lock<std::mutex> lock(fMutex);
+    fCV.wait(lock, [this]{ return fChunks.size() < kQueue || fStop; });
+    if(fStop) return false;
+    fChunks.push_back(std::move(chunk));
+    lock.unlock();
+    fCV.notify_all();
+    chunk = std::vector<Hit>();
+    chunk.reserve(kChunk);
+    return true;
+  }
+
+  void Run(){
+    TFile *f = TFile::Open(fFile.c_str(), "read");
+    TTree *tree = (f && !f->IsZombie()) ? (TTree *)f->Get("FragmentTree") : nullptr;
+    if(tree && tree->FindBranch("TFragment")){
+      tree->SetBranchStatus("*", 0);
+      tree->SetBranchStatus("TFragment*", 1);
+      tree->SetCacheSize(4*1024*1024);
+      tree->AddBranchToCache("TFragment*", true);
+      TFragment *frag = nullptr;
+      tree->SetBranchAddress("TFragment", &frag);
+      std::vector<Hit> chunk;
+      chunk.reserve(kChunk);
+      long nentries = tree->GetEntries();
+      bool ok = true;
+      for(long i=0;i<nentries && ok;i++){
+        if(tree->GetEntry(i) <= 0 || !Keep(frag)) continue;
+        chunk.push_back({frag->GetTimeStampNs(), gChannels.Number(frag->GetAddress()), (float)frag->GetCharge()});
+        if(chunk.size() == kChunk) ok = Push(chunk);
+      }
+      if(ok && !chunk.empty()) Push(chunk);
+      tree->ResetBranchAddresses();
+      delete frag;
+    }else{
+      std::cerr << "No FragmentTree in " << fFile << std::endl;
+    }
+    delete f;
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fDone = true;
+    }
+    fCV.notify_all();
+  }
+
+  std::string fFile;
+  std::vector<std::string> fKeep;                 // channel name prefixes to keep
+  std::unordered_map<unsigned int, bool> fKeepAddress;
+  size_t fDepth;
+  std::priority_queue<Hit, std::vector<Hit>, Later> fBuffer;  // reorder buffer
+  std::vector<Hit> fCur;                          // chunk being read by Head()
+  size_t fPos = 0;
+  long fNRead = 0;
+  std::deque<std::vector<Hit>> fChunks;
+  bool fStop = false;
+  bool fDone = false;
+  std::mutex fMutex;
+  std::condition_variable fCV;
+  std::thread fThread;
+};
+
+// ============================ EventWriter ========================================//
+class EventWriter{
+public:
+  EventWriter(TTree *tree, Long64_t window) : fTree(tree), fWindow(window) {
+    fEvent.MakeBranches(fTree);
+  }
+
+  void Add(const Hit &hit){
+    if(fEvent.nhits>0 && hit.t - fEvent.t0 > fWindow) Flush();
+    if(hit.t < fLast) fNLate++;   // out of order by more than the reorder buffer
+    fLast = hit.t;
+    if(fEvent.nhits == 0) fEvent.t0 = hit.t;
+    if(fEvent.nhits == CompactEvent::kMaxHits){
+      fNDropped++;
+      return;
+    }
+    fEvent.ch[fEvent.nhits] = hit.ch;
+    fEvent.q[fEvent.nhits]  = hit.q;
+    fEvent.dt[fEvent.nhits] = hit.t - fEvent.t0;
+    fEvent.nhits++;
+  }
+
+  void Flush(){
+    if(fEvent.nhits == 0) return;
+    fTree->Fill();
+    fNEvents++;
+    fEvent.nhits = 0;
+  }
+
+  long fNEvents = 0;
+  long fNLate = 0;
+  long fNDropped = 0;
+
+private:
+  TTree *fTree;
+  Long64_t fWindow;
+  Long64_t fLast = 0;
+  CompactEvent fEvent;
+};
+
+
+// ====================================== main() ==========================================//
+// [-window ns]: coincidence window from the first hit of the event (default 2000 ns)
+// [-depth N]:   reorder buffer per subrun in hits (default 20000)
+// [-open N]:    subruns open (and read ahead) at the same time (default 4)
+// [-keep A,B]:  keep only channels whose name starts with A or B (eg TI,SU); default all
+// [-out file]:  output file (default events.root)
+// argv1: CalibrationFile (channel names)
+// argv2...: FragmentTree File Path
+int main(int argc, char **argv){
+  Long64_t window = 2000;
+  size_t depth = 20000;
+  size_t maxopen = 4;
+  std::vector<std::string> keep;
+  std::string outname = "events.root";
+  int iarg = 1;
+  while(iarg+1<argc && argv[iarg][0]=='-'){
+    std::string o = argv[iarg];
+    if(o=="-window")     window = atol(argv[iarg+1]);
+    else if(o=="-depth") depth  = atol(argv[iarg+1]);
+    else if(o=="-open")  maxopen = std::max(1L, atol(argv[iarg+1]));
+    else if(o=="-out")   outname = argv[iarg+1];
+    else if(o=="-keep"){
+      std::string list = argv[iarg+1];
+      size_t pos;
+      while((pos = list.find(',')) != std::string::npos){
+        keep.push_back(list.substr(0, pos));
+        list.erase(0, pos+1);
+      }
+      if(!list.empty()) keep.push_back(list);
+    }
+    else break;
+    iarg += 2;
+  }
+  if(argc-iarg<2){
+    printf("Input [-window ns] [-depth N] [-open N] [-keep TI,SU] [-out events.root] Calibration file and FragmentTree file paths\n");
+    return 1;
+  }
+  if(!LoadChannels(argv[iarg])) return 1;
+  std::vector<std::string> files;
+  for(int i=iarg+1;i<argc;i++) files.push_back(argv[i]);
+  InputIndex index("FragmentTree");
+  std::vector<long> counts = index.Count(files);
+  long ntotal = 0;
+  for(long n : counts) if(n>0) ntotal += n;
+
+  TStopwatch sw;
+  ROOT::EnableThreadSafety();
+
+  TFile *outfile = new TFile(outname.c_str(), "recreate");
+  TTree *tree = new TTree("EventTree", "compact S3/TIGRESS events");
+  EventWriter writer(tree, window);
+
+  // k-way merge: heap of (time of the head hit, stream), over at most maxopen open subruns
+  typedef std::pair<Long64_t, size_t> Head;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+  std::vector<HitStream *> streams(files.size(), nullptr);
+  size_t nopen = 0, next = 0;
+  Hit hit;
+  auto closeStream = [&](size_t s){
+    delete streams[s];
+    streams[s] = nullptr;
+    nopen--;
+  };
+  auto openStreams = [&](){
+    for(;next<files.size() && nopen<maxopen;next++){
+      if(counts[next] <= 0) continue;
+      streams[next] = new HitStream(files[next], keep, depth);
+      nopen++;
+      if(streams[next]->Head(hit)) heap.push({hit.t, next});
+      else closeStream(next);
+    }
+  };
+  openStreams();
+  Long64_t tfirst = -1, tlast = 0;
+  long nhits = 0;
+  while(!heap.empty()){
+    size_t s = heap.top().second;
+    heap.pop();
+    streams[s]->Head(hit);
+    streams[s]->Pop();
+    writer.Add(hit);
+    if(tfirst < 0) tfirst = hit.t;
+    tlast = hit.t;
+    if((++nhits % 1000000) == 0){
+      printf("Building events: %ld hits, %ld events \r", nhits, writer.fNEvents);
+      fflush(stdout);
+    }
+    if(streams[s]->Head(hit)) heap.push({hit.t, s});
+    else{
+      closeStream(s);   // drained: free its thread, file and buffers, open the next subrun
+      openStreams();
+    }
+  }
+  writer.Flush();
+
+  outfile->cd();
+  tree->Write();
+  outfile->Close();
+  sw.Stop();
+  double span = (tlast - tfirst)*1e-9;
+  printf("\nEvent building DONE! %ld fragments, %ld hits kept, %ld events -> %s\n",
+         ntotal, nhits, writer.fNEvents, outname.c_str());
+  printf("%.1f s for %.1f s of data (%.1fx real time), %ld hits out of order, %ld dropped (> %i hits)\n",
+         sw.RealTime(), span, sw.RealTime()>0 ? span/sw.RealTime() : 0., writer.fNLate,
+         writer.fNDropped, CompactEvent::kMaxHits);
+  return 0;
+}
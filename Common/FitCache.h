@@ -0,0 +1,188 @@
+// FitCache.h: per-channel cache of the FitAlphaHist() results, keyed by a hash of the inputs.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// A rerun of FitRawHist after a few more subruns, or a refit of one channel, used to refit
+// every channel. The cache file ($FIT_CACHE, default fit_cache.dat, "" = off) keeps the result
+// of every channel under a key made of
+//   bin contents (with under/overflow) | binning | pyramid level | seed option | kAlphaFitVersion
+// The fit range and tasf() options are found from these, so they are covered by the key.
+// A channel whose key is unchanged gets its saved result and fit function back (same
+// parameters, errors, chi2, range and options, so fit_hist.root is unchanged) without any fit;
+// every other channel is refitted and its entry replaced. Entries of channels that are not
+// fitted in this run are kept. AlphaFit::cached tells which results were reused.
+//   AlphaFitCache cache;
+//   AlphaFit fit = CachedFitAlphaHist(cache, hist, ch);
+//   cache.Write();
+#ifndef FITCACHE_H
+#define FITCACHE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cinttypes>
+#include <unistd.h>
+#include <TH1.h>
+#include <TF1.h>
+#include "CalibCore.h"
+
+class AlphaFitCache{
+public:
+  // filename: cache file; default from $FIT_CACHE ("fit_cache.dat" if unset, "" = disabled)
+  explicit AlphaFitCache(const std::string &filename = DefaultFile()) : fFile(filename) { Read(); }
+
+  static std::string DefaultFile(){
+    const char *env = getenv("FIT_CACHE");
+    return env ? env : "fit_cache.dat";
+  }
+
+  bool Enabled() const { return !fFile.empty(); }
+  void SetRefit(bool refit){ fRefit = refit; }   // true: every channel is refitted (and saved)
+
+  // hash of everything FitAlphaHist(hist, ch, level, seed) depends on
+  static uint64_t Key(TH1 *hist, int level, bool seed){
+    int nbins = hist->GetNbinsX();
+    std::vector<double> v;
+    v.reserve(nbins+7);
+    v.push_back(nbins);
+    v.push_back(hist->GetXaxis()->GetXmin());
+    v.push_back(hist->GetXaxis()->GetXmax());
+    for(int b=0;b<=nbins+1;b++) v.push_back(hist->GetBinContent(b));
+    v.push_back(level);
+    v.push_back(seed);
+    v.push_back(kAlphaFitVersion);
+    return HashBytes((const char *)v.data(), v.size()*sizeof(double));
+  }
+
+  // cached result of ch with this key, with its function rebuilt on hist; false if none
+  bool Get(int ch, uint64_t key, TH1 *hist, AlphaFit &fit) const {
+    if(!Enabled() || fRefit) return false;
+    auto it = fEntries.find(ch);
+    if(it == fEntries.end() || it->second.key != key) return false;
+    const Entry &e = it->second;
+    fit = AlphaFit();
+    fit.ch = ch;
+    fit.status = e.status;
+    fit.seconds = 0;
+    fit.cached = true;
+    if(e.opt == "-") return true;   // no fit function: less than 2 peaks found
+    fit.opt = e.opt;
+    hist->GetXaxis()->SetRange(e.first, e.last);
+    TF1 *fc = tasf(hist, Form("fc_CH%i",ch), 0, 1, e.opt.c_str());   // start values are overwritten
+    for(int ip=0;ip<9;ip++){
+      fc->SetParameter(ip, e.par[ip]);
+      fc->SetParError(ip, e.err[ip]);
+    }
+    fc->SetChisquare(e.chi2);
+    fc->SetNDF(e.ndf);
+    hist->GetListOfFunctions()->Add(fc->Clone());   // as hist->Fit() leaves a copy in hist
+    fit.fx = fc;
+    ReadAlphaPars(fit);
+    return true;
+  }
+
+  void Put(uint64_t key, TH1 *hist, const AlphaFit &fit){
+    if(!Enabled()) return;
+    Entry e;
+    e.key = key;
+    e.status = fit.status;
+    if(fit.fx){
+      e.opt = fit.opt;
+      e.first = hist->GetXaxis()->GetFirst();
+      e.last = hist->GetXaxis()->GetLast();
+      for(int ip=0;ip<9;ip++){
+        e.par[ip] = fit.fx->GetParameter(ip);
+        e.err[ip] = fit.fx->GetParError(ip);
+      }
+      e.chi2 = fit.fx->GetChisquare();
+      e.ndf = fit.fx->GetNDF();
+    }
+    fEntries[fit.ch] = e;
+    fChanged = true;
+  }
+
+  // written to a temporary file (per process) and renamed; nothing to do if no entry changed
+  bool Write() const {
+    if(!Enabled() || !fChanged) return true;
+    std::string tmp = fFile + ".tmp" + std::to_string((long)getpid());
+    FILE *out = fopen(tmp.c_str(), "w");
+    if(!out){
+      printf("Cannot write %s\n", tmp.c_str());
+      return false;
+    }
+    fprintf(out, "# FitCache v1: CH KEY STATUS OPT FIRST LAST CHI2 NDF PAR[0-8] ERR[0-8]\n");
+    for(const auto &it : fEntries){
+      const Entry &e = it.second;
+      fprintf(out, "%d %016" PRIx64 " %d %s %d %d %.17g %d", it.first, e.key, e.status, e.opt.c_str(),
+              e.first, e.last, e.chi2, e.ndf);
+      for(int ip=0;ip<9;ip++) fprintf(out, " %.17g", e.par[ip]);
+      for(int ip=0;ip<9;ip++) fprintf(out, " %.17g", e.err[ip]);
+      fprintf(out, "\n");
+    }
+    bool ok = fclose(out) == 0;
+    if(ok) ok = std::rename(tmp.c_str(), fFile.c_str()) == 0;
+    return ok;
+  }
+
+private:
+  struct Entry{
+    uint64_t key = 0;
+    int status = -1;
+    std::string opt = "-";   // tasf() options, "-" = no fit function
+    int first = 0;
+    int last = 0;
+    double chi2 = 0;
+    int ndf = 0;
+    double par[9] = {};
+    double err[9] = {};
+  };
+
+  void Read(){
+    if(!Enabled()) return;
+    FILE *in = fopen(fFile.c_str(), "r");
+    if(!in) return;
+    char line[2048];
+    while(fgets(line, sizeof(line), in)){
+      if(line[0] == '#') continue;
+      Entry e;
+      int ch, n;
+      char opt[8];
+      if(sscanf(line, "%d %" SCNx64 " %d %7s %d %d %lg %d%n", &ch, &e.key, &e.status, opt,
+                &e.first, &e.last, &e.chi2, &e.ndf, &n) != 8) continue;
+      e.opt = opt;
+      const char *p = line + n;
+      bool ok = true;
+      for(int ip=0;ip<18 && ok;ip++){
+        int m;
+        ok = sscanf(p, "%lg%n", ip<9 ? &e.par[ip] : &e.err[ip-9], &m) == 1;
+        p += m;
+      }
+      if(ok) fEntries[ch] = e;
+    }
+    fclose(in);
+  }
+
+  std::string fFile;
+  std::map<int, Entry> fEntries;
+  bool fRefit = false;
+  bool fChanged = false;
+};
+
+// ============================ CachedFitAlphaHist() ========================================//
+// FitAlphaHist(hist, ch, level, seed), or its cached result if hist and the options are unchanged
+inline AlphaFit CachedFitAlphaHist(AlphaFitCache &cache, TH1 *hist, int ch, int level=2, bool seed=true){
+  uint64_t key = AlphaFitCache::Key(hist, level, seed);
+  AlphaFit fit;
+  if(cache.Get(ch, key, hist, fit)){
+    gPerf.Count("fits_cached", 1);
+    return fit;
+  }
+  fit = FitAlphaHist(hist, ch, level, seed);
+  cache.Put(key, hist, fit);
+  gPerf.Count("fits_refitted", 1);
+  return fit;
+}
+
+#endif
@@ -0,0 +1,466 @@
+// GlobalAlphaFit.h: simultaneous triple-alpha fit of all the channels of one S3 detector.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// FitAlphaHist() fits every channel on its own, with its own Pu_n, Am_n (width of the Pu and
+// Am groups relative to Cm, set by the source thickness) and Pu/Am/Cm amplitudes. These are
+// properties of the source, the same for every channel, and poorly constrained in channels
+// with few counts. The global fit shares them:
+//   shared       Pu_n, Am_n, Pu/Cm and Am/Cm intensity ratios
+//   per channel  Cm amplitude, fwhmCm, bg, offset, gain
+// and maximizes the summed Poisson likelihood of all channels (Levenberg-Marquardt, Fisher
+// matrix). Every channel depends only on its own 5 parameters and the 4 shared ones, so the
+// matrix is a block arrow: one 5x5 block per channel, a 4x4 shared block and the 5x4
+// couplings. Each step eliminates the channel blocks (Schur complement), solves the 4x4
+// shared system and then every 5x5 channel system, so an iteration costs one pass over the
+// bins and N small solves, as for N separate fits, instead of a (5N+4)^2 matrix.
+// Errors come from the inverse Fisher matrix with the shared-parameter uncertainty included.
+//   std::vector<AlphaFit> fits = ...;                // FitAlphaHist() of every channel: start values
+//   GlobalAlphaPars g = GlobalAlphaFit(hists, fits); // hists[i] is the histogram of fits[i]
+// Only three-group fits (Pu/Am/Cm, not "d") take part; the others are left as they are.
+#ifndef GLOBALALPHAFIT_H
+#define GLOBALALPHAFIT_H
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <TH1.h>
+#include <TF1.h>
+#include "CalibCore.h"
+
+// ============================ GlobalAlphaPars ========================================//
+// Shared parameters of a global fit and their errors
+struct GlobalAlphaPars{
+  enum { kPuN, kAmN, kPuCm, kAmCm, kNShared };
+  double val[kNShared] = {1, 1, 1, 1};
+  double err[kNShared] = {0, 0, 0, 0};
+  int nch = 0;             // channels in the fit
+  int niter = 0;
+  bool converged = false;
+  double deviance = 0;     // -2 ln(likelihood ratio) summed over the channels
+  int ndf = 0;
+};
+
+class GlobalAlphaFitter{
+public:
+  enum { kAmp, kFwhm, kBg, kOffset, kGain, kNCh };   // per-channel parameters
+  enum { kNS = GlobalAlphaPars::kNShared };
+
+  // bins x (centres) and counts y of one channel, start values par[kNCh]; returns its index
+  int Add(std::vector<double> x, std::vector<double> y, const double *par){
+    Chan c;
+    c.x = std::move(x);
+    c.y = std::move(y);
+    std::copy(par, par+kNCh, c.p);
+    fChans.push_back(std::move(c));
+    return (int)fChans.size()-1;
+  }
+
+  void SetShared(const double *s){ std::copy(s, s+kNS, fS); }
+  const double *Shared() const { return fS; }
+  const double *SharedErr() const { return fSErr; }
+  const double *Par(int i) const { return fChans[i].p; }
+  const double *ParErr(int i) const { return fChans[i].err; }
+  double Deviance(int i) const { return fChans[i].dev; }
+  int NBins(int i) const { return (int)fChans[i].x.size(); }
+  int NChannels() const { return (int)fChans.size(); }
+
+  // Levenberg-Marquardt iterations until the deviance changes by less than tol; true if converged
+  bool Fit(int maxiter = 100, double tol = 1e-7){
+    fNIter = 0;
+    double lambda = 1e-3;
+    double dev = TotalDeviance(fS, false);
+    bool converged = false;
+    while(fNIter < maxiter && !converged){
+      fNIter++;
+      Accumulate();
+      bool accepted = false;
+      for(int itry=0;itry<12 && !accepted;itry++){
+        double snew[kNS];
+        if(!Step(lambda, snew)){
+          lambda *= 10;
+          continue;
+        }
+        double devnew = TotalDeviance(snew, true);
+        if(devnew <= dev){
+          for(Chan &c : fChans) std::copy(c.pnew, c.pnew+kNCh, c.p);
+          std::copy(snew, snew+kNS, fS);
+          converged = (dev - devnew) < tol*(1 + devnew);
+          dev = devnew;
+          lambda = std::max(lambda/10, 1e-9);
+          accepted = true;
+        }else{
+          lambda *= 10;
+        }
+      }
+      if(!accepted) converged = true;   // no step lowers the deviance: at the minimum within precision
+    }
+    fDev = TotalDeviance(fS, false);
+    Accumulate();
+    Errors();
+    return converged;
+  }
+
+  int NIter() const { return fNIter; }
+  double TotalDeviance() const { return fDev; }
+
+private:
+  struct Chan{
+    std::vector<double> x, y;
+    double p[kNCh] = {};
+    double pnew[kNCh] = {};
+    double err[kNCh] = {};
+    double dev = 0;
+    // Fisher blocks and gradient at p
+    double hcc[kNCh][kNCh] = {};
+    double hcs[kNCh][kNS] = {};
+    double gc[kNCh] = {};
+  };
+  struct Block{ double l[kNCh][kNCh]; };
+
+  // lines of TripleAlphaHighE_Fun(): energy, intensity within the group
+  struct Line{ double e, w; };
+  static const std::vector<Line> &Group(int g){
+    static const std::vector<Line> pu = {{5156.59, 0.7077}, {5144.30, 0.1711}, {5105.80, 0.1194}};
+    static const std::vector<Line> am = {{5544.5, 0.0036}, {5388, 0.0166}, {5485.56, 0.848}, {5442.8, 0.131}};
+    static const std::vector<Line> cm = {{5804.77, 0.769}, {5762.16, 0.231}};
+    return g==0 ? pu : (g==1 ? am : cm);
+  }
+
+  // model at x, and its derivatives dc (channel) and ds (shared) if dc != nullptr
+  static double Eval(const double *p, const double *s, double x, double *dc, double *ds){
+    double E = p[kOffset] + p[kGain]*x;
+    double sCm = p[kFwhm]/2.35;
+    double sig[3] = {sCm*s[GlobalAlphaPars::kPuN], sCm*s[GlobalAlphaPars::kAmN], sCm};
+    double S[3] = {0, 0, 0}, D[3] = {0, 0, 0}, W[3] = {0, 0, 0};
+    for(int g=0;g<3;g++){
+      for(const Line &l : Group(g)){
+        double u = (E - l.e)/sig[g];
+        if(fabs(u) > 10) continue;
+        double G = l.w * exp(-0.5*u*u);
+        S[g] += G;
+        D[g] -= G*u/sig[g];        // dG/dE
+        W[g] += G*u*u/sig[g];      // dG/dsigma
+      }
+    }
+    double rPu = s[GlobalAlphaPars::kPuCm], rAm = s[GlobalAlphaPars::kAmCm], A = p[kAmp];
+    double peaks = rPu*S[0] + rAm*S[1] + S[2];
+    if(dc){
+      dc[kAmp]    = peaks;
+      dc[kFwhm]   = A*(rPu*W[0]*s[GlobalAlphaPars::kPuN] + rAm*W[1]*s[GlobalAlphaPars::kAmN] + W[2])/2.35;
+      dc[kBg]     = 1;
+      dc[kOffset] = A*(rPu*D[0] + rAm*D[1] + D[2]);
+      dc[kGain]   = x*dc[kOffset];
+      ds[GlobalAlphaPars::kPuN]  = A*rPu*W[0]*sCm;
+      ds[GlobalAlphaPars::kAmN]  = A*rAm*W[1]*sCm;
+      ds[GlobalAlphaPars::kPuCm] = A*S[0];
+      ds[GlobalAlphaPars::kAmCm] = A*S[1];
+    }
+    return A*peaks + p[kBg];
+  }
+
+  static double BinDeviance(double y, double mu){
+    mu = std::max(mu, 1e-12);
+    return 2*(mu - y + (y > 0 ? y*log(y/mu) : 0));
+  }
+
+  // summed deviance with the shared parameters s and p (trial: pnew) of every channel
+  double TotalDeviance(const double *s, bool trial){
+    double dev = 0;
+    for(Chan &c : fChans){
+      const double *p = trial ? c.pnew : c.p;
+      double d = 0;
+      for(size_t k=0;k<c.x.size();k++) d += BinDeviance(c.y[k], Eval(p, s, c.x[k], nullptr, nullptr));
+      if(!trial) c.dev = d;
+      dev += d;
+    }
+    return dev;
+  }
+
+  // Fisher blocks and gradient of ln(L) at the current parameters
+  void Accumulate(){
+    for(int a=0;a<kNS;a++){
+      fGs[a] = 0;
+      for(int b=0;b<kNS;b++) fHss[a][b] = 0;
+    }
+    for(Chan &c : fChans){
+      for(int a=0;a<kNCh;a++){
+        c.gc[a] = 0;
+        for(int b=0;b<kNCh;b++) c.hcc[a][b] = 0;
+        for(int b=0;b<kNS;b++) c.hcs[a][b] = 0;
+      }
+      for(size_t k=0;k<c.x.size();k++){
+        double dc[kNCh], ds[kNS];
+        double mu = std::max(Eval(c.p, fS, c.x[k], dc, ds), 1e-12);
+        double w = 1/mu, r = c.y[k]/mu - 1;
+        for(int a=0;a<kNCh;a++){
+          c.gc[a] += r*dc[a];
+          for(int b=0;b<kNCh;b++) c.hcc[a][b] += w*dc[a]*dc[b];
+          for(int b=0;b<kNS;b++) c.hcs[a][b] += w*dc[a]*ds[b];
+        }
+        for(int a=0;a<kNS;a++){
+          fGs[a] += r*ds[a];
+          for(int b=0;b<kNS;b++) fHss[a][b] += w*ds[a]*ds[b];
+        }
+      }
+    }
+  }
+
+  // Cholesky factor of the n x n matrix a (lower triangle, in place); false if not positive
+  template<int N>
+  static bool Cholesky(double (&a)[N][N]){
+    for(int j=0;j<N;j++){
+      double d = a[j][j];
+      for(int k=0;k<j;k++) d -= a[j][k]*a[j][k];
+      if(!(d > 0)) return false;
+      a[j][j] = sqrt(d);
+      for(int i=j+1;i<N;i++){
+        double v = a[i][j];
+        for(int k=0;k<j;k++) v -= a[i][k]*a[j][k];
+        a[i][j] = v/a[j][j];
+      }
+    }
+    return true;
+  }
+  template<int N>
+  static void CholSolve(const double (&l)[N][N], double *b){
+    for(int i=0;i<N;i++){
+      for(int k=0;k<i;k++) b[i] -= l[i][k]*b[k];
+      b[i] /= l[i][i];
+    }
+    for(int i=N-1;i>=0;i--){
+      for(int k=i+1;k<N;k++) b[i] -= l[k][i]*b[k];
+      b[i] /= l[i][i];
+    }
+  }
+
+  // damped channel block, factorized
+  static bool ChannelFactor(const Chan &c, double lambda, double (&l)[kNCh][kNCh]){
+    for(int a=0;a<kNCh;a++) for(int b=0;b<kNCh;b++) l[a][b] = c.hcc[a][b];
+    for(int a=0;a<kNCh;a++) l[a][a] = l[a][a]*(1 + lambda) + 1e-12;
+    return Cholesky(l);
+  }
+
+  // one damped step: eliminate the channel blocks, solve the shared system, back-substitute
+  bool Step(double lambda, double *snew){
+    double S[kNS][kNS], r[kNS];
+    for(int a=0;a<kNS;a++){
+      r[a] = fGs[a];
+      for(int b=0;b<kNS;b++) S[a][b] = fHss[a][b];
+      S[a][a] = S[a][a]*(1 + lambda) + 1e-12;
+    }
+    fFactors.resize(fChans.size());
+    for(size_t i=0;i<fChans.size();i++){
+      Chan &c = fChans[i];
+      if(!ChannelFactor(c, lambda, fFactors[i].l)) return false;
+      // X = Hcc^-1 [Hcs | gc]
+      double X[kNS+1][kNCh];
+      for(int b=0;b<=kNS;b++){
+        for(int a=0;a<kNCh;a++) X[b][a] = (b < kNS) ? c.hcs[a][b] : c.gc[a];
+        CholSolve(fFactors[i].l, X[b]);
+      }
+      for(int a=0;a<kNS;a++){
+        for(int k=0;k<kNCh;k++){
+          r[a] -= c.hcs[k][a]*X[kNS][k];
+          for(int b=0;b<kNS;b++) S[a][b] -= c.hcs[k][a]*X[b][k];
+        }
+      }
+    }
+    if(!Cholesky(S)) return false;
+    CholSolve(S, r);
+    for(int a=0;a<kNS;a++) snew[a] = fS[a] + r[a];
+    ClampShared(snew);
+    for(size_t i=0;i<fChans.size();i++){
+      Chan &c = fChans[i];
+      double d[kNCh];
+      for(int a=0;a<kNCh;a++){
+        d[a] = c.gc[a];
+        for(int b=0;b<kNS;b++) d[a] -= c.hcs[a][b]*r[b];
+      }
+      CholSolve(fFactors[i].l, d);
+      for(int a=0;a<kNCh;a++) c.pnew[a] = c.p[a] + d[a];
+      ClampChannel(c.pnew);
+    }
+    return true;
+  }
+
+  // limits of tasf()
+  static void ClampShared(double *s){
+    s[GlobalAlphaPars::kPuN]  = std::min(1.5, std::max(0.5, s[GlobalAlphaPars::kPuN]));
+    s[GlobalAlphaPars::kAmN]  = std::min(1.5, std::max(0.5, s[GlobalAlphaPars::kAmN]));
+    s[GlobalAlphaPars::kPuCm] = std::max(0., s[GlobalAlphaPars::kPuCm]);
+    s[GlobalAlphaPars::kAmCm] = std::max(0., s[GlobalAlphaPars::kAmCm]);
+  }
+  static void ClampChannel(double *p){
+    p[kAmp]  = std::max(0., p[kAmp]);
+    p[kFwhm] = std::min(500., std::max(20., p[kFwhm]));
+    p[kBg]   = std::max(0., p[kBg]);
+    p[kGain] = std::max(1e-3, p[kGain]);
+  }
+
+  // diagonal of the inverse Fisher matrix: shared block S^-1, channel blocks
+  // Hcc^-1 + X S^-1 X^T with X = Hcc^-1 Hcs
+  void Errors(){
+    double S[kNS][kNS];
+    for(int a=0;a<kNS;a++) for(int b=0;b<kNS;b++) S[a][b] = fHss[a][b];
+    for(int a=0;a<kNS;a++) S[a][a] += 1e-12;
+    std::vector<std::array<std::array<double, kNCh>, kNS>> Xs(fChans.size());
+    std::vector<char> good(fChans.size(), 0);
+    fFactors.resize(fChans.size());
+    for(size_t i=0;i<fChans.size();i++){
+      Chan &c = fChans[i];
+      if(!ChannelFactor(c, 0, fFactors[i].l)) continue;
+      good[i] = 1;
+      for(int b=0;b<kNS;b++){
+        double col[kNCh];
+        for(int a=0;a<kNCh;a++) col[a] = c.hcs[a][b];
+        CholSolve(fFactors[i].l, col);
+        for(int a=0;a<kNCh;a++) Xs[i][b][a] = col[a];
+        for(int a=0;a<kNS;a++) for(int k=0;k<kNCh;k++) S[a][b] -= c.hcs[k][a]*col[k];
+      }
+    }
+    double Sinv[kNS][kNS];
+    bool sok = Cholesky(S);
+    for(int b=0;b<kNS;b++){
+      double e[kNS] = {0, 0, 0, 0};
+      e[b] = 1;
+      if(sok) CholSolve(S, e);
+      for(int a=0;a<kNS;a++) Sinv[a][b] = sok ? e[a] : 0;
+    }
+    for(int a=0;a<kNS;a++) fSErr[a] = sqrt(std::max(0., Sinv[a][a]));
+    for(size_t i=0;i<fChans.size();i++){
+      Chan &c = fChans[i];
+      for(int a=0;a<kNCh;a++) c.err[a] = 0;
+      if(!good[i]) continue;
+      for(int a=0;a<kNCh;a++){
+        double e[kNCh] = {0, 0, 0, 0, 0};
+        e[a] = 1;
+        CholSolve(fFactors[i].l, e);
+        double v = e[a];
+        for(int p=0;p<kNS;p++) for(int q=0;q<kNS;q++) v += Xs[i][p][a]*Sinv[p][q]*Xs[i][q][a];
+        c.err[a] = sqrt(std::max(0., v));
+      }
+    }
+  }
+
+  std::vector<Chan> fChans;
+  std::vector<Block> fFactors;   // damped channel blocks, factorized
+  double fS[kNS] = {1, 1, 1, 1};
+  double fSErr[kNS] = {0, 0, 0, 0};
+  double fHss[kNS][kNS];
+  double fGs[kNS];
+  double fDev = 0;
+  int fNIter = 0;
+};
+
+// ============================ GlobalAlphaFit() ========================================//
+// Refit the three-group channels of fits together with shared Pu_n, Am_n, Pu/Cm and Am/Cm,
+// starting from their FitAlphaHist() results and fit ranges. hists[i] is the histogram of
+// fits[i]. fits and their fx are updated (status 0 = converged, 1 = not converged); the
+// shared parameters are the medians of the separate fits to start with.
+inline GlobalAlphaPars GlobalAlphaFit(const std::vector<TH1 *> &hists, std::vector<AlphaFit> &fits,
+                                      int maxiter = 100){
+  GlobalAlphaPars g;
+  GlobalAlphaFitter fitter;
+  std::vector<size_t> idx;
+  std::vector<double> start[GlobalAlphaPars::kNShared];
+  for(size_t i=0;i<fits.size() && i<hists.size();i++){
+    TF1 *fx = fits[i].fx;
+    TH1 *h = hists[i];
+    if(!fx || !h || fits[i].status != 0) continue;
+    if(fx->GetParameter(0) <= 0 || fx->GetParameter(2) <= 0) continue;   // "d" (no Pu) or empty Cm
+    std::vector<double> x, y;
+    int first = std::max(1, h->FindBin(fx->GetXmin()));
+    int last  = std::min(h->GetNbinsX(), h->FindBin(fx->GetXmax()));
+    for(int b=first;b<=last;b++){
+      x.push_back(h->GetBinCenter(b));
+      y.push_back(h->GetBinContent(b));
+    }
+    if(x.size() < 20) continue;
+    double par[GlobalAlphaFitter::kNCh];
+    par[GlobalAlphaFitter::kAmp]    = fx->GetParameter(2);
+    par[GlobalAlphaFitter::kFwhm]   = fx->GetParameter(3);
+    par[GlobalAlphaFitter::kBg]     = fx->GetParameter(4);
+    par[GlobalAlphaFitter::kOffset] = fx->GetParameter(7);
+    par[GlobalAlphaFitter::kGain]   = fx->GetParameter(8);
+    fitter.Add(std::move(x), std::move(y), par);
+    idx.push_back(i);
+    start[GlobalAlphaPars::kPuN].push_back(fx->GetParameter(5));
+    start[GlobalAlphaPars::kAmN].push_back(fx->GetParameter(6));
+    start[GlobalAlphaPars::kPuCm].push_back(fx->GetParameter(0)/fx->GetParameter(2));
+    start[GlobalAlphaPars::kAmCm].push_back(fx->GetParameter(1)/fx->GetParameter(2));
+  }
+  g.nch = (int)idx.size();
+  if(g.nch == 0) return g;
+  double s0[GlobalAlphaPars::kNShared];
+  for(int a=0;a<GlobalAlphaPars::kNShared;a++){
+    std::vector<double> &v = start[a];
+    std::nth_element(v.begin(), v.begin()+v.size()/2, v.end());
+    s0[a] = v[v.size()/2];
+  }
+  fitter.SetShared(s0);
+
+  PerfTimer timer("global_fit");
+  g.converged = fitter.Fit(maxiter);
+  g.niter = fitter.NIter();
+  g.deviance = fitter.TotalDeviance();
+  const double *s = fitter.Shared();
+  for(int a=0;a<GlobalAlphaPars::kNShared;a++){
+    g.val[a] = s[a];
+    g.err[a] = fitter.SharedErr()[a];
+  }
+  g.ndf = -GlobalAlphaPars::kNShared;
+  for(int k=0;k<g.nch;k++){
+    AlphaFit &f = fits[idx[k]];
+    const double *p = fitter.Par(k);
+    const double *e = fitter.ParErr(k);
+    TF1 *fx = f.fx;
+    fx->SetParameter(0, p[GlobalAlphaFitter::kAmp]*s[GlobalAlphaPars::kPuCm]);
+    fx->SetParameter(1, p[GlobalAlphaFitter::kAmp]*s[GlobalAlphaPars::kAmCm]);
+    fx->SetParameter(2, p[GlobalAlphaFitter::kAmp]);
+    fx->SetParameter(3, p[GlobalAlphaFitter::kFwhm]);
+    fx->SetParameter(4, p[GlobalAlphaFitter::kBg]);
+    fx->SetParameter(5, s[GlobalAlphaPars::kPuN]);
+    fx->SetParameter(6, s[GlobalAlphaPars::kAmN]);
+    fx->SetParameter(7, p[GlobalAlphaFitter::kOffset]);
+    fx->SetParameter(8, p[GlobalAlphaFitter::kGain]);
+    // Pu and Am amplitudes = Cm amplitude * shared ratio (correlation of the two neglected)
+    double A = p[GlobalAlphaFitter::kAmp], eA = e[GlobalAlphaFitter::kAmp];
+    fx->SetParError(0, hypot(eA*s[GlobalAlphaPars::kPuCm], A*g.err[GlobalAlphaPars::kPuCm]));
+    fx->SetParError(1, hypot(eA*s[GlobalAlphaPars::kAmCm], A*g.err[GlobalAlphaPars::kAmCm]));
+    fx->SetParError(2, eA);
+    fx->SetParError(3, e[GlobalAlphaFitter::kFwhm]);
+    fx->SetParError(4, e[GlobalAlphaFitter::kBg]);
+    fx->SetParError(5, g.err[GlobalAlphaPars::kPuN]);
+    fx->SetParError(6, g.err[GlobalAlphaPars::kAmN]);
+    fx->SetParError(7, e[GlobalAlphaFitter::kOffset]);
+    fx->SetParError(8, e[GlobalAlphaFitter::kGain]);
+    int ndf = fitter.NBins(k) - GlobalAlphaFitter::kNCh;
+    fx->SetChisquare(fitter.Deviance(k));
+    fx->SetNDF(ndf);
+    f.gain      = p[GlobalAlphaFitter::kGain];
+    f.offset    = p[GlobalAlphaFitter::kOffset];
+    f.fwhmCm    = p[GlobalAlphaFitter::kFwhm];
+    f.fwhmAm    = f.fwhmCm * s[GlobalAlphaPars::kAmN];
+    f.fwhmPu    = f.fwhmCm * s[GlobalAlphaPars::kPuN];
+    f.gainErr   = e[GlobalAlphaFitter::kGain];
+    f.offsetErr = e[GlobalAlphaFitter::kOffset];
+    f.fwhmCmErr = e[GlobalAlphaFitter::kFwhm];
+    f.chi2ndf   = ndf>0 ? fitter.Deviance(k)/ndf : 0;
+    f.status    = g.converged ? 0 : 1;
+    g.ndf += ndf;
+  }
+  gPerf.Count("global_fit_channels", g.nch);
+  return g;
+}
+
+// "Pu_n=... Am_n=... Pu/Cm=... Am/Cm=..." with errors, for the screen and Res_Check.dat
+inline std::string FormatGlobalAlphaPars(const GlobalAlphaPars &g){
+  return Form("global fit of %i channels: Pu_n=%.4f(%.4f) Am_n=%.4f(%.4f) Pu/Cm=%.4f(%.4f) Am/Cm=%.4f(%.4f) "
+              "deviance/ndf=%.3f iterations=%i%s",
+              g.nch, g.val[0], g.err[0], g.val[1], g.err[1], g.val[2], g.err[2], g.val[3], g.err[3],
+              g.ndf>0 ? g.deviance/g.ndf : 0., g.niter, g.converged ? "" : " (not converged)");
+}
+
+#endif
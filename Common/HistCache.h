@@ -0,0 +1,260 @@
+// HistCache.h: per-input-file cache of partial histograms.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// Every AnalysisTree file is filled into its own set of partial histograms, saved as
+// <dir>/<tag>_<hash of path>.root together with a key made of
+//   full path | file size | mtime | hash of the calibration file | kHistFillVersion.
+// The binning of every saved partial must also match the histogram it is added to.
+// Next time the same file comes in with the same key, the saved partials are added to the
+// totals instead of reading the tree again. A new subrun only costs its own fill, and a
+// changed file (or calibration file) only invalidates its own entry.
+#ifndef HISTCACHE_H
+#define HISTCACHE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TH1.h>
+#include <TNamed.h>
+#include <TKey.h>
+
+// ============================ FNV-1a hash ========================================//
+inline uint64_t HashBytes(const char *data, size_t n, uint64_t h = 14695981039346656037ULL){
+  for(size_t i=0;i<n;i++){
+    h ^= (unsigned char)data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+inline std::string HashHex(uint64_t h){
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+  return buf;
+}
+
+// Hash of the whole content of a (text) file, "none" if it cannot be read.
+inline std::string HashFile(const std::string &filename){
+  std::ifstream infile(filename, std::ios::binary);
+  if(!infile.is_open()) return "none";
+  std::stringstream ss;
+  ss << infile.rdbuf();
+  std::string content = ss.str();
+  return HashHex(HashBytes(content.data(), content.size()));
+}
+
+// Version of the fill code (FillS3Hist(), FillTigressHist(), FillFragHist(), the channel
+// lookups...). Part of every cache key: increase it with any change that changes the filled
+// histograms, so the entries made by the old code are filled again.
+constexpr int kHistFillVersion = 2;
+
+// ============================ HistCache ========================================//
+class HistCache{
+public:
+  // tag: name of the histogram set (programs filling identical histograms can share one tag)
+  // calfile: calibration file used while filling; its content is part of every key
+  HistCache(const std::string &tag, const std::string &calfile, const std::string &dir = "hist_cache")
+    : fTag(tag), fDir(dir), fCalHash(HashFile(calfile)) {
+    mkdir(fDir.c_str(), 0755);
+  }
+
+  // Key of an input file, empty if the file cannot be stat'ed (eg remote file: never cached).
+  std::string Key(const std::string &file) const {
+    struct stat st;
+    if(stat(file.c_str(), &st) != 0) return "";
+    return FullPath(file) + "|" + std::to_string((long long)st.st_size) + "|"
+         + std::to_string((long long)st.st_mtime) + "|" + fCalHash + "|v" + std::to_string(kHistFillVersion);
+  }
+
+  std::string CachePath(const std::string &file) const {
+    std::string path = FullPath(file);
+    return fDir + "/" + fTag + "_" + HashHex(HashBytes(path.data(), path.size())) + ".root";
+  }
+
+  // Add the cached partials of file into hists (matched by name). False if there is no valid
+  // entry, or if a partial has another binning than its histogram (then nothing is added).
+  bool Load(const std::string &file, const std::vector<TH1 *> &hists) const {
+    std::string key = Key(file);
+    if(key.empty()) return false;
+    std::string cpath = CachePath(file);
+    struct stat st;
+    if(stat(cpath.c_str(), &st) != 0) return false;
+    TFile *cf = TFile::Open(cpath.c_str(), "read");
+    if(!cf || cf->IsZombie()){
+      delete cf;
+      return false;
+    }
+    TNamed *saved = (TNamed *)cf->Get("cache_key");
+    if(!saved || key != saved->GetTitle()){
+      cf->Close();
+      delete cf;
+      return false;
+    }
+    std::map<std::string, TH1 *> byname;
+    for(TH1 *h : hists) byname[h->GetName()] = h;
+    std::vector<std::pair<TH1 *, TH1 *>> adds;   // (histogram, partial)
+    bool same = true;
+    for(TObject *obj : *cf->GetListOfKeys()){
+      TKey *k = (TKey *)obj;
+      auto found = byname.find(k->GetName());
+      if(found == byname.end()) continue;
+      TH1 *part = (TH1 *)k->ReadObj();
+      adds.push_back({found->second, part});
+      if(!SameBinning(found->second, part)){
+        same = false;
+        break;
+      }
+    }
+    for(auto &a : adds){
+      if(same) a.first->Add(a.second);
+      delete a.second;
+    }
+    cf->Close();
+    delete cf;
+    return same;
+  }
+
+  // Save the partials of file (non-empty histograms only). Written to a temporary file and
+  // renamed, so an interrupted or parallel run never leaves a half-written entry.
+  void Save(const std::string &file, const std::vector<TH1 *> &parts) const {
+    std::string key = Key(file);
+    if(key.empty()) return;
+    std::string cpath = CachePath(file);
+    std::string tmp   = cpath + ".tmp" + std::to_string((long)getpid());
+    TFile *cf = new TFile(tmp.c_str(), "recreate");
+    if(cf->IsZombie()){
+      delete cf;
+      return;
+    }
+    cf->cd();
+    TNamed("cache_key", key.c_str()).Write();
+    for(TH1 *h : parts){
+      if(h->GetEntries()>0) h->Write();
+    }
+    cf->Close();
+    delete cf;
+    std::rename(tmp.c_str(), cpath.c_str());
+  }
+
+private:
+  static bool SameAxis(const TAxis *a, const TAxis *b){
+    return a->GetNbins() == b->GetNbins() && a->GetXmin() == b->GetXmin() && a->GetXmax() == b->GetXmax();
+  }
+  static bool SameBinning(TH1 *a, TH1 *b){
+    return a->GetDimension() == b->GetDimension() && SameAxis(a->GetXaxis(), b->GetXaxis())
+           && SameAxis(a->GetYaxis(), b->GetYaxis()) && SameAxis(a->GetZaxis(), b->GetZaxis());
+  }
+
+  static std::string FullPath(const std::string &file){
+    char buf[PATH_MAX];
+    if(realpath(file.c_str(), buf)) return buf;
+    return file;
+  }
+
+  std::string fTag;
+  std::string fDir;
+  std::string fCalHash;
+};
+
+// ============================ CachedFill() ========================================//
+// For every file: add its cached partials to hists, or fill a zeroed copy of hists with
+// fill(file, parts), save it to the cache and add it to hists.
+// fill has the signature void(const std::string &file, std::vector<TH1 *> &parts).
+template<class FILL>
+void CachedFill(const HistCache &cache, const std::vector<std::string> &files,
+                const std::vector<TH1 *> &hists, FILL fill){
+  std::vector<TH1 *> parts;
+  for(TH1 *h : hists){
+    TH1 *p = (TH1 *)h->Clone(h->GetName());
+    p->SetDirectory(nullptr);
+    parts.push_back(p);
+  }
+  int nreused = 0;
+  for(size_t i=0;i<files.size();i++){
+    if(cache.Load(files[i], hists)){
+      nreused++;
+      printf("[%zu/%zu] cached:    %s\n", i+1, files.size(), files[i].c_str());
+      continue;
+    }
+    printf("[%zu/%zu] filling:   %s\n", i+1, files.size(), files[i].c_str());
+    for(TH1 *p : parts) p->Reset();
+    fill(files[i], parts);
+    cache.Save(files[i], parts);
+    for(size_t j=0;j<hists.size();j++) hists[j]->Add(parts[j]);
+  }
+  for(TH1 *p : parts) delete p;
+  printf("%i / %zu files taken from the cache\n", nreused, files.size());
+}
+
+// ============================ ParallelCachedFill() ========================================//
+// Same as CachedFill(), with the files spread over nthreads threads. Every thread keeps its
+// own partials and sums, added into hists at the end (about 2 x hists of memory per thread).
+// fill is called concurrently on different files and must only touch its own parts.
+template<class FILL>
+void ParallelCachedFill(const HistCache &cache, const std::vector<std::string> &files,
+                        const std::vector<TH1 *> &hists, int nthreads, FILL fill){
+  nthreads = std::max(1, std::min<int>(nthreads, files.size()));
+  ROOT::EnableThreadSafety();
+  std::vector<std::vector<TH1 *>> parts(nthreads), sums(nthreads);
+  for(int t=0;t<nthreads;t++){
+    for(TH1 *h : hists){
+      TH1 *p = (TH1 *)h->Clone(h->GetName());
+      p->SetDirectory(nullptr);
+      p->Reset();
+      parts[t].push_back(p);
+      TH1 *s = (TH1 *)p->Clone(h->GetName());
+      s->SetDirectory(nullptr);
+      sums[t].push_back(s);
+    }
+  }
+  std::atomic<size_t> next(0);
+  std::atomic<int> nreused(0);
+  std::mutex printmutex;
+  auto worker = [&](int t){
+    size_t i;
+    while((i = next++) < files.size()){
+      for(TH1 *p : parts[t]) p->Reset();
+      bool cached = cache.Load(files[i], parts[t]);
+      {
+        std::lock_guard<std::mutex> lock(printmutex);
+        printf("[%zu/%zu] %s %s\n", i+1, files.size(), cached ? "cached: " : "filling:", files[i].c_str());
+      }
+      if(cached){
+        nreused++;
+      }else{
+        fill(files[i], parts[t]);
+        cache.Save(files[i], parts[t]);
+      }
+      for(size_t j=0;j<hists.size();j++) sums[t][j]->Add(parts[t][j]);
+    }
+  };
+  std::vector<std::thread> pool;
+  for(int t=0;t<nthreads;t++) pool.emplace_back(worker, t);
+  for(auto &th : pool) th.join();
+  for(int t=0;t<nthreads;t++){
+    for(size_t j=0;j<hists.size();j++){
+      hists[j]->Add(sums[t][j]);
+      delete parts[t][j];
+      delete sums[t][j];
+    }
+  }
+  printf("%i / %zu files taken from the cache (%i threads)\n", nreused.load(), files.size(), nthreads);
+}
+
+#endif
@@ -0,0 +1,72 @@
+// HistPyramid.h: coarse copies of a spectrum for peak search and first fit passes.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// Level 0 is the histogram itself, level k has 2^k of its bins merged (2x, 4x, 8x). A level
+// is made the first time it is asked for, from the level below, so a channel that never
+// needs the 8x copy never pays for it. Build the pyramid after the histogram is filled:
+// the levels are not updated by later fills.
+//   HistPyramid pyr(hist);
+//   PeakHunt(pyr, 2, ...)          peak search on the 4x level, positions refined on hist
+//   pyr.Level(2)->Fit(...)         first fit pass on 1000 bins instead of 4000
+//   hist->Fit(..., ROI)            final fit at full resolution in the region of interest only
+#ifndef HISTPYRAMID_H
+#define HISTPYRAMID_H
+
+#include <vector>
+#include <algorithm>
+#include <TH1.h>
+
+class HistPyramid{
+public:
+  HistPyramid(TH1 *hist, int maxlevel = 3) : fLevels(maxlevel+1, nullptr) { fLevels[0] = hist; }
+  ~HistPyramid(){
+    for(size_t k=1;k<fLevels.size();k++) delete fLevels[k];
+  }
+  HistPyramid(const HistPyramid &) = delete;
+  HistPyramid &operator=(const HistPyramid &) = delete;
+
+  TH1 *Base() const { return fLevels[0]; }
+  int MaxLevel() const { return (int)fLevels.size()-1; }
+  int Factor(int level) const { return 1 << level; }
+
+  // 2^level times coarser copy of Base() (owned by the pyramid, not in any directory)
+  TH1 *Level(int level){
+    if(level <= 0) return fLevels[0];
+    if(level > MaxLevel()) level = MaxLevel();
+    if(!fLevels[level]){
+      TH1 *below = Level(level-1);
+      TH1 *h = (TH1 *)below->Clone(Form("%s_x%i", fLevels[0]->GetName(), Factor(level)));
+      h->SetDirectory(nullptr);
+      h->GetListOfFunctions()->Delete();
+      h->GetXaxis()->SetRange(0, 0);
+      h->Rebin(2);
+      fLevels[level] = h;
+    }
+    return fLevels[level];
+  }
+
+private:
+  std::vector<TH1 *> fLevels;
+};
+
+// ============================ MaxBinIn() ========================================//
+// Highest bin of h between the bins of xlow and xhigh (first one if several), without
+// touching the axis range of h. Same bin as SetAxisRange(xlow, xhigh) + GetMaximumBin().
+inline int MaxBinIn(TH1 *h, double xlow, double xhigh){
+  int first = std::max(1, h->FindBin(xlow));
+  int last  = std::min(h->GetNbinsX(), h->FindBin(xhigh));
+  int best = first;
+  for(int b=first+1;b<=last;b++){
+    if(h->GetBinContent(b) > h->GetBinContent(best)) best = b;
+  }
+  return best;
+}
+
+// ============================ RefinePeak() ========================================//
+// Peak position x found on a coarse level, moved to the centre of the highest bin of the
+// full-resolution h within +-halfwidth
+inline double RefinePeak(TH1 *h, double x, double halfwidth){
+  return h->GetBinCenter(MaxBinIn(h, x-halfwidth, x+halfwidth));
+}
+
+#endif
@@ -0,0 +1,187 @@
+// InputIndex.h: fast start-up for TChains over many subrun files.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// TChain::GetEntries() right after Add() opens every file header one after the other, which
+// takes minutes for hundreds of subruns on network storage. MakeChain() instead
+//  1. takes the entry count of each file from a small index (".entry_index" in the data
+//     directory, or "entry_index.dat" in the working directory if the data is read-only),
+//     valid as long as the file size and mtime are unchanged;
+//  2. opens only the files missing from the index, on a pool of threads;
+//  3. adds every file with its known count, TChain::Add(file, nentries), so the chain
+//     opens each file only when the event loop reaches it.
+#ifndef INPUTINDEX_H
+#define INPUTINDEX_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+
+// ============================ FindSubruns() ========================================//
+// All files in the directory of infile with the same 5-digit run number (the 5 characters
+// before the last '_') and kind ("analysis" or "fragment") in their name, sorted.
+inline std::vector<std::string> FindSubruns(const std::string &infile, const char *kind){
+  std::vector<std::string> runlist;
+  size_t size = infile.find_last_of("/");
+  std::string directory = (size == std::string::npos) ? "." : infile.substr(0,size);
+  size_t num = infile.find_last_of("_");
+  if(num == std::string::npos || num < 5) return {infile};
+  std::string runnumber = infile.substr(num-5,5);
+  std::cout << "Directory: " << directory << ", Run number: " << runnumber << std::endl;
+  DIR *pDIR;
+  struct dirent *entry;
+  if((pDIR = opendir(directory.c_str()))){
+    while((entry = readdir(pDIR))){
+      if(strstr(entry->d_name, runnumber.c_str()) && strstr(entry->d_name, kind)){
+        runlist.push_back(directory + "/" + entry->d_name);
+      }
+    }
+    closedir(pDIR);
+  }
+  std::sort(runlist.begin(), runlist.end()); // Puts subruns in order
+  return runlist;
+}
+
+// ============================ InputIndex ========================================//
+class InputIndex{
+public:
+  InputIndex(const std::string &treename = "AnalysisTree", int nthreads = 8)
+    : fTreeName(treename), fNThreads(nthreads) {}
+
+  // Entry count of every file (-1 if it cannot be opened or has no tree).
+  std::vector<long> Count(const std::vector<std::string> &files){
+    std::vector<long> counts(files.size(), -1);
+    std::vector<std::string> stamps(files.size());
+    std::vector<size_t> missing;
+    for(size_t i=0;i<files.size();i++){
+      stamps[i] = Stamp(files[i]);
+      if(stamps[i].empty()){
+        missing.push_back(i);                 // remote file: no stat, always opened
+        continue;
+      }
+      std::string dir = DirName(FullPath(files[i]));
+      LoadIndex(dir + "/.entry_index");
+      LoadIndex("entry_index.dat");
+      auto found = fIndex.find(stamps[i]);
+      if(found != fIndex.end()) counts[i] = found->second;
+      else missing.push_back(i);
+    }
+    if(missing.empty()) return counts;
+
+    // open the missing files in parallel
+    ROOT::EnableThreadSafety();
+    std::atomic<size_t> next(0);
+    auto worker = [&](){
+      size_t n;
+      while((n = next++) < missing.size()){
+        size_t i = missing[n];
+        TFile *f = TFile::Open(files[i].c_str(), "read");
+        if(f && !f->IsZombie()){
+          TTree *tree = (TTree *)f->Get(fTreeName.c_str());
+          if(tree) counts[i] = tree->GetEntries();
+        }
+        delete f;
+      }
+    };
+    std::vector<std::thread> pool;
+    int nthreads = std::min<int>(fNThreads, missing.size());
+    for(int t=0;t<nthreads;t++) pool.emplace_back(worker);
+    for(auto &t : pool) t.join();
+    printf("Opened %zu / %zu files to count entries (%zu from the index)\n",
+           missing.size(), files.size(), files.size()-missing.size());
+
+    std::map<std::string, std::vector<std::string>> newlines; // dir -> index lines
+    for(size_t i : missing){
+      if(counts[i] < 0 || stamps[i].empty()) continue;
+      fIndex[stamps[i]] = counts[i];
+      newlines[DirName(FullPath(files[i]))].push_back(stamps[i] + " " + std::to_string(counts[i]));
+    }
+    for(auto &[dir, lines] : newlines){
+      if(!AppendIndex(dir + "/.entry_index", lines)) AppendIndex("entry_index.dat", lines);
+    }
+    return counts;
+  }
+
+  // Chain over files with known entry counts; files that cannot be read are skipped.
+  TChain *MakeChain(const std::vector<std::string> &files){
+    return MakeChain(files, Count(files));
+  }
+
+  // Same, with the counts of a previous Count(files)
+  TChain *MakeChain(const std::vector<std::string> &files, const std::vector<long> &counts){
+    TChain *chain = new TChain(fTreeName.c_str());
+    for(size_t i=0;i<files.size();i++){
+      if(counts[i] < 0){
+        std::cerr << "Skip file without " << fTreeName << ": " << files[i] << std::endl;
+        continue;
+      }
+      if(counts[i] == 0) continue;
+      chain->Add(files[i].c_str(), counts[i]);
+    }
+    return chain;
+  }
+
+private:
+  static std::string FullPath(const std::string &file){
+    char buf[PATH_MAX];
+    if(realpath(file.c_str(), buf)) return buf;
+    return file;
+  }
+
+  static std::string DirName(const std::string &path){
+    size_t pos = path.find_last_of("/");
+    return (pos == std::string::npos) ? "." : path.substr(0, pos);
+  }
+
+  // "fullpath size mtime tree", empty if the file cannot be stat'ed
+  std::string Stamp(const std::string &file) const {
+    struct stat st;
+    if(stat(file.c_str(), &st) != 0) return "";
+    return FullPath(file) + " " + std::to_string((long long)st.st_size) + " "
+         + std::to_string((long long)st.st_mtime) + " " + fTreeName;
+  }
+
+  void LoadIndex(const std::string &filename){
+    if(fLoaded.count(filename)) return;
+    fLoaded[filename] = true;
+    std::ifstream infile(filename);
+    std::string line;
+    while(std::getline(infile, line)){
+      if(line.empty() || line[0] == '#') continue;
+      size_t pos = line.find_last_of(' ');
+      if(pos == std::string::npos) continue;
+      fIndex[line.substr(0,pos)] = atol(line.c_str()+pos+1);
+    }
+  }
+
+  static bool AppendIndex(const std::string &filename, const std::vector<std::string> &lines){
+    std::ofstream outfile(filename, std::ios::app);
+    if(!outfile.is_open()) return false;
+    for(const auto &l : lines) outfile << l << '\n';
+    return outfile.good();
+  }
+
+  std::string fTreeName;
+  int fNThreads;
+  std::map<std::string, long> fIndex;   // stamp -> entries
+  std::map<std::string, bool> fLoaded;  // index files already read
+};
+
+#endif
@@ -0,0 +1,177 @@
+//g++ MergeHists.cxx `root-config --cflags --libs` -O2 -o MergeHists
+
+// Add the histograms of several partial outputs (eg raw_hist.root of each shard) into one file.
+// Histograms with the same name and binning are added bin by bin on their flat content arrays
+// (and sumw2, entries and fit statistics), without the per-object checks of TH1::Merge/hadd.
+// Histograms with a different binning fall back to TH1::Add; other objects are copied from
+// the first file they appear in.
+// Objects are written in order of first appearance, except the channel histograms hs<N>, which
+// are written in increasing N as by a single RawHistMaker (a channel empty in the first shard
+// would otherwise come after the others).
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include <TFile.h>
+#include <TKey.h>
+#include <TH1.h>
+#include <TArrayD.h>
+#include <TArrayF.h>
+#include <TArrayI.h>
+#include <TArrayS.h>
+#include <TArrayC.h>
+#include <TStopwatch.h>
+
+// ============================ SameBinning() ========================================//
+bool SameAxis(const TAxis *a, const TAxis *b){
+  return a->GetNbins() == b->GetNbins() && a->GetXmin() == b->GetXmin() && a->GetXmax() == b->GetXmax();
+}
+
+bool SameBinning(const TH1 *a, const TH1 *b){
+  return a->IsA() == b->IsA() && a->GetNcells() == b->GetNcells()
+      && SameAxis(a->GetXaxis(), b->GetXaxis())
+      && SameAxis(a->GetYaxis(), b->GetYaxis())
+      && SameAxis(a->GetZaxis(), b->GetZaxis());
+}
+
+// ============================ AddFlat() ========================================//
+// a += b on the content array of type ARRAY (TArrayD for TH1D/TH2D..., TArrayF for TH1F...)
+template<class ARRAY>
+bool AddArray(TH1 *a, TH1 *b){
+  ARRAY *pa = dynamic_cast<ARRAY *>(a);
+  ARRAY *pb = dynamic_cast<ARRAY *>(b);
+  if(!pa || !pb) return false;
+  auto *ca = pa->GetArray();
+  auto *cb = pb->GetArray();
+  int n = pa->GetSize();
+  for(int i=0;i<n;i++) ca[i] += cb[i];
+  return true;
+}
+
+bool AddFlat(TH1 *a, TH1 *b){
+  if(!SameBinning(a, b)) return false;
+  if((a->GetSumw2N() > 0) != (b->GetSumw2N() > 0)) return false;
+  if(a->GetDimension() != b->GetDimension()) return false;
+  if(a->GetBuffer() || b->GetBuffer()) return false;
+
+  double sa[TH1::kNstat], sb[TH1::kNstat];
+  a->GetStats(sa);
+  b->GetStats(sb);
+  double entries = a->GetEntries() + b->GetEntries();
+
+  if(!AddArray<TArrayD>(a, b) && !AddArray<TArrayF>(a, b) && !AddArray<TArrayI>(a, b)
+     && !AddArray<TArrayS>(a, b) && !AddArray<TArrayC>(a, b)) return false;
+  if(a->GetSumw2N() > 0){
+    double *wa = a->GetSumw2()->GetArray();
+    double *wb = b->GetSumw2()->GetArray();
+    int n = a->GetSumw2N();
+    for(int i=0;i<n;i++) wa[i] += wb[i];
+  }
+  for(int i=0;i<TH1::kNstat;i++) sa[i] += sb[i];
+  a->PutStats(sa);
+  a->SetEntries(entries);
+  return true;
+}
+
+// ============================ SortChannelHists() ========================================//
+// hs<N> names of order sorted by N in the positions they hold; the other names stay in place
+bool IsChannelHist(const std::string &name){
+  return name.size()>2 && name.compare(0, 2, "hs")==0
+      && name.find_first_not_of("0123456789", 2)==std::string::npos;
+}
+
+void SortChannelHists(std::vector<std::string> &order){
+  std::vector<size_t> pos;
+  std::vector<std::string> names;
+  for(size_t i=0;i<order.size();i++){
+    if(!IsChannelHist(order[i])) continue;
+    pos.push_back(i);
+    names.push_back(order[i]);
+  }
+  std::sort(names.begin(), names.end(), [](const std::string &a, const std::string &b){
+    return atoi(a.c_str()+2) < atoi(b.c_str()+2);
+  });
+  for(size_t k=0;k<pos.size();k++) order[pos[k]] = names[k];
+}
+
+// ====================================== main() ==========================================//
+// argv: [-min N] output.root input1.root input2.root ...
+// -min N: drop histograms with N entries or less after the merge (RawHistMaker keeps > 10)
+int main(int argc, char **argv){
+  int iarg = 1;
+  double minentries = -1;
+  if(argc>2 && strcmp(argv[1], "-min") == 0){
+    minentries = atof(argv[2]);
+    iarg = 3;
+  }
+  if(argc-iarg<2){
+    printf("Input [-min N] output.root and partial root files\n");
+    return 1;
+  }
+  TH1::AddDirectory(kFALSE);
+  std::string outname = argv[iarg];
+
+  TStopwatch sw;
+  std::vector<std::string> order;              // first appearance, then SortChannelHists()
+  std::map<std::string, TObject *> objs;
+  int nflat = 0, nslow = 0;
+  for(int f=iarg+1;f<argc;f++){
+    TFile *infile = TFile::Open(argv[f], "read");
+    if(!infile || infile->IsZombie()){
+      std::cerr << "Cannot open file: " << argv[f] << std::endl;
+      return 1;
+    }
+    std::map<std::string, bool> seen;          // only the highest cycle of each key
+    for(TObject *obj : *infile->GetListOfKeys()){
+      TKey *key = (TKey *)obj;
+      std::string name = key->GetName();
+      if(seen[name]) continue;
+      seen[name] = true;
+      TObject *cur = key->ReadObj();
+      auto found = objs.find(name);
+      if(found == objs.end()){
+        if(TH1 *h = dynamic_cast<TH1 *>(cur)) h->SetDirectory(nullptr);
+        objs[name] = cur;
+        order.push_back(name);
+        continue;
+      }
+      TH1 *hacc = dynamic_cast<TH1 *>(found->second);
+      TH1 *hcur = dynamic_cast<TH1 *>(cur);
+      if(hacc && hcur){
+        if(AddFlat(hacc, hcur)){
+          nflat++;
+        }else{
+          hacc->Add(hcur);
+          nslow++;
+        }
+      }
+      delete cur;
+    }
+    infile->Close();
+    delete infile;
+    printf("Merging file: %i / %i \r", f-iarg, argc-iarg-1);
+    fflush(stdout);
+  }
+
+  SortChannelHists(order);
+  TFile *newf = new TFile(outname.c_str(), "recreate");
+  newf->cd();
+  int nwritten = 0;
+  for(const auto &name : order){
+    TObject *obj = objs[name];
+    TH1 *h = dynamic_cast<TH1 *>(obj);
+    if(h && h->GetEntries() <= minentries) continue;
+    obj->Write(name.c_str());
+    nwritten++;
+  }
+  newf->Close();
+  sw.Stop();
+  printf("\nMerged %i files into %s: %i objects, %i flat adds, %i TH1::Add, %.2f s\n",
+         argc-iarg-1, outname.c_str(), nwritten, nflat, nslow, sw.RealTime());
+  return 0;
+}
@@ -0,0 +1,216 @@
+// PerfReport.h: run-time instrumentation of the histogram makers and fitters.
+// Header only (C++17), include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// One global report per process, gPerf, collects
+//   sections  wall time of named parts (PerfTimer t("fill"); ... ends at the end of the scope)
+//   counters  entries, hits, bytes... (gPerf.Count("hits", n), add once per loop, not per hit)
+//   fits      wall time, function calls and status of every fit, per channel
+//   io        bytes read from disk (TFile::GetFileBytesRead) and estimated bytes unzipped
+// and, only if $PERF_DIR is set, writes it as one JSON file per run with gPerf.Write() at the
+// end of main():
+//   $PERF_DIR/<program>_<date>_<time>_<pid>.json   (eg PERF_DIR=perf; unset or "" = no report)
+// ReadAhead.h adds the GetEntry time (reader thread), the time the fill loop waited for
+// events and the number of entries read, so fill-bound and I/O-bound runs can be told apart.
+#ifndef PERFREPORT_H
+#define PERFREPORT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TFitResult.h>
+#include <TFitResultPtr.h>
+
+class PerfReport{
+public:
+  PerfReport() : fStart(std::chrono::steady_clock::now()), fStartTime(time(nullptr)) {}
+
+  void Start(const std::string &program, int argc = 0, char **argv = nullptr){
+    std::lock_guard<std::mutex> lock(fMutex);
+    fProgram = program;
+    fArgs.clear();
+    for(int i=1;i<argc;i++) fArgs.push_back(argv[i]);
+  }
+
+  void AddTime(const std::string &section, double seconds){
+    std::lock_guard<std::mutex> lock(fMutex);
+    fSections[section] += seconds;
+  }
+
+  void Count(const std::string &counter, double n){
+    std::lock_guard<std::mutex> lock(fMutex);
+    fCounters[counter] += n;
+  }
+
+  // one fit of channel ch (ncalls: function calls of the minimizer, from TFitResult)
+  void Fit(int ch, double seconds, int ncalls, int status){
+    std::lock_guard<std::mutex> lock(fMutex);
+    FitStat &f = fFits[ch];
+    f.nfits++;
+    f.seconds += seconds;
+    f.ncalls += ncalls;
+    if(status != 0) f.nfailed++;
+  }
+
+  // fit with option "S" added, timed and recorded under channel ch
+  template<class H, class F>
+  TFitResultPtr TimedFit(int ch, H *hist, F *func, const char *opt){
+    auto t0 = std::chrono::steady_clock::now();
+    TFitResultPtr r = hist->Fit(func, (std::string(opt) + "S").c_str());
+    double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const TFitResult *res = r.Get();
+    Fit(ch, dt, res ? (int)res->NCalls() : 0, (int)r);
+    return r;
+  }
+
+  // compression factor of the branches read from tree, for the unzipped-bytes estimate
+  void Tree(TTree *tree){
+    if(!tree) return;
+    double zip = tree->GetZipBytes(), tot = tree->GetTotBytes();
+    std::lock_guard<std::mutex> lock(fMutex);
+    if(zip > 0) fUnzipRatio = tot/zip;
+  }
+
+  static double PeakRSSMB(){
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss/1024.;   // kB on Linux
+  }
+
+  // Write the JSON report to $PERF_DIR; returns the file name ("" if disabled or not writable)
+  std::string Write(){
+    const char *env = getenv("PERF_DIR");
+    std::string dir = env ? env : "";
+    if(dir.empty()) return "";
+    mkdir(dir.c_str(), 0755);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&fStartTime));
+    std::string name = dir + "/" + (fProgram.empty() ? "run" : fProgram) + "_" + stamp + "_"
+                     + std::to_string((long)getpid()) + ".json";
+    FILE *out = fopen(name.c_str(), "w");
+    if(!out) return "";
+
+    std::lock_guard<std::mutex> lock(fMutex);
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - fStart).count();
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double cpu = ru.ru_utime.tv_sec + 1e-6*ru.ru_utime.tv_usec + ru.ru_stime.tv_sec + 1e-6*ru.ru_stime.tv_usec;
+    double bytesread = (double)TFile::GetFileBytesRead();
+    char host[256] = "";
+    gethostname(host, sizeof(host)-1);
+    char started[32];
+    strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%S", localtime(&fStartTime));
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"program\": \"%s\",\n", Escape(fProgram).c_str());
+    fprintf(out, "  \"args\": [");
+    for(size_t i=0;i<fArgs.size();i++) fprintf(out, "%s\"%s\"", i ? ", " : "", Escape(fArgs[i]).c_str());
+    fprintf(out, "],\n");
+    fprintf(out, "  \"host\": \"%s\",\n", Escape(host).c_str());
+    fprintf(out, "  \"start\": \"%s\",\n", started);
+    fprintf(out, "  \"wall_s\": %.3f,\n", wall);
+    fprintf(out, "  \"cpu_s\": %.3f,\n", cpu);
+    fprintf(out, "  \"peak_rss_mb\": %.1f,\n", ru.ru_maxrss/1024.);
+    fprintf(out, "  \"io\": {\"bytes_read\": %.0f, \"bytes_unzipped_est\": %.0f, \"read_mb_s\": %.2f},\n",
+            bytesread, bytesread*fUnzipRatio, wall > 0 ? bytesread/1e6/wall : 0.);
+
+    fprintf(out, "  \"sections_s\": {");
+    bool first = true;
+    for(const auto &s : fSections){
+      fprintf(out, "%s\n    \"%s\": %.4f", first ? "" : ",", Escape(s.first).c_str(), s.second);
+      first = false;
+    }
+    fprintf(out, "%s},\n", first ? "" : "\n  ");
+
+    fprintf(out, "  \"counters\": {");
+    first = true;
+    for(const auto &c : fCounters){
+      fprintf(out, "%s\n    \"%s\": %.0f", first ? "" : ",", Escape(c.first).c_str(), c.second);
+      first = false;
+    }
+    fprintf(out, "%s},\n", first ? "" : "\n  ");
+
+    // derived rates
+    auto counter = [this](const char *k){ auto f = fCounters.find(k); return f == fCounters.end() ? 0. : f->second; };
+    double entries = counter("entries"), hits = counter("hits");
+    fprintf(out, "  \"rates\": {\"entries_per_s\": %.1f, \"hits_per_event\": %.3f},\n",
+            wall > 0 ? entries/wall : 0., entries > 0 ? hits/entries : 0.);
+
+    int nfits = 0, nfailed = 0;
+    double fitsec = 0;
+    for(const auto &f : fFits){
+      nfits += f.second.nfits;
+      nfailed += f.second.nfailed;
+      fitsec += f.second.seconds;
+    }
+    fprintf(out, "  \"fits\": {\"n\": %i, \"failed\": %i, \"wall_s\": %.4f, \"fits_per_s\": %.2f, \"channels\": [",
+            nfits, nfailed, fitsec, fitsec > 0 ? nfits/fitsec : 0.);
+    first = true;
+    for(const auto &f : fFits){
+      fprintf(out, "%s\n    {\"ch\": %i, \"nfits\": %i, \"wall_s\": %.5f, \"ncalls\": %ld, \"failed\": %i}",
+              first ? "" : ",", f.first, f.second.nfits, f.second.seconds, f.second.ncalls, f.second.nfailed);
+      first = false;
+    }
+    fprintf(out, "%s]}\n", first ? "" : "\n  ");
+    fprintf(out, "}\n");
+    fclose(out);
+    printf("Performance report: %s\n", name.c_str());
+    return name;
+  }
+
+private:
+  struct FitStat{
+    int nfits = 0;
+    int nfailed = 0;
+    double seconds = 0;
+    long ncalls = 0;
+  };
+
+  static std::string Escape(const std::string &s){
+    std::string e;
+    for(char c : s){
+      if(c == '"' || c == '\\') e += '\\';
+      if((unsigned char)c < 0x20) continue;
+      e += c;
+    }
+    return e;
+  }
+
+  std::chrono::steady_clock::time_point fStart;
+  time_t fStartTime;
+  std::string fProgram;
+  std::vector<std::string> fArgs;
+  std::map<std::string, double> fSections;
+  std::map<std::string, double> fCounters;
+  std::map<int, FitStat> fFits;
+  double fUnzipRatio = 1;
+  std::mutex fMutex;
+};
+
+inline PerfReport gPerf;
+
+// ============================ PerfTimer ========================================//
+// Adds the wall time of its scope to section name of gPerf.
+class PerfTimer{
+public:
+  PerfTimer(const char *name) : fName(name), fStart(std::chrono::steady_clock::now()) {}
+  ~PerfTimer(){
+    gPerf.AddTime(fName, std::chrono::duration<double>(std::chrono::steady_clock::now() - fStart).count());
+  }
+private:
+  const char *fName;
+  std::chrono::steady_clock::time_point fStart;
+};
+
+#endif
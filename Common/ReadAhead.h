@@ -0,0 +1,188 @@
+// ReadAhead.h: asynchronous input stage for the AnalysisTree/FragmentTree event loops.
+// Header only, include it after the ROOT headers and compile with -I<repo>/Common.
+//
+// EnableParallelRead(): once in main(), before any thread is started: baskets of the next
+//   clusters are decompressed on background threads (TTreeCacheUnzip + implicit MT).
+// SetupReadCache(): only the branches the loop reads are enabled and put in a TTreeCache
+//   (no learning phase). Safe to call from the worker threads of ParallelCachedFill().
+// ReadAhead<T>: a reader thread runs GetEntry() and copies the event object (TS3, TTigress,
+//   TFragment...) into a ring of slots; the fill loop takes complete events from the bounded
+//   queue with Next(), so disk, decompression and histogram filling overlap.
+//
+//   EnableParallelRead();                    // in main()
+//   SetupReadCache(chain, {"TS3"});
+//   ReadAhead<TS3> reader(chain, "TS3");
+//   while(TS3 *s3 = reader.Next()){ ... reader.Entry() ... }
+// When the reader is destroyed it adds its timing to gPerf (PerfReport.h): "getentry" (reader
+// thread), "wait_for_input" and "fill" (fill loop), and the "entries" counter.
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include <TROOT.h>
+#include <TChain.h>
+#include <TFile.h>
+#include <TTreeCacheUnzip.h>
+#include "PerfReport.h"
+
+// ============================ EnableParallelRead() ========================================//
+// Process-wide ROOT settings of the readers: thread safety, implicit MT with nunzip threads and
+// parallel basket unzipping (nunzip = 0: thread safety only). Call it once at the start of
+// main(), before any thread reads a tree.
+inline void EnableParallelRead(int nunzip = 2){
+  ROOT::EnableThreadSafety();
+  if(nunzip > 0){
+    ROOT::EnableImplicitMT(nunzip);
+    TTreeCacheUnzip::SetParallelUnzip(TTreeCacheUnzip::kEnable);
+  }
+}
+
+// ============================ SetupReadCache() ========================================//
+// branches: top-level branch names read by the loop (sub-branches are included)
+inline void SetupReadCache(TChain *chain, const std::vector<std::string> &branches,
+                           long cachesize = 100*1024*1024){
+  chain->SetBranchStatus("*", 0);
+  for(const auto &b : branches) chain->SetBranchStatus((b + "*").c_str(), 1);
+  chain->SetCacheSize(cachesize);
+  for(const auto &b : branches) chain->AddBranchToCache((b + "*").c_str(), true);
+  chain->StopCacheLearningPhase();
+}
+
+// ============================ ReadAhead<T> ========================================//
+template<class T>
+class ReadAhead{
+public:
+  // Starts reading entries [first, last) of branch into a queue of depth events
+  // (last = -1: until the end of the chain). The chain must not be used until the reader is gone.
+  ReadAhead(TChain *chain, const char *branch, int depth = 256, long first = 0, long last = -1)
+    : fChain(chain), fSlots(depth), fFirst(first) {
+    ROOT::EnableThreadSafety();
+    fLast = (last < 0) ? chain->GetEntries() : last;
+    for(int i=0;i<depth;i++){
+      fSlots[i].obj = new T;
+      fFree.push_back(i);
+    }
+    fChain->SetBranchAddress(branch, &fObj);
+    fStart = std::chrono::steady_clock::now();
+    fThread = std::thread(&ReadAhead::Run, this);
+  }
+
+  ~ReadAhead(){
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fStop = true;
+    }
+    fFreeCV.notify_all();
+    fThread.join();
+    double loop = std::chrono::duration<double>(std::chrono::steady_clock::now() - fStart).count();
+    gPerf.AddTime("getentry", fReadSec);
+    gPerf.AddTime("wait_for_input", fWaitSec);
+    gPerf.AddTime("fill", loop - fWaitSec);
+    gPerf.Count("entries", fNRead);
+    gPerf.Tree(fChain->GetTree());
+    fChain->ResetBranchAddresses();
+    delete fObj;
+    for(auto &s : fSlots) delete s.obj;
+  }
+
+  // Next complete event, nullptr at the end. The returned object is valid until the next call.
+  T *Next(){
+    std::unique_lock<std::mutex> lock(fMutex);
+    if(fCur >= 0){
+      fFree.push_back(fCur);
+      fFreeCV.notify_one();
+      fCur = -1;
+    }
+    if(fReady.empty() && !fDone){
+      auto t0 = std::chrono::steady_clock::now();
+      fReadyCV.wait(lock, [this]{ return !fReady.empty() || fDone; });
+      fWaitSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    if(fReady.empty()) return nullptr;
+    fCur = fReady.front();
+    fReady.pop_front();
+    return fSlots[fCur].obj;
+  }
+
+  long GetEntries() const { return fLast - fFirst; }
+  // chain entry, tree number and file name of the event returned by Next()
+  long Entry() const { return fSlots[fCur].entry; }
+  int TreeNumber() const { return fSlots[fCur].tree; }
+  const std::string &FileName() const { return fSlots[fCur].file; }
+
+private:
+  struct Slot{
+    T *obj = nullptr;
+    long entry = -1;
+    int tree = -1;
+    std::string file;
+  };
+
+  void Run(){
+    int curtree = -1;
+    std::string curfile;
+    for(long xentry=fFirst; xentry<fLast; xentry++){
+      auto t0 = std::chrono::steady_clock::now();
+      int nbytes = fChain->GetEntry(xentry);
+      fReadSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      if(nbytes <= 0) continue;
+      fNRead++;
+      if(fChain->GetTreeNumber() != curtree){
+        curtree = fChain->GetTreeNumber();
+        curfile = fChain->GetFile() ? fChain->GetFile()->GetName() : "";
+      }
+      int idx;
+      {
+        std::unique_lock<std::mutex> lock(fMutex);
+        fFreeCV.wait(lock, [this]{ return !fFree.empty() || fStop; });
+        if(fStop) break;
+        idx = fFree.front();
+        fFree.pop_front();
+      }
+      Slot &slot = fSlots[idx];
+      *slot.obj  = *fObj;            // copy outside the lock, the fill loop keeps running
+      slot.entry = xentry;
+      slot.tree  = curtree;
+      slot.file  = curfile;
+      {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fReady.push_back(idx);
+      }
+      fReadyCV.notify_one();
+    }
+    {
+      std::lock_guard<std::mutex> lock(fMutex);
+      fDone = true;
+    }
+    fReadyCV.notify_all();
+  }
+
+  TChain *fChain;
+  T *fObj = nullptr;              // branch address, only used by the reader thread
+  std::vector<Slot> fSlots;
+  std::deque<int> fFree;
+  std::deque<int> fReady;
+  int fCur = -1;                  // slot handed out by the last Next()
+  long fFirst;
+  long fLast;
+  bool fStop = false;
+  bool fDone = false;
+  std::chrono::steady_clock::time_point fStart;
+  double fReadSec = 0;            // in GetEntry(), reader thread
+  double fWaitSec = 0;            // fill loop waiting for events in Next()
+  long fNRead = 0;
+  std::mutex fMutex;
+  std::condition_variable fFreeCV;
+  std::condition_variable fReadyCV;
+  std::thread fThread;
+};
+
+#endif
@@ -0,0 +1,62 @@
+//g++ ResultsQuery.cxx -O2 -o ResultsQuery
+
+// Query the fit results store (ResultsStore.h) without refitting anything:
+//   ResultsQuery [-store dir] stage channel [last]    history of one channel, newest first
+//   ResultsQuery [-store dir] -list                   every (stage, channel) and its number of records
+// stage: alpha, co60, peaks_<source> (e.g. peaks_152eu) or quad; last: default 50 records.
+// Eg, FWHM of S3 channel 1000 over the last 50 runs: ResultsQuery alpha 1000 50
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include "ResultsStore.h"
+
+
+// ====================================== main() ==========================================//
+int main(int argc, char **argv){
+  std::string dir = ResultsStore::DefaultDir();
+  int iarg = 1;
+  if(iarg+1<argc && strcmp(argv[iarg], "-store")==0){
+    dir = argv[iarg+1];
+    iarg += 2;
+  }
+  if(dir.empty()) dir = "results";
+  ResultsStore store(dir);
+
+  if(iarg<argc && strcmp(argv[iarg], "-list")==0){
+    for(const auto &it : store.Keys()){
+      printf("%-14s %6i %8lld\n", it.first.first.c_str(), it.first.second, (long long)it.second);
+    }
+    return 0;
+  }
+  if(argc-iarg<2){
+    printf("Input [-store dir] stage channel [last]  or  [-store dir] -list\n");
+    return 1;
+  }
+  std::string stage = argv[iarg];
+  int channel = atoi(argv[iarg+1]);
+  int last = (argc-iarg>2) ? atoi(argv[iarg+2]) : 50;
+
+  std::vector<ResultRec> recs = store.History(stage, channel, last);
+  if(recs.empty()){
+    printf("No results for %s channel %i in %s/\n", stage.c_str(), channel, dir.c_str());
+    return 1;
+  }
+  std::vector<std::string> cols = StageColumns(stage);
+  printf("#%-6s %-19s %4s", "run", "date", "sub");
+  for(const std::string &c : cols) printf(" %12s %10s", c.c_str(), "err");
+  printf(" %9s %6s %9s\n", "chi2/ndf", "status", "fit_s");
+  for(const ResultRec &r : recs){
+    char date[32];
+    time_t t = (time_t)r.time;
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    printf(" %-6i %-19s %4i", r.run, date, r.sub);
+    for(size_t c=0;c<cols.size();c++) printf(" %12.5g %10.3g", r.val[c], r.err[c]);
+    printf(" %9.3f %6i %9.4f\n", r.chi2ndf, r.status, r.seconds);
+  }
+  return 0;
+}
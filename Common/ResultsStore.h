@@ -0,0 +1,245 @@
+// ResultsStore.h: append-only store of the fit results of every run, indexed by stage and channel.
+// Header only (C++17, no ROOT), compile with -I<repo>/Common.
+//
+// Res_Check.dat, co60_linfit.dat, peaks_*.dat and cal_pars.dat are overwritten by every run.
+// The programs also append their results to a store directory ($RESULTS_STORE, default
+// "results", "" = off):
+//   results.log   fixed-size ResultRec records, only ever appended
+//   results.idx   per (stage, channel): number of records and the last one; every record
+//                 points to the previous record of its key, so the history of one channel is
+//                 a chain of reads from the end, whatever the size of the log
+// History("alpha", 1000, 50) reads the index and 50 records, no matter how many runs are in
+// the log. The index is rebuilt from the log if it is missing or behind (e.g. a crash
+// between the two writes). Appends from several processes are serialized with flock().
+// The run number comes from $CAL_RUN (set by Run.sh from the input file names), -1 if unset.
+#ifndef RESULTSSTORE_H
+#define RESULTSSTORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <ctime>
+#include <type_traits>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+// One fit result. val/err meaning per stage (StageColumns()):
+//   alpha      gain offset fwhmPu fwhmAm fwhmCm res%      (S3 channel)
+//   co60       gain offset fwhm1332 res%                  (TIGRESS crystal)
+//   peaks_<s>  energy centroid                            (one record per peak, sub = peak)
+//   quad       non_lin gain offset
+struct ResultRec{
+  int64_t time;        // unix time of the append
+  int64_t prev;        // previous record of the same (stage, channel), -1 = first
+  int32_t run;
+  int32_t channel;
+  char    stage[16];
+  int32_t sub;
+  int32_t status;      // fit status, 0 = ok, -1 = no fit
+  float   chi2ndf;
+  float   seconds;     // fit wall time
+  float   val[6];
+  float   err[6];
+};
+static_assert(std::is_trivially_copyable<ResultRec>::value, "ResultRec is written as raw bytes");
+
+inline ResultRec MakeResult(const std::string &stage, int channel, int sub = 0){
+  ResultRec r;
+  memset(&r, 0, sizeof(r));
+  r.prev = -1;
+  r.run = -1;
+  r.channel = channel;
+  r.sub = sub;
+  strncpy(r.stage, stage.c_str(), sizeof(r.stage)-1);
+  return r;
+}
+
+inline std::vector<std::string> StageColumns(const std::string &stage){
+  if(stage == "alpha") return {"gain", "offset", "fwhmPu", "fwhmAm", "fwhmCm", "res%"};
+  if(stage == "co60")  return {"gain", "offset", "fwhm1332", "res%"};
+  if(stage == "quad")  return {"non_lin", "gain", "offset"};
+  if(stage.compare(0, 6, "peaks_") == 0) return {"energy", "centroid"};
+  return {"v0", "v1", "v2", "v3", "v4", "v5"};
+}
+
+class ResultsStore{
+public:
+  // dir: store directory; default from $RESULTS_STORE ("results" if unset, "" = disabled)
+  explicit ResultsStore(const std::string &dir = DefaultDir()) : fDir(dir) {}
+
+  static std::string DefaultDir(){
+    const char *env = getenv("RESULTS_STORE");
+    return env ? env : "results";
+  }
+
+  static int CurrentRun(){
+    const char *env = getenv("CAL_RUN");
+    return (env && *env) ? atoi(env) : -1;
+  }
+
+  bool Enabled() const { return !fDir.empty(); }
+
+  // Append recs (time, run and prev are filled here); false if the store cannot be written
+  bool Append(std::vector<ResultRec> recs){
+    if(!Enabled() || recs.empty()) return Enabled();
+    mkdir(fDir.c_str(), 0755);
+    int fd = open(LogName().c_str(), O_RDWR | O_CREAT, 0644);
+    if(fd < 0){
+      printf("Cannot write results store %s\n", LogName().c_str());
+      return false;
+    }
+    flock(fd, LOCK_EX);
+    int64_t nrec = NRecords(fd);
+    Index idx;
+    LoadIndex(fd, nrec, idx);
+    int64_t now = (int64_t)time(nullptr);
+    int run = CurrentRun();
+    for(size_t i=0;i<recs.size();i++){
+      ResultRec &r = recs[i];
+      r.time = now;
+      if(r.run < 0) r.run = run;
+      Entry &e = idx[Key(r)];
+      r.prev = e.count ? e.last : -1;
+      e.last = nrec + i;
+      e.count++;
+    }
+    bool ok = pwrite(fd, recs.data(), recs.size()*sizeof(ResultRec), nrec*sizeof(ResultRec))
+              == (ssize_t)(recs.size()*sizeof(ResultRec));
+    if(ok) ok = SaveIndex(idx, nrec + recs.size());
+    flock(fd, LOCK_UN);
+    close(fd);
+    return ok;
+  }
+
+  // Last `last` records of (stage, channel), newest first
+  std::vector<ResultRec> History(const std::string &stage, int channel, int last = 50) const {
+    std::vector<ResultRec> out;
+    int fd = open(LogName().c_str(), O_RDONLY);
+    if(fd < 0) return out;
+    flock(fd, LOCK_SH);
+    Index idx;
+    LoadIndex(fd, NRecords(fd), idx);
+    auto found = idx.find({stage, channel});
+    int64_t k = (found == idx.end()) ? -1 : found->second.last;
+    while(k >= 0 && (int)out.size() < last){
+      ResultRec r;
+      if(pread(fd, &r, sizeof(r), k*sizeof(ResultRec)) != (ssize_t)sizeof(r)) break;
+      out.push_back(r);
+      k = r.prev;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+    return out;
+  }
+
+  // (stage, channel) -> number of records
+  std::map<std::pair<std::string, int>, int64_t> Keys() const {
+    std::map<std::pair<std::string, int>, int64_t> keys;
+    int fd = open(LogName().c_str(), O_RDONLY);
+    if(fd < 0) return keys;
+    flock(fd, LOCK_SH);
+    Index idx;
+    LoadIndex(fd, NRecords(fd), idx);
+    flock(fd, LOCK_UN);
+    close(fd);
+    for(const auto &it : idx) keys[it.first] = it.second.count;
+    return keys;
+  }
+
+private:
+  struct Entry{
+    int64_t last = -1;
+    int64_t count = 0;
+  };
+  typedef std::map<std::pair<std::string, int>, Entry> Index;
+
+  // results.idx: "RSIDX1" header, number of log records covered, then per key
+  // stage[16] channel last count
+  struct IdxHeader{
+    char    magic[8];
+    int64_t nrec;
+  };
+  struct IdxEntry{
+    char    stage[16];
+    int32_t channel;
+    int32_t pad;
+    int64_t last;
+    int64_t count;
+  };
+
+  std::string LogName() const { return fDir + "/results.log"; }
+  std::string IdxName() const { return fDir + "/results.idx"; }
+
+  static std::pair<std::string, int> Key(const ResultRec &r){
+    return {std::string(r.stage, strnlen(r.stage, sizeof(r.stage))), r.channel};
+  }
+
+  static int64_t NRecords(int fd){
+    struct stat st;
+    if(fstat(fd, &st) != 0) return 0;
+    return st.st_size / sizeof(ResultRec);   // a torn last record is overwritten by the next append
+  }
+
+  // index of the first nrec records of the log: results.idx, plus a scan of the records
+  // written after it
+  void LoadIndex(int logfd, int64_t nrec, Index &idx) const {
+    int64_t covered = 0;
+    FILE *in = fopen(IdxName().c_str(), "rb");
+    if(in){
+      IdxHeader h;
+      if(fread(&h, sizeof(h), 1, in) == 1 && memcmp(h.magic, "RSIDX1", 6) == 0 && h.nrec <= nrec){
+        IdxEntry e;
+        while(fread(&e, sizeof(e), 1, in) == 1){
+          Entry &x = idx[{std::string(e.stage, strnlen(e.stage, sizeof(e.stage))), e.channel}];
+          x.last = e.last;
+          x.count = e.count;
+        }
+        covered = h.nrec;
+      }
+      fclose(in);
+    }
+    for(int64_t k=covered;k<nrec;k++){
+      ResultRec r;
+      if(pread(logfd, &r, sizeof(r), k*sizeof(ResultRec)) != (ssize_t)sizeof(r)) break;
+      Entry &x = idx[Key(r)];
+      x.last = k;
+      x.count++;
+    }
+  }
+
+  // written to a temporary file and renamed, so readers never see half an index
+  bool SaveIndex(const Index &idx, int64_t nrec) const {
+    std::string tmp = IdxName() + ".tmp" + std::to_string((long)getpid());
+    FILE *out = fopen(tmp.c_str(), "wb");
+    if(!out) return false;
+    IdxHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "RSIDX1", 6);
+    h.nrec = nrec;
+    bool ok = fwrite(&h, sizeof(h), 1, out) == 1;
+    for(const auto &it : idx){
+      IdxEntry e;
+      memset(&e, 0, sizeof(e));
+      strncpy(e.stage, it.first.first.c_str(), sizeof(e.stage)-1);
+      e.channel = it.first.second;
+      e.last = it.second.last;
+      e.count = it.second.count;
+      ok = ok && fwrite(&e, sizeof(e), 1, out) == 1;
+    }
+    ok = (fclose(out) == 0) && ok;
+    if(ok) ok = rename(tmp.c_str(), IdxName().c_str()) == 0;
+    if(!ok) remove(tmp.c_str());
+    return ok;
+  }
+
+  std::string fDir;
+};
+
+#endif
@@ -0,0 +1,33 @@
+// ShardOptions.h: leading command-line options shared by the histogram makers, used by
+// the sharded mode of Run.sh (one process per part of the AnalysisTree file list).
+//   -o <file>  fill only: write every non-empty histogram of this shard to <file>
+//   -i <file>  no fill: take the (merged) histograms from <file>, then continue as usual
+// The shards are added together with MergeHists (Common/MergeHists.cxx).
+#ifndef SHARDOPTIONS_H
+#define SHARDOPTIONS_H
+
+#include <string>
+#include <cstring>
+
+struct ShardOptions{
+  std::string out;  // -o
+  std::string in;   // -i
+};
+
+// Strips the options from argc/argv, so argv[1]... are the usual positional arguments.
+inline ShardOptions ParseShardOptions(int &argc, char **&argv){
+  ShardOptions opt;
+  int n = 1;
+  while(n+1 < argc && argv[n][0] == '-'){
+    if(strcmp(argv[n], "-o") == 0)      opt.out = argv[n+1];
+    else if(strcmp(argv[n], "-i") == 0) opt.in  = argv[n+1];
+    else break;
+    n += 2;
+  }
+  argv[n-1] = argv[0];
+  argv += n-1;
+  argc -= n-1;
+  return opt;
+}
+
+#endif
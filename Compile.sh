@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# =============================
+# Build script for the top-level tools
+# The pipeline programs are built by AlphaCalibration/Compile.sh and HPGe_Codes/Compile.sh
+# =============================
+
+CXX=g++
+CXXFLAGS="-O2 -march=native -fno-trapping-math -pthread"
+
+BINDIR="bins"
+mkdir -p "$BINDIR"
+
+ROOTFLAGS=$(root-config --cflags --libs)
+
+echo "Compiling GausFitBatch..."
+$CXX GausFitBatch.cxx $CXXFLAGS $ROOTFLAGS -lMinuit2 -o "$BINDIR/GausFitBatch"
+echo "✔ GausFitBatch built → $BINDIR/GausFitBatch"
@@ -0,0 +1,179 @@
+//g++ GausFitBatch.cxx -o bins/GausFitBatch `root-config --cflags --libs` -lMinuit2 -O2 -march=native -fno-trapping-math -pthread
+
+// Headless batch driver for the GausFit.C multi-peak fit.
+// Fits a list of (histogram, centroids, range, bg order) jobs on a pool of worker threads
+// and writes areas, centroids, sigmas and chi2/(NDF-1) to a text file, plus the fitted
+// histograms with their component functions to a ROOT file. Nothing is drawn.
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TH1.h>
+#include <TStopwatch.h>
+#include <Math/MinimizerOptions.h>
+
+#include "GausFit.C"
+
+// ============= job description ============= //
+struct FitJob{
+  std::string file;
+  std::string hname;
+  double lower = 0;
+  double upper = 0;
+  int bgorder  = 1;
+  std::vector<double> cents;
+  TH1 *hist = nullptr;    // private clone, owned by the job
+  MultGausResult res;
+};
+
+// ============= ReadJobFile() ============= //
+// One job per line, '#' for comments:
+//   rootfile  histname  lower  upper  bgorder  cent1 [cent2 ...]
+std::vector<FitJob> ReadJobFile(const std::string& filename){
+  std::vector<FitJob> jobs;
+  std::ifstream infile(filename);
+  if(!infile.is_open()){
+    std::cerr << "Cannot open job file: " << filename << std::endl;
+    return jobs;
+  }
+  std::string line;
+  int nline = 0;
+  while(std::getline(infile, line)){
+    nline++;
+    if(line.empty() || line[0] == '#') continue;
+    std::stringstream ss(line);
+    FitJob job;
+    if(!(ss >> job.file >> job.hname >> job.lower >> job.upper >> job.bgorder)){
+      std::cerr << "Skip line " << nline << ": " << line << std::endl;
+      continue;
+    }
+    double cent;
+    while(ss >> cent) job.cents.push_back(cent);
+    if(job.cents.empty()){
+      std::cerr << "Skip line " << nline << ": no centroid given" << std::endl;
+      continue;
+    }
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+// ============= LoadHists() ============= //
+// Read every histogram once per file (single thread, I/O only) and give each job its own clone.
+void LoadHists(std::vector<FitJob>& jobs){
+  std::map<std::string, std::vector<FitJob *>> byfile;
+  for(auto &job : jobs) byfile[job.file].push_back(&job);
+  for(auto &[fname, fjobs] : byfile){
+    TFile *file = TFile::Open(fname.c_str());
+    if(!file || file->IsZombie()){
+      std::cerr << "Cannot open file: " << fname << std::endl;
+      continue;
+    }
+    for(FitJob *job : fjobs){
+      TH1 *h = (TH1 *)file->Get(job->hname.c_str());
+      if(!h){
+        std::cerr << "No histogram " << job->hname << " in " << fname << std::endl;
+        continue;
+      }
+      job->hist = (TH1 *)h->Clone(Form("%s_job%li", job->hname.c_str(), job - jobs.data()));
+      job->hist->SetDirectory(nullptr);
+    }
+    file->Close();
+  }
+}
+
+// ============= RunJobs() ============= //
+// Workers take the next job index from a shared counter until the list is empty.
+void RunJobs(std::vector<FitJob>& jobs, int nworkers){
+  std::atomic<int> next(0);
+  std::atomic<int> ndone(0);
+  int njobs = jobs.size();
+  auto worker = [&](){
+    int ijob;
+    while((ijob = next++) < njobs){
+      FitJob &job = jobs[ijob];
+      if(job.hist){
+        job.res = MultGausFitCore(job.hist, job.cents, job.lower, job.upper, 0.0, job.bgorder,
+                                  2., 5., Form("_job%i",ijob), true);
+      }
+      int done = ++ndone;
+      if(done%10 == 0 || done == njobs){
+        printf("Fitting job: %i / %i \r", done, njobs);
+        fflush(stdout);
+      }
+    }
+  };
+  std::vector<std::thread> pool;
+  for(int i=0;i<nworkers;i++) pool.emplace_back(worker);
+  for(auto &t : pool) t.join();
+  printf("\n");
+}
+
+// ============= WriteResults() ============= //
+void WriteResults(const std::vector<FitJob>& jobs, const std::string& prefix){
+  std::ofstream outfile(prefix + ".dat");
+  outfile << "# Job\tHist\tPeak\tCentroid\tCentErr\tSigma\tSigmaErr\tArea\tChi2/(NDF-1)\tStatus\n";
+  for(int i=0;i<(int)jobs.size();i++){
+    const FitJob &job = jobs[i];
+    if(!job.hist || job.res.npeak<1) continue;
+    for(int j=0;j<job.res.npeak;j++){
+      outfile << i << '\t' << job.hname << '\t' << j+1 << '\t'
+              << job.res.cents[j] << '\t' << job.res.cent_errs[j] << '\t'
+              << job.res.sigma << '\t' << job.res.sigma_err << '\t'
+              << job.res.areas[j] << '\t' << job.res.chi2 << '\t' << job.res.status << '\n';
+    }
+  }
+  outfile.close();
+
+  TFile *newf = new TFile((prefix + ".root").c_str(), "recreate");
+  newf->cd();
+  for(const auto &job : jobs){
+    if(job.hist) job.hist->Write(); // written with fx, f1..fN and fbg attached
+  }
+  newf->Close();
+}
+
+// =============== main() =================== //
+// argv1: job file (see ReadJobFile())
+// argv2: output prefix, writes <prefix>.dat and <prefix>.root (default: gausfit_batch)
+// argv3: number of worker threads (default: all cores)
+// argv4: "grad" to use the analytic-gradient fit (optional)
+int main(int argc, char **argv){
+  if(argc<2){
+    printf("Input job file [output prefix] [n workers] [grad]\n");
+    return 1;
+  }
+  std::string prefix = argc>2 ? argv[2] : "gausfit_batch";
+  int nworkers = argc>3 ? atoi(argv[3]) : std::thread::hardware_concurrency();
+  if(nworkers<1) nworkers = 1;
+  gGradFit = (argc>4 && std::string(argv[4]) == "grad");
+
+  gROOT->SetBatch(kTRUE);
+  ROOT::EnableThreadSafety();
+  ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2"); // TMinuit is not thread safe
+  ROOT::Math::MinimizerOptions::SetDefaultPrintLevel(-1);
+  TH1::AddDirectory(kFALSE);
+
+  std::vector<FitJob> jobs = ReadJobFile(argv[1]);
+  if(jobs.empty()){
+    printf("No valid job in %s\n", argv[1]);
+    return 1;
+  }
+  TStopwatch sw;
+  LoadHists(jobs);
+  RunJobs(jobs, nworkers);
+  WriteResults(jobs, prefix);
+  sw.Stop();
+
+  printf("%zu jobs, %i workers, %.2f s\nOutput: %s.dat, %s.root\n",
+         jobs.size(), nworkers, sw.RealTime(), prefix.c_str(), prefix.c_str());
+  return 0;
+}
@@ -11,8 +11,8 @@ echo "🧹 Cleaning calibration workspace"
 echo "==============================================="
 
 # 1️⃣  Remove all *.root and *.dat files in the current directory
-echo "[INFO] Removing all *.root and *.dat files in current directory..."
-rm -f ./*.root ./*.dat
+echo "[INFO] Removing all *.root, *.dat, *.bin and *.chsnap files in current directory..."
+rm -f ./*.root ./*.dat ./*.bin ./*.chsnap
 echo "✅ Done."
 
 # 2️⃣  Clean peaks/ folder (no confirmation)
@@ -24,7 +24,22 @@ else
   echo "[INFO] Peaks directory not found. Skipping."
 fi
 
-# 3️⃣  Ask before cleaning co60/ folder
+# Remove shard outputs of the sharded Run.sh mode and the performance reports
+rm -rf ./shards ./perf
+
+# 3️⃣  Ask before cleaning hist_cache/ folder (per-file partial histograms)
+if [[ -d "./hist_cache" ]]; then
+  echo
+  read -p "⚠️  Do you want to delete the histogram cache hist_cache/? (y/N): " confirm
+  if [[ "$confirm" == "y" || "$confirm" == "Y" ]]; then
+    rm -rf ./hist_cache
+    echo "✅ hist_cache/ deleted."
+  else
+    echo "❎ Skipped cleaning hist_cache/."
+  fi
+fi
+
+# 4️⃣  Ask before cleaning co60/ folder
 if [[ -d "$CO60_DIR" ]]; then
   echo
   read -p "⚠️  Do you want to delete all files in $CO60_DIR/? (y/N): " confirm
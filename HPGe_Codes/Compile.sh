@@ -14,10 +14,10 @@ COMMON_FLAGS="-Wl,--no-as-needed `root-config --cflags --libs --glibs` \
 -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA \
 -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries \
 `grsi-config --cflags --all-libs --GRSIData-libs` \
--I$GRSISYS/GRSIData/include -lROOTTPython"
+-I$GRSISYS/GRSIData/include -I../Common -lROOTTPython"
 
 # =============================
-# COMPILE THREE PROGRAMS
+# COMPILE ALL PROGRAMS
 # =============================
 echo "===================================="
 echo "🚀 Compiling co60_linfit.cxx ..."
@@ -31,6 +31,24 @@ echo "===================================="
 echo "🚀 Compiling Calibration.cxx ..."
 g++ "$SRC_DIR/Calibration.cxx" $COMMON_FLAGS -o "$BIN_DIR/Calibration" || { echo "❌ Failed: Calibration"; exit 1; }
 
+echo "===================================="
+echo "🚀 Compiling GammaMatrix.cxx ..."
+g++ "$SRC_DIR/GammaMatrix.cxx" $COMMON_FLAGS -pthread -o "$BIN_DIR/GammaMatrix" || { echo "❌ Failed: GammaMatrix"; exit 1; }
+
+echo "===================================="
+echo "🚀 Compiling MergeHists.cxx ..."
+g++ "../Common/MergeHists.cxx" -O2 `root-config --cflags --libs` -o "$BIN_DIR/MergeHists" || { echo "❌ Failed: MergeHists"; exit 1; }
+
+echo "===================================="
+echo "🚀 Compiling ResultsQuery.cxx ..."
+g++ "../Common/ResultsQuery.cxx" -O2 -o "$BIN_DIR/ResultsQuery" || { echo "❌ Failed: ResultsQuery"; exit 1; }
+
+echo "===================================="
+echo "🚀 Compiling CalibChain.cxx ..."
+g++ "../Common/CalibChain.cxx" -Wl,--no-as-needed `root-config --cflags --libs` -lSpectrum -lMinuit -O2 -pthread \
+  -Wl,--copy-dt-needed-entries `grsi-config --cflags --all-libs --GRSIData-libs` \
+  -I$GRSISYS/GRSIData/include -I../Common -o "$BIN_DIR/CalibChain" || { echo "❌ Failed: CalibChain"; exit 1; }
+
 echo "===================================="
 echo "✅ All programs compiled successfully!"
 echo "Executables saved to: $BIN_DIR/"
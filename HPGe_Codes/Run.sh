@@ -17,6 +17,70 @@ SOURCE_LIST=(
   "60co ${ANALYSIS_FILES_CO60[*]}"
   "56co /tig/pterodon_data3/S2426/AnalysisTrees/analysis62095* /tig/pterodon_data3/S2426/AnalysisTrees/analysis620956_0*"
 )
+# Results store: every fit is also appended to $RESULTS_STORE (default results/) under the
+# run number CAL_RUN, taken from the first input file name (analysis62347_000.root -> 62347)
+# unless set by hand. Query with ResultsQuery, e.g. "ResultsQuery co60 16 50".
+export RESULTS_STORE="${RESULTS_STORE-results}"
+export CAL_RUN="${CAL_RUN:-$(basename "${ANALYSIS_FILES_CO60[0]}" | sed -n 's/.*\([0-9]\{5\}\)_[0-9]*\.root$/\1/p')}"
+# Single process (1 = yes, 0 = no): STEP 1~3 in one CalibChain process, histograms stay in
+# memory between the steps (same output files; NSHARDS and MAX_PARALLEL are not used)
+SINGLE_PROCESS=0
+CHAIN_THREADS=4            # AnalysisTree files filled at the same time in single-process mode
+# Gain drift tracking (not sharded): DRIFT_SLICE > 0 makes co60_linfit and Calibration_HistMaker
+# also track the gain of every crystal in slices of DRIFT_SLICE seconds in the same pass and
+# write drift_<source>.dat (saved in co60/ and peaks/). DRIFT_REFILL=1 refills and refits
+# every source with its correction (one more pass over the input). One run per source: the
+# slices follow the time stamps, which restart with every run.
+DRIFT_SLICE=0
+DRIFT_REFILL=0
+# Sharded mode: split the AnalysisTree files of each step into NSHARDS parts, one process each
+# (1 = single process). Partial outputs go to shards/, MergeHists adds them up.
+NSHARDS=1
+
+# =============================
+# run_sharded EXE NAME ARGS... -- FILES...
+# Run "EXE -o shards/NAME_<n>.root ARGS... <files of shard n>" for every shard in the
+# background and merge them into shards/NAME.root; then "EXE -i shards/NAME.root ARGS..."
+# does the fits. The shard commands can also be sent to separate batch nodes.
+# =============================
+run_sharded() {
+  local exe="$1" name="$2"
+  shift 2
+  local args=()
+  while [[ $# -gt 0 && "$1" != "--" ]]; do args+=("$1"); shift; done
+  shift
+  local files=("$@")
+  local per=$(( (${#files[@]} + NSHARDS - 1) / NSHARDS ))
+  mkdir -p shards
+  rm -f shards/"${name}"_*.root
+  for ((n=0; n<NSHARDS; n++)); do
+    local part=("${files[@]:$((n*per)):$per}")
+    [[ ${#part[@]} -eq 0 ]] && continue
+    "$exe" -o "shards/${name}_${n}.root" "${args[@]}" "${part[@]}" > "shards/${name}_${n}.log" 2>&1 &
+  done
+  wait
+  "$BIN_DIR/MergeHists" "shards/${name}.root" shards/"${name}"_*.root
+}
+
+# =============================
+# STEP 1~3 in one process
+# =============================
+if [[ $SINGLE_PROCESS -eq 1 ]]; then
+  echo "===================================="
+  echo "🔹 STEP 1~3: CalibChain hpge"
+  echo "===================================="
+  CHAIN_ARGS=(-s 60co "${ANALYSIS_FILES_CO60[@]}")
+  for entry in "${SOURCE_LIST[@]}"; do
+    source_name=$(echo "$entry" | awk '{print $1}')
+    files=( $(echo "$entry" | cut -d' ' -f2-) )
+    [[ ${#files[@]} -eq 0 ]] && continue
+    CHAIN_ARGS+=(-s "$source_name" "${files[@]}")
+  done
+  "$BIN_DIR/CalibChain" hpge -nthreads "$CHAIN_THREADS" "$CAL_FILE" "${CHAIN_ARGS[@]}" || exit 1
+  echo "✅ co60/, peaks/, cal_pars.dat and calibration.root written."
+  exit 0
+fi
+
 # =============================
 # STEP 1: Run co60_linfit
 # =============================
@@ -28,7 +92,17 @@ if [[ -f "${CO60_DIR}/co60_linfit.dat" ]]; then
   echo "✅ co60_linfit.dat already exists, skipping Co60 fit."
 else
   echo "Running Co60 linear fit..."
-  "$BIN_DIR/co60_linfit" "$CAL_FILE" "${ANALYSIS_FILES_CO60[@]}"
+  if (( NSHARDS > 1 )); then
+    run_sharded "$BIN_DIR/co60_linfit" co60 "$CAL_FILE" -- "${ANALYSIS_FILES_CO60[@]}"
+    "$BIN_DIR/co60_linfit" -i shards/co60.root "$CAL_FILE"
+  elif (( DRIFT_SLICE > 0 )); then
+    "$BIN_DIR/co60_linfit" -drift "$DRIFT_SLICE" "$CAL_FILE" "${ANALYSIS_FILES_CO60[@]}"
+    if (( DRIFT_REFILL == 1 )) && [[ -f drift_60co.dat ]]; then
+      "$BIN_DIR/co60_linfit" -driftcor drift_60co.dat "$CAL_FILE" "${ANALYSIS_FILES_CO60[@]}"
+    fi
+  else
+    "$BIN_DIR/co60_linfit" "$CAL_FILE" "${ANALYSIS_FILES_CO60[@]}"
+  fi
   echo "Done."
 
   # Create output directory if missing
@@ -37,6 +111,7 @@ else
   # Move results
   [[ -f "co60_linfit.dat" ]] && mv co60_linfit.dat "$CO60_DIR/"
   [[ -f "co60_linfit.root" ]] && mv co60_linfit.root "$CO60_DIR/"
+  [[ -f "drift_60co.dat" ]] && mv drift_60co.dat "$CO60_DIR/"
 
   echo "Results saved to: $CO60_DIR/"
 fi
@@ -74,11 +149,22 @@ for entry in "${SOURCE_LIST[@]}"; do
   (
     # ======= Start background job =======
     # Run Calibration_HistMaker for this source
-    "$BIN_DIR/Calibration_HistMaker" "$CAL_FILE" "$source_name" "${files[@]}"
+    if (( NSHARDS > 1 )); then
+      run_sharded "$BIN_DIR/Calibration_HistMaker" "$source_name" "$CAL_FILE" "$source_name" -- "${files[@]}"
+      "$BIN_DIR/Calibration_HistMaker" -i "shards/${source_name}.root" "$CAL_FILE" "$source_name"
+    elif (( DRIFT_SLICE > 0 )); then
+      "$BIN_DIR/Calibration_HistMaker" -drift "$DRIFT_SLICE" "$CAL_FILE" "$source_name" "${files[@]}"
+      if (( DRIFT_REFILL == 1 )) && [[ -f "drift_${source_name}.dat" ]]; then
+        "$BIN_DIR/Calibration_HistMaker" -driftcor "drift_${source_name}.dat" "$CAL_FILE" "$source_name" "${files[@]}"
+      fi
+    else
+      "$BIN_DIR/Calibration_HistMaker" "$CAL_FILE" "$source_name" "${files[@]}"
+    fi
 
     # Move result files to the peaks folder
     [[ -f "peaks_${source_name}.dat" ]] && mv "peaks_${source_name}.dat" "$PEAKS_DIR/"
     [[ -f "peaks_${source_name}.root" ]] && mv "peaks_${source_name}.root" "$PEAKS_DIR/"
+    [[ -f "drift_${source_name}.dat" ]] && mv "drift_${source_name}.dat" "$PEAKS_DIR/"
 
     echo "✅ Finished $source_name"
     # ======= End background job =======
@@ -1,4 +1,4 @@
-//g++ Calibration.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -o Calibration
+//g++ Calibration.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -I../../Common -o Calibration
 
 
 #include <iostream>
@@ -25,6 +25,7 @@
 #include "TChannel.h"
 #include "TTigress.h"
 #include "TTigressHit.h"
+#include "CalibCore.h"   // FormatIsotopeName(), FitQuadCal(), WriteCalPars(), FillSummary()
 
 TList *glist;
 TH2D *sumc;
@@ -35,26 +36,12 @@ double offset[64];
 std::vector<std::vector<double>> uncalE(64);
 std::vector<std::vector<double>> uncalE_err(64);
 std::vector<std::vector<double>> energies(64);
-std::vector<std::vector<double>> energies_err(64);
 // ================================ After this, need GRSISort Structure ======================== //
 void Initialize(){
   glist = new TList; 
   sumc = new TH2D("sumc","uncalibrated summary plot", 4000,0,4000,64,0,64);
   sume = new TH2D("sume","calibrated summary plot"  , 4000,0,4000,64,0,64);
 }
-// ============================ Source Name Format ========================================//
-// convert input source name to number + lowercase letter (eg, 60co, 133ba)
-std::string FormatIsotopeName(const std::string& srcName="60co") {
-  std::string number, letters;
-  for (char c : srcName) {
-    if (std::isdigit(c))
-      number += c;
-    else if (std::isalpha(c))
-      letters += std::tolower(c);  // ensure lowercase                                                                                                                                                             
-  }       
-  return number + letters;
-}
-
 // ====================================== ReadPeaksFile() ========================================//
 void ReadPeaksFile(const std::string& source){
   std::ifstream infile(Form("peaks/peaks_%s.dat", source.c_str()));
@@ -76,59 +63,19 @@ void ReadPeaksFile(const std::string& source){
   }    
 }
 
-// ====================================== Calibrate() ========================================//
-void WriteCalibFile(const std::string& filename="cal_pars.dat") {
-  std::ofstream fout(filename);
-  fout << "float non_lin[64] = {";
-  for (int i = 0; i < 64; ++i) {
-    fout << quad[i];
-    if (i != 63) fout << ", ";
-  }
-  fout << "};\n";
-
-  fout << "float gain[64] = {";
-  for (int i = 0; i < 64; ++i) {
-    fout << gain[i];
-    if (i != 63) fout << ", ";
-  }
-  fout << "};\n";
-
-  fout << "float offset[64] = {";
-  for (int i = 0; i < 64; ++i) {
-    fout << offset[i];
-    if (i != 63) fout << ", ";
-  }
-  fout << "};\n";
-
-  fout.close();
-}
-
 // ====================================== Calibrate() ========================================//
 void Calibrate(){
   for(int i=0;i<uncalE.size();i++){
     std::cout << "Fitting array " << i 
               << ": N points = " << uncalE[i].size() << std::endl;
     if(uncalE[i].empty()) continue;
-    energies_err[i].resize(energies[i].size(), 0.0);
-    TGraphErrors *gr = new TGraphErrors(uncalE[i].size(),
-                                        uncalE[i].data(), energies[i].data(), 
-                                        uncalE_err[i].data(),energies_err[i].data());
-    gr->SetName(Form("gr%i",i));
-    TF1 *fx = new TF1(Form("fx%i",i), "[0]+[1]*x+[2]*x*x");
-    fx->SetParameters(30,1.5,1e-6);
-    gr->Fit(fx,"Q");
-    offset[i] = fx->GetParameter(0);
-    gain[i] = fx->GetParameter(1);
-    quad[i] = fx->GetParameter(2);
+    TGraphErrors *gr = FitQuadCal(i, uncalE[i], uncalE_err[i], energies[i], quad[i], gain[i], offset[i]);
     glist->Add(gr);
   } // i (array number) loop over
 }
 
 // ====================================== DrawSum(): Draw Summary Plot ====================================//
 void DrawSum(std::vector<std::string> sources){
-  // arraynum -> (bin center) -> content
-  std::map<int, std::map<double, double>> unc; 
-  std::map<int, std::map<double, double>> cal; 
   for(int i=0;i<sources.size();i++){
     TFile *curfile = TFile::Open(Form("peaks/peaks_%s.root",sources[i].c_str()));
     if (!curfile || curfile->IsZombie()) {
@@ -138,33 +85,17 @@ void DrawSum(std::vector<std::string> sources){
     for(int j=0;j<64;j++){
       TH1D *htemp = (TH1D *)curfile->Get(Form("hs%i",j));
       if(! htemp || htemp->GetEntries()==0) continue;
-      for(int n=1;n<=htemp->GetNbinsX();n++){
-        double charge = htemp->GetBinCenter(n);
-        double energy = offset[j] + gain[j]*charge + quad[j]*charge*charge;
-        double content = htemp->GetBinContent(n);
-        unc[j][charge] += content;
-        cal[j][energy] += content;
-      }// n (# of bin in the histogram) loop over
+      FillSummary(sumc, sume, htemp, j, quad[j], gain[j], offset[j]);
     } // j (array number) loop over
     curfile->Close();
   } // i (sources) loop over 
-  
-  for (const auto& [arraynum, charge_map] : unc) {
-    for (const auto& [charge, content] : charge_map) {
-      sumc->Fill(charge, arraynum, content);  
-    }
-  }
-  for (const auto& [arraynum, energy_map] : cal) {
-    for (const auto& [energy, content] : energy_map) {
-      sume->Fill(energy, arraynum, content);  
-    }
-  }
 }
 
 // ====================================== main() ==========================================//
 // argv1...: sources name
 int main(int argc, char** argv){
 
+  gPerf.Start("Calibration", argc, argv);
   Initialize();
   
   if(argc<2){
@@ -189,13 +120,15 @@ int main(int argc, char** argv){
   DrawSum(sources); 
   
   // Step 5: write calibration coefficiency, and write the root file
-  WriteCalibFile();
+  WriteCalPars(quad, gain, offset);
+  StoreQuadCal(quad, gain, offset, glist);
   TFile *newf = new TFile("calibration.root", "recreate");
   newf->cd();
   sumc->Write();
   sume->Write();
   glist->Write();
   newf->Close(); 
+  gPerf.Write();
 
   return 0;
 }
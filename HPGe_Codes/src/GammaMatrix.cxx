@@ -0,0 +1,367 @@
+//g++ GammaMatrix.cxx -Wl,--no-as-needed `root-config --cflags --libs --glibs` -lSpectrum -lMinuit -lGuiHtml -lTreePlayer -lTMVA -L/opt/local/lib -lX11 -lXpm -O2 -Wl,--copy-dt-needed-entries -L/opt/local/lib -lX11 -lXpm `grsi-config --cflags --all-libs --GRSIData-libs` -I$GRSISYS/GRSIData/include -I../../Common -pthread -o GammaMatrix
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TChain.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TStopwatch.h>
+#include "TChannel.h"
+#include "TTigress.h"
+#include "TTigressHit.h"
+#include "InputIndex.h"
+#include "PerfReport.h"
+#include "ChannelTable.h"
+#include "CompactEvent.h"
+
+// γγ matrix: kMatBins x kMatBins, 1 keV/bin, 0~4096 keV
+// γγγ cube : kCubeBins^3, kCubeKeV keV/bin, 0~4096 keV
+// Both are symmetric, so only the i<=j (i<=j<=k) triangle is stored, as uint32 counts.
+const int kMatBins  = 4096;
+const double kMatKeV  = 1.0;
+const int kCubeBins = 1024;
+const double kCubeKeV = 4.0;
+const double kEmin    = 10.0;    // keV, ignore hits below
+const int kMaxHits    = 64;      // hits per event used for coincidences
+const int kTdiffBins  = 2000;    // tdiff spectrum: 1 ns/bin, -1000~1000 ns
+
+float non_lin[64];
+float gain[64];
+float offset[64];
+
+// ============================ Packed triangle index ========================================//
+inline uint64_t MatIndex(uint32_t i, uint32_t j){ // i<=j
+  return (uint64_t)j*(j+1)/2 + i;
+}
+inline uint64_t CubeIndex(uint32_t i, uint32_t j, uint32_t k){ // i<=j<=k
+  return (uint64_t)k*(k+1)*(k+2)/6 + (uint64_t)j*(j+1)/2 + i;
+}
+const uint64_t kMatSize  = MatIndex(0, kMatBins);
+const uint64_t kCubeSize = CubeIndex(0, 0, kCubeBins);
+
+// ============================ Read cal_pars.dat File ========================================//
+// Format written by Calibration.cxx: "float gain[64] = {g0, g1, ...};" for non_lin, gain, offset.
+// E = offset + gain*charge + non_lin*charge^2
+bool ReadCalPars(const std::string& filename = "cal_pars.dat"){
+  std::ifstream infile(filename);
+  if (!infile.is_open()) {
+    std::cerr << "Failed to open file: " << filename << std::endl;
+    return false;
+  }
+  int nfound = 0;
+  std::string line;
+  while (std::getline(infile, line)) {
+    size_t lb = line.find('{');
+    size_t rb = line.find('}');
+    if (lb == std::string::npos || rb == std::string::npos) continue;
+    float *pars = nullptr;
+    if (line.find("non_lin") != std::string::npos)     pars = non_lin;
+    else if (line.find("gain") != std::string::npos)   pars = gain;
+    else if (line.find("offset") != std::string::npos) pars = offset;
+    if (!pars) continue;
+    std::string values = line.substr(lb+1, rb-lb-1);
+    std::replace(values.begin(), values.end(), ',', ' ');
+    std::stringstream ss(values);
+    int n = 0;
+    while (n < 64 && ss >> pars[n]) n++;
+    if (n == 64) nfound++;
+  }
+  return nfound == 3;
+}
+
+// ============================ Shard: one per thread ========================================//
+struct Shard{
+  std::vector<uint32_t> mat;
+  std::vector<uint32_t> tdiff;
+  std::vector<double> singles;
+  long npairs   = 0;
+  long ntriples = 0;
+  Shard() : mat(kMatSize, 0), tdiff(kTdiffBins, 0), singles(kMatBins, 0) {}
+};
+
+// ============================ EventHits ========================================//
+// Calibrated hits of one event, as matrix and cube bins
+struct EventHits{
+  double   t[kMaxHits];
+  uint32_t mbin[kMaxHits];
+  uint32_t cbin[kMaxHits];
+  int n = 0;
+
+  // false once kMaxHits hits are taken
+  bool Add(int arryn, double charge, double time, Shard *shard){
+    if (n == kMaxHits) return false;
+    double energy = offset[arryn] + gain[arryn]*charge + non_lin[arryn]*charge*charge;
+    if (energy < kEmin || energy >= kMatBins*kMatKeV) return true;
+    t[n] = time;
+    mbin[n] = (uint32_t)(energy/kMatKeV);
+    cbin[n] = std::min((uint32_t)(energy/kCubeKeV), (uint32_t)(kCubeBins-1));
+    shard->singles[mbin[n]] += 1;
+    n++;
+    return true;
+  }
+
+  // tdiff of every pair, matrix of the pairs and cube of the triples within tgate
+  void Fill(double tgate, Shard *shard, uint32_t *cube) const {
+    for (int i = 0; i < n; i++) {
+      for (int j = i+1; j < n; j++) {
+        double dt = t[j] - t[i];
+        int tb = (int)std::floor(dt) + kTdiffBins/2;
+        if (tb >= 0 && tb < kTdiffBins) shard->tdiff[tb]++;
+        if (std::fabs(dt) > tgate) continue;
+        shard->mat[MatIndex(std::min(mbin[i],mbin[j]), std::max(mbin[i],mbin[j]))]++;
+        shard->npairs++;
+        if (!cube) continue;
+        for (int k = j+1; k < n; k++) {
+          if (std::fabs(t[k]-t[i]) > tgate || std::fabs(t[k]-t[j]) > tgate) continue;
+          uint32_t b[3] = {cbin[i], cbin[j], cbin[k]};
+          std::sort(b, b+3);
+          __atomic_fetch_add(&cube[CubeIndex(b[0],b[1],b[2])], 1u, __ATOMIC_RELAXED);
+          shard->ntriples++;
+        }
+      }
+    }
+  }
+};
+
+// TIGRESS core channel (TI...00A) of an EventTree hit: its crystal index, -1 otherwise.
+// Only the A output is taken, as the TTigress hits of the AnalysisTree.
+inline int CoreArray(int number){
+  const ChannelRec *rec = gChannels.Get(number);
+  if (!rec || rec->array < 0 || rec->array > 63 || rec->segment != 0) return -1;
+  size_t len = strnlen(rec->name, sizeof(rec->name));
+  if (len == 0 || rec->name[len-1] != 'A') return -1;
+  return rec->array;
+}
+
+// ============================ FillRange() ========================================//
+// Loop over entries [first, last) with a private TChain and TTigress object, or, with
+// compact, the EventTree of EventBuilder (CompactEvent) with its TIGRESS core hits.
+// Matrix counts go to the thread's own shard; cube counts (too large to copy per thread)
+// go to the shared cube with relaxed atomic increments.
+// counts: entries of each file (InputIndex), so the chain does not open files before its range
+void FillRange(const std::vector<std::string>& files, const std::vector<long>& counts,
+               bool compact, long first, long last, double tgate,
+               Shard *shard, uint32_t *cube, std::atomic<long> *ndone){
+  TChain chain(compact ? "EventTree" : "AnalysisTree");
+  for (size_t i = 0; i < files.size(); i++) {
+    if (counts[i] > 0) chain.Add(files[i].c_str(), counts[i]);
+  }
+  TTigress *tig = NULL;
+  CompactEvent ev;
+  if (compact) {
+    ev.SetBranches(&chain);
+  } else {
+    chain.SetBranchStatus("*", 0);
+    chain.SetBranchStatus("TTigress*", 1);
+    chain.SetBranchAddress("TTigress", &tig);
+  }
+  chain.SetCacheSize(64*1024*1024);
+
+  EventHits hits;
+  long nlocal = 0;
+  long nread = 0;
+  double treadsec = 0;
+  auto tstart = std::chrono::steady_clock::now();
+  for (long xentry = first; xentry < last; xentry++) {
+    if (++nlocal == 10000) {   // counted before the read, so a skipped entry still counts
+      *ndone += nlocal;
+      nlocal = 0;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    int nbytes = chain.GetEntry(xentry);
+    treadsec += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (nbytes <= 0) continue;   // read error: do not refill the previous event
+    hits.n = 0;
+    if (compact) {
+      nread += ev.nhits;
+      for (int i = 0; i < ev.nhits; i++) {
+        int arryn = CoreArray(ev.ch[i]);
+        if (arryn < 0) continue;
+        if (!hits.Add(arryn, ev.q[i], ev.t0 + ev.dt[i], shard)) break;
+      }
+    } else {
+      nread += tig->GetMultiplicity();
+      for (int i = 0; i < tig->GetMultiplicity(); i++) {
+        TTigressHit* tig_hit = tig->GetTigressHit(i);
+        int arryn = gChannels.Array(tig_hit->GetAddress());
+        if (arryn < 0 || arryn > 63) continue;
+        if (!hits.Add(arryn, tig_hit->GetCharge(), tig_hit->GetTime(), shard)) break;
+      }
+    }
+    hits.Fill(tgate, shard, cube);
+  } // entries loop over
+  *ndone += nlocal;
+  double loop = std::chrono::duration<double>(std::chrono::steady_clock::now() - tstart).count();
+  gPerf.AddTime("getentry", treadsec);           // summed over the threads
+  gPerf.AddTime("fill", loop - treadsec);
+  gPerf.Count("entries", last - first);
+  gPerf.Count("hits", nread);
+  gPerf.Tree(chain.GetTree());
+}
+
+// ============================ MergeShards() ========================================//
+// Sum the shards and unfold the triangle into a symmetric TH2I: every pair is filled as
+// (E1,E2) and (E2,E1), so a projection of the matrix is the coincidence spectrum.
+TH2I *MergeShards(std::vector<Shard>& shards, TH1D *hsingles, TH1D *htdiff){
+  for (size_t s = 1; s < shards.size(); s++) {
+    for (uint64_t n = 0; n < kMatSize; n++) shards[0].mat[n] += shards[s].mat[n];
+    for (int n = 0; n < kTdiffBins; n++) shards[0].tdiff[n] += shards[s].tdiff[n];
+    for (int n = 0; n < kMatBins; n++) shards[0].singles[n] += shards[s].singles[n];
+  }
+  const Shard& sum = shards[0];
+  TH2I *gg = new TH2I("gg", "symmetrized #gamma#gamma matrix;E_{#gamma} (keV);E_{#gamma} (keV)",
+                      kMatBins, 0, kMatBins*kMatKeV, kMatBins, 0, kMatBins*kMatKeV);
+  Int_t *arr = gg->GetArray();
+  const int nx = kMatBins + 2; // with under/overflow bins
+  double entries = 0;
+  for (int j = 0; j < kMatBins; j++) {
+    for (int i = 0; i <= j; i++) {
+      uint32_t c = sum.mat[MatIndex(i,j)];
+      if (c == 0) continue;
+      arr[(j+1)*nx + (i+1)] += c;
+      arr[(i+1)*nx + (j+1)] += c;
+      entries += 2.*c;
+    }
+  }
+  gg->SetEntries(entries);
+  for (int n = 0; n < kMatBins; n++)   hsingles->SetBinContent(n+1, sum.singles[n]);
+  for (int n = 0; n < kTdiffBins; n++) htdiff->SetBinContent(n+1, sum.tdiff[n]);
+  return gg;
+}
+
+// ============================ WriteCube() ========================================//
+// Binary file: header {char[8] "GGGCUBE1", int32 nbins, float keV/bin, uint64 size},
+// then size uint32 counts of the packed i<=j<=k triangle, index = CubeIndex(i,j,k).
+void WriteCube(const std::vector<uint32_t>& cube, const std::string& filename = "gg_cube.bin"){
+  std::ofstream fout(filename, std::ios::binary);
+  const char magic[8] = {'G','G','G','C','U','B','E','1'};
+  int32_t nbins = kCubeBins;
+  float kev = kCubeKeV;
+  uint64_t size = cube.size();
+  fout.write(magic, 8);
+  fout.write((const char *)&nbins, sizeof(nbins));
+  fout.write((const char *)&kev, sizeof(kev));
+  fout.write((const char *)&size, sizeof(size));
+  fout.write((const char *)cube.data(), size*sizeof(uint32_t));
+  fout.close();
+}
+
+// ====================================== main() ==========================================//
+// argv1: CalibrationFile (channel mapping and time)
+// argv2: cal_pars.dat from Calibration.cxx
+// argv3: time gate |t1-t2| in ns
+// argv4: number of threads (0 = all cores)
+// argv5: "cube" to also fill the γγγ cube, "mat" for the matrix only
+// argv6...: AnalysisTree File Path, or EventTree files (events.root) from EventBuilder
+int main(int argc, char** argv){
+
+  gPerf.Start("GammaMatrix", argc, argv);
+  if(argc<7){
+    printf("Input Calibration file, cal_pars.dat, time gate(ns), nthreads, mat/cube and Analysistree (or EventTree) file paths\n");
+    return 1;
+  }
+  // Step 1: check input files and calibration
+  std::vector<std::string> files;
+  for(int i=6;i<argc;i++){
+    files.push_back(argv[i]);
+  }
+  // AnalysisTree from GRSISort, or EventTree from EventBuilder (plain branches, CompactEvent.h)
+  bool compact = false;
+  TFile *fin = TFile::Open(files[0].c_str(), "read");
+  if(fin && !fin->IsZombie()) compact = !fin->Get("AnalysisTree") && fin->Get("EventTree");
+  delete fin;
+  InputIndex index(compact ? "EventTree" : "AnalysisTree");
+  std::vector<long> counts = index.Count(files);
+  TChain *chain = index.MakeChain(files, counts);
+  long nentries = chain->GetEntries();
+  if(nentries==0){
+    printf("No valid root file input\n");
+    return 1;
+  }
+  if(!compact && !chain->FindBranch("TTigress")){
+    std::cout << "Branch 'TTigress' not found!" << std::endl;
+    return 1;
+  }
+  delete chain;
+  if(compact) printf("Reading EventTree: TIGRESS core (TI...00A) hits, time = t0 + dt\n");
+  char const *calfile = argv[1];
+  if(!LoadChannels(calfile)) return 1;
+  if(!ReadCalPars(argv[2])){
+    std::cout << "Cannot read non_lin/gain/offset from " << argv[2] << "!" << std::endl;
+    return 1;
+  }
+  double tgate  = atof(argv[3]);
+  int nthreads  = atoi(argv[4]);
+  if(nthreads<1) nthreads = std::thread::hardware_concurrency();
+  bool docube   = std::string(argv[5]) == "cube";
+
+  // Step 2: fill the shards, each thread on its own entry range
+  ROOT::EnableThreadSafety();
+  TH1::AddDirectory(kFALSE);
+  std::vector<Shard> shards(nthreads);
+  std::vector<uint32_t> cube;
+  if(docube) cube.assign(kCubeSize, 0);
+  std::atomic<long> ndone(0);
+  TStopwatch sw;
+  std::vector<std::thread> pool;
+  for(int t=0;t<nthreads;t++){
+    long first = nentries*t/nthreads;
+    long last  = nentries*(t+1)/nthreads;
+    pool.emplace_back(FillRange, std::cref(files), std::cref(counts), compact, first, last, tgate, &shards[t],
+                      docube ? cube.data() : nullptr, &ndone);
+  }
+  while(ndone < nentries){
+    printf("Making Matrix on entry: %lu / %lu \r", ndone.load(), nentries);
+    fflush(stdout);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  }
+  for(auto &th : pool) th.join();
+  sw.Stop();
+  long npairs = 0, ntriples = 0;
+  for(const auto &s : shards){
+    npairs   += s.npairs;
+    ntriples += s.ntriples;
+  }
+  printf("Making Matrix DONE!  Entry: %lu / %lu, %.1f s, %.0f entries/s, %i threads\n",
+         nentries, nentries, sw.RealTime(), nentries/sw.RealTime(), nthreads);
+  printf("Pairs: %lu, Triples: %lu\n", npairs, ntriples);
+
+  // Step 3: merge shards and write gg_matrix.root (and gg_cube.bin)
+  TH1D *hsingles = new TH1D("singles", "calibrated singles;E_{#gamma} (keV)", kMatBins, 0, kMatBins*kMatKeV);
+  TH1D *htdiff   = new TH1D("tdiff", "t_{2}-t_{1} of all hit pairs;#Deltat (ns)", kTdiffBins, -kTdiffBins/2, kTdiffBins/2);
+  TH2I *gg;
+  {
+    PerfTimer timer("merge");
+    gg = MergeShards(shards, hsingles, htdiff);
+  }
+  TFile *newf = new TFile("gg_matrix.root", "recreate");
+  newf->cd();
+  gg->Write();
+  hsingles->Write();
+  htdiff->Write();
+  newf->Close();
+  if(docube){
+    WriteCube(cube);
+    printf("Cube saved to gg_cube.bin (%i bins x %.0f keV)\n", kCubeBins, kCubeKeV);
+  }
+  gPerf.Count("pairs", npairs);
+  gPerf.Count("triples", ntriples);
+  gPerf.Write();
+
+  return 0;
+}